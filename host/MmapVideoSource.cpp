@@ -0,0 +1,50 @@
+#include "MmapVideoSource.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MmapVideoSource::MmapVideoSource(const char* path)
+    : hostPath(path), mapping(nullptr), mappingSize(0) {
+}
+
+MmapVideoSource::~MmapVideoSource() {
+    close();
+}
+
+bool MmapVideoSource::open() {
+    if (mapping) {
+        return MemoryVideoSource::open();
+    }
+    
+    int fd = ::open(hostPath, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    
+    void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    
+    mapping = address;
+    mappingSize = info.st_size;
+    setImage((const uint8_t*)mapping, mappingSize);
+    return MemoryVideoSource::open();
+}
+
+void MmapVideoSource::close() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        mappingSize = 0;
+        setImage(nullptr, 0);
+    }
+}
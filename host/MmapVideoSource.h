@@ -0,0 +1,22 @@
+#ifndef MMAP_VIDEO_SOURCE_H
+#define MMAP_VIDEO_SOURCE_H
+
+#include "MemoryVideoSource.h"
+
+// Host counterpart of a .vid baked into program flash: the file is mmap()ed
+// read-only and played in place through MemoryVideoSource.
+class MmapVideoSource : public MemoryVideoSource {
+private:
+    const char* hostPath;
+    void* mapping;
+    size_t mappingSize;
+    
+public:
+    MmapVideoSource(const char* path);
+    ~MmapVideoSource();
+    
+    bool open() override;
+    void close() override;
+};
+
+#endif
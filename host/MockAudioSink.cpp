@@ -0,0 +1,73 @@
+#include "MockAudioSink.h"
+
+MockAudioSink::MockAudioSink(bool realTimeMode, const char* path)
+    : realTime(realTimeMode), outputPath(path), output(nullptr), track(nullptr), rate(0),
+      startMicros(0), pulledSamples(0), deliveredSamples(0) {
+}
+
+MockAudioSink::~MockAudioSink() {
+    if (output) {
+        fclose(output);
+    }
+}
+
+bool MockAudioSink::begin(AudioTrack* audioTrack, uint32_t sampleRate) {
+    end();
+    if (!audioTrack || sampleRate == 0) {
+        return false;
+    }
+    if (outputPath && !output) {
+        output = fopen(outputPath, "wb");
+    }
+    
+    track = audioTrack;
+    rate = sampleRate;
+    startMicros = micros();
+    pulledSamples = 0;
+    deliveredSamples = 0;
+    return true;
+}
+
+void MockAudioSink::end() {
+    track = nullptr;
+}
+
+void MockAudioSink::poll() {
+    if (!track || !realTime) {
+        return;
+    }
+    
+    uint64_t due = (uint64_t)(uint32_t)(micros() - startMicros) * rate / 1000000;
+    while (pulledSamples < due) {
+        pull((uint32_t)min(due - pulledSamples, (uint64_t)AudioTrack::BLOCK_SAMPLES));
+    }
+}
+
+uint32_t MockAudioSink::pull(uint32_t samples) {
+    if (!track) {
+        return 0;
+    }
+    
+    int16_t buffer[AudioTrack::BLOCK_SAMPLES];
+    uint32_t total = 0;
+    
+    while (samples) {
+        uint32_t count = min(samples, (uint32_t)AudioTrack::BLOCK_SAMPLES);
+        uint32_t delivered = track->read(buffer, count);
+        
+        // Real-time output keeps the silence the track filled in.
+        uint32_t written = realTime ? count : delivered;
+        if (output && written) {
+            fwrite(buffer, sizeof(int16_t), written, output);
+        }
+        
+        pulledSamples += written;
+        deliveredSamples += delivered;
+        total += delivered;
+        samples -= count;
+        if (!realTime && delivered < count) {
+            break;
+        }
+    }
+    return total;
+}
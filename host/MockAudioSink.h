@@ -0,0 +1,39 @@
+#ifndef MOCK_AUDIO_SINK_H
+#define MOCK_AUDIO_SINK_H
+
+#include "AudioSink.h"
+#include "AudioTrack.h"
+
+// Host stand-in for an I2S codec or DAC. In real-time mode every poll() pulls
+// the samples that fell due since begin() by micros(), silence included when
+// the track underruns, like the hardware would; otherwise the caller pulls
+// with pull(). Pulled samples can be written to a raw 16-bit mono PCM file,
+// which stays open across sample rate changes.
+class MockAudioSink : public AudioSink {
+private:
+    bool realTime;
+    const char* outputPath;
+    FILE* output;
+    AudioTrack* track;
+    uint32_t rate;
+    uint32_t startMicros;
+    uint64_t pulledSamples;
+    uint64_t deliveredSamples;
+    
+public:
+    MockAudioSink(bool realTimeMode, const char* path = nullptr);
+    ~MockAudioSink();
+    
+    bool begin(AudioTrack* audioTrack, uint32_t sampleRate) override;
+    void end() override;
+    void poll() override;
+    
+    // Pulls up to `samples` samples and returns how many the track delivered.
+    uint32_t pull(uint32_t samples);
+    
+    uint64_t getPulledSamples() const { return pulledSamples; }
+    uint64_t getDeliveredSamples() const { return deliveredSamples; }
+    uint32_t getSampleRate() const { return rate; }
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "VirtualPanel.h"
+
+VirtualPanel::VirtualPanel(uint8_t csPin, uint8_t dcPin, uint32_t fixedClockHz)
+    : pinCS(csPin), pinDC(dcPin), fixedClock(fixedClockHz), clock(fixedClockHz ? fixedClockHz : 4000000),
+      command(0), paramCount(0), madctl(0), bytesPerPixel(3), startColumn(0), endColumn(WIDTH - 1),
+      startRow(0), endRow(HEIGHT - 1), column(0), row(0), pixelFill(0), busMicros(0), busBytes(0),
+      pixelsWritten(0) {
+    memset(params, 0, sizeof(params));
+    memset(pixelBytes, 0, sizeof(pixelBytes));
+    memset(gram, 0, sizeof(gram));
+}
+
+void VirtualPanel::beginTransaction(uint32_t clockHz) {
+    if (!fixedClock && clockHz) {
+        clock = clockHz;
+    }
+}
+
+void VirtualPanel::write(const uint8_t* data, size_t count) {
+    busBytes += count;
+    busMicros += count * 8e6 / clock;
+    if (digitalRead(pinCS) != LOW) {
+        return;
+    }
+    
+    if (digitalRead(pinDC) == LOW) {
+        for (size_t i = 0; i < count; i++) {
+            startCommand(data[i]);
+        }
+        return;
+    }
+    
+    if (command != CMD_RAMWR && command != CMD_RAMWRC) {
+        for (size_t i = 0; i < count; i++) {
+            parameter(data[i]);
+        }
+        return;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        pixelBytes[pixelFill++] = data[i];
+        if (pixelFill == bytesPerPixel) {
+            storePixel();
+            pixelFill = 0;
+        }
+    }
+}
+
+void VirtualPanel::startCommand(uint8_t cmd) {
+    command = cmd;
+    paramCount = 0;
+    pixelFill = 0;
+    if (cmd == CMD_RAMWR) {
+        column = startColumn;
+        row = startRow;
+    }
+}
+
+void VirtualPanel::parameter(uint8_t value) {
+    if (paramCount < sizeof(params)) {
+        params[paramCount] = value;
+    }
+    paramCount++;
+    
+    switch (command) {
+        case CMD_CASET:
+        case CMD_RASET:
+            if (paramCount == 4) {
+                uint16_t first = (params[0] << 8) | params[1];
+                uint16_t last = (params[2] << 8) | params[3];
+                if (command == CMD_CASET) {
+                    startColumn = first;
+                    endColumn = last;
+                } else {
+                    startRow = first;
+                    endRow = last;
+                }
+            }
+            break;
+        case CMD_MADCTL:
+            madctl = value;
+            break;
+        case CMD_COLMOD:
+            bytesPerPixel = (value & 0x07) == 0x05 ? 2 : 3;
+            break;
+        default:
+            break;
+    }
+}
+
+void VirtualPanel::storePixel() {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    if (bytesPerPixel == 2) {
+        uint16_t value = (pixelBytes[0] << 8) | pixelBytes[1];
+        r = (value >> 11) & 0x1F;
+        g = (value >> 5) & 0x3F;
+        b = value & 0x1F;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+    } else {
+        r = pixelBytes[0] & 0xFC;
+        g = pixelBytes[1] & 0xFC;
+        b = pixelBytes[2] & 0xFC;
+    }
+    
+    // Mirroring works on the addresses as sent, before rows and columns swap.
+    uint8_t orientation = madctl ^ UPRIGHT_MADCTL;
+    bool exchange = (orientation & MADCTL_MV) != 0;
+    uint16_t columns = exchange ? HEIGHT : WIDTH;
+    uint16_t rows = exchange ? WIDTH : HEIGHT;
+    if (column < columns && row < rows) {
+        uint16_t c = orientation & MADCTL_MX ? columns - 1 - column : column;
+        uint16_t p = orientation & MADCTL_MY ? rows - 1 - row : row;
+        uint16_t x = exchange ? p : c;
+        uint16_t y = exchange ? c : p;
+        uint8_t* pixel = &gram[((uint32_t)y * WIDTH + x) * 3];
+        pixel[0] = r;
+        pixel[1] = g;
+        pixel[2] = b;
+        pixelsWritten++;
+    }
+    
+    if (column < endColumn) {
+        column++;
+        return;
+    }
+    column = startColumn;
+    row = row < endRow ? row + 1 : startRow;
+}
+
+void VirtualPanel::resetCounters() {
+    busMicros = 0;
+    busBytes = 0;
+    pixelsWritten = 0;
+}
+
+uint32_t VirtualPanel::hash() const {
+    uint32_t value = 2166136261u;
+    for (size_t i = 0; i < sizeof(gram); i++) {
+        value = (value ^ gram[i]) * 16777619u;
+    }
+    return value;
+}
+
+bool VirtualPanel::writePPM(const char* path) const {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", WIDTH, HEIGHT);
+    bool written = fwrite(gram, 1, sizeof(gram), file) == sizeof(gram);
+    return fclose(file) == 0 && written;
+}
@@ -0,0 +1,77 @@
+#ifndef VIRTUAL_PANEL_H
+#define VIRTUAL_PANEL_H
+
+#include <Arduino.h>
+#include <SPI.h>
+
+// Host model of the LCD controller behind the SPI shim. It follows chip select
+// and data/command through the shim's pin levels and interprets CASET, RASET,
+// RAMWR/RAMWRC, MADCTL and COLMOD into a 240x320 GRAM held as RGB888, so the
+// rendered picture can be dumped and compared.
+//
+// MADCTL is applied relative to the driver's default (MY set), which is how
+// the module is mounted: with the defaults the GRAM reads top row first.
+// Every byte on the bus, selected or not, costs 8 clocks at the transaction's
+// clock, or at a fixed clock when one is given.
+class VirtualPanel : public SPIListener {
+public:
+    static const uint16_t WIDTH = 240;
+    static const uint16_t HEIGHT = 320;
+    
+    VirtualPanel(uint8_t csPin, uint8_t dcPin, uint32_t fixedClockHz = 0);
+    
+    void beginTransaction(uint32_t clockHz) override;
+    void write(const uint8_t* data, size_t count) override;
+    
+    double getBusMicros() const { return busMicros; }
+    uint64_t getBusBytes() const { return busBytes; }
+    uint64_t getPixelsWritten() const { return pixelsWritten; }
+    void resetCounters();
+    
+    // FNV-1a over the GRAM, for quick golden comparisons.
+    uint32_t hash() const;
+    bool writePPM(const char* path) const;
+    
+private:
+    static const uint8_t CMD_CASET = 0x2A;
+    static const uint8_t CMD_RASET = 0x2B;
+    static const uint8_t CMD_RAMWR = 0x2C;
+    static const uint8_t CMD_MADCTL = 0x36;
+    static const uint8_t CMD_COLMOD = 0x3A;
+    static const uint8_t CMD_RAMWRC = 0x3C;
+    static const uint8_t MADCTL_MY = 0x80;
+    static const uint8_t MADCTL_MX = 0x40;
+    static const uint8_t MADCTL_MV = 0x20;
+    static const uint8_t UPRIGHT_MADCTL = MADCTL_MY;
+    
+    uint8_t pinCS;
+    uint8_t pinDC;
+    uint32_t fixedClock;
+    uint32_t clock;
+    
+    uint8_t command;
+    uint8_t params[4];
+    uint8_t paramCount;
+    uint8_t madctl;
+    uint8_t bytesPerPixel;
+    uint16_t startColumn;
+    uint16_t endColumn;
+    uint16_t startRow;
+    uint16_t endRow;
+    uint16_t column;
+    uint16_t row;
+    uint8_t pixelBytes[3];
+    uint8_t pixelFill;
+    
+    double busMicros;
+    uint64_t busBytes;
+    uint64_t pixelsWritten;
+    
+    uint8_t gram[WIDTH * HEIGHT * 3];
+    
+    void startCommand(uint8_t cmd);
+    void parameter(uint8_t value);
+    void storePixel();
+};
+
+#endif
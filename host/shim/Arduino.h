@@ -0,0 +1,68 @@
+//
+// Minimal Arduino core stand-in for host (native) builds.
+// Only what the player sources use is provided.
+//
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define MSBFIRST 1
+
+// Memory placement attributes are meaningless on the host
+#define DMAMEM
+#define EXTMEM
+#define FASTRUN
+#define PROGMEM
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Pin levels are remembered, so bus listeners can follow chip select and
+// data/command lines.
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+// Serial writes to stdout; input is read non-blocking from stdin when it is a pipe or terminal.
+class HostSerial {
+public:
+    void begin(uint32_t baud) { (void)baud; }
+    operator bool() const { return true; }
+    
+    int available();
+    int read();
+    int availableForWrite() { return 4096; }
+    
+    size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+    size_t write(const uint8_t* buffer, size_t size) { return fwrite(buffer, 1, size, stdout); }
+    
+    size_t print(const char* text) { return fputs(text, stdout) < 0 ? 0 : strlen(text); }
+    size_t println(const char* text = "") { return print(text) + write('\n'); }
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void flush() { fflush(stdout); }
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,170 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <SdFat.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+
+HostSerial Serial;
+SPIClass SPI;
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+uint32_t millis() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startTime).count();
+}
+
+uint32_t micros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {}
+
+static uint8_t pinLevels[256];
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void digitalWrite(uint8_t pin, uint8_t value) { pinLevels[pin] = value ? HIGH : LOW; }
+int digitalRead(uint8_t pin) { return pinLevels[pin]; }
+void analogWrite(uint8_t pin, int value) { (void)pin; (void)value; }
+
+////////////////////////////////////////////////////////////
+//                      HostSerial                        //
+////////////////////////////////////////////////////////////
+int HostSerial::available() {
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    return (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) ? 1 : 0;
+}
+
+int HostSerial::read() {
+    if (!available()) {
+        return -1;
+    }
+    unsigned char c;
+    return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+int HostSerial::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written;
+}
+
+////////////////////////////////////////////////////////////
+//                   File-backed SdFat                    //
+////////////////////////////////////////////////////////////
+const char* SdFs::hostRoot = ".";
+HostSdTiming SdFs::timing = { 0, 0, 0, 0, 0.0 };
+
+void SdFs::setHostRoot(const char* directory) {
+    hostRoot = directory;
+}
+
+FsFile SdFs::open(const char* path, int oflag) {
+    (void)oflag;
+    std::string hostPath(hostRoot);
+    if (path[0] != '/') {
+        hostPath += '/';
+    }
+    hostPath += path;
+    
+    FsFile file;
+    file.open(hostPath.c_str());
+    return file;
+}
+
+bool FsFile::open(const char* path) {
+    close();
+    
+    snprintf(hostPath, sizeof(hostPath), "%s", path);
+    const char* slash = strrchr(path, '/');
+    snprintf(name, sizeof(name), "%s", slash ? slash + 1 : path);
+    
+    dir = opendir(path);
+    if (dir) {
+        return true;
+    }
+    
+    file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    return true;
+}
+
+bool FsFile::openNext(FsFile* directory, int oflag) {
+    (void)oflag;
+    if (!directory || !directory->dir) {
+        return false;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(directory->dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        std::string childPath = std::string(directory->hostPath) + "/" + entry->d_name;
+        return open(childPath.c_str());
+    }
+    return false;
+}
+
+void FsFile::close() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    if (dir) {
+        closedir(dir);
+        dir = nullptr;
+    }
+    size = 0;
+}
+
+size_t FsFile::getName(char* buffer, size_t length) const {
+    if (length == 0) {
+        return 0;
+    }
+    snprintf(buffer, length, "%s", name);
+    return strlen(buffer);
+}
+
+uint64_t FsFile::curPosition() const {
+    return file ? ftell(file) : 0;
+}
+
+bool FsFile::seekSet(uint64_t position) {
+    return file && position <= size && fseek(file, (long)position, SEEK_SET) == 0;
+}
+
+int FsFile::read(void* buffer, size_t count) {
+    if (!file) {
+        return -1;
+    }
+    int bytesRead = (int)fread(buffer, 1, count, file);
+    
+    HostSdTiming& timing = SdFs::hostTiming();
+    timing.reads++;
+    timing.bytes += bytesRead;
+    timing.busyMicros += timing.latencyMicros;
+    if (timing.bytesPerSecond) {
+        timing.busyMicros += bytesRead * 1e6 / timing.bytesPerSecond;
+    }
+    return bytesRead;
+}
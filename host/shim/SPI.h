@@ -0,0 +1,68 @@
+//
+// SPI stand-in for host builds. Transfers are discarded unless a bus
+// listener is installed.
+//
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0
+
+class SPISettings {
+public:
+    SPISettings() : clock(4000000) {}
+    SPISettings(uint32_t clockHz, uint8_t bitOrder, uint8_t dataMode) : clock(clockHz) {
+        (void)bitOrder;
+        (void)dataMode;
+    }
+    
+    uint32_t clock;
+};
+
+// Sees every byte sent on the bus, e.g. a simulated display.
+class SPIListener {
+public:
+    virtual ~SPIListener() {}
+    virtual void beginTransaction(uint32_t clockHz) { (void)clockHz; }
+    virtual void write(const uint8_t* data, size_t count) = 0;
+    virtual void endTransaction() {}
+};
+
+class SPIClass {
+public:
+    SPIClass() : listener(nullptr) {}
+    
+    void setListener(SPIListener* busListener) { listener = busListener; }
+    
+    void begin() {}
+    void beginTransaction(SPISettings settings) {
+        if (listener) {
+            listener->beginTransaction(settings.clock);
+        }
+    }
+    void endTransaction() {
+        if (listener) {
+            listener->endTransaction();
+        }
+    }
+    uint8_t transfer(uint8_t data) {
+        if (listener) {
+            listener->write(&data, 1);
+        }
+        return data;
+    }
+    void transfer(void* buffer, size_t count) {
+        if (listener) {
+            listener->write((const uint8_t*)buffer, count);
+        }
+    }
+    
+private:
+    SPIListener* listener;
+};
+
+extern SPIClass SPI;
+
+#endif
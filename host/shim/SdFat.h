@@ -0,0 +1,76 @@
+//
+// File-backed SdFat stand-in for host builds. Paths on the "card" are
+// resolved below a host directory set with SdFs::setHostRoot() (default ".").
+//
+
+#ifndef HOST_SDFAT_H
+#define HOST_SDFAT_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <dirent.h>
+
+#define O_RDONLY 0x00
+#define SHARED_SPI 0
+#define DEDICATED_SPI 1
+#define SD_SCK_MHZ(maxMhz) (1000000UL * (maxMhz))
+
+class SdSpiConfig {
+public:
+    SdSpiConfig(uint8_t cs, uint8_t opt, uint32_t maxSck) : csPin(cs), options(opt), maxSpeed(maxSck) {}
+    
+    uint8_t csPin;
+    uint8_t options;
+    uint32_t maxSpeed;
+};
+
+class FsFile {
+public:
+    FsFile() : file(nullptr), dir(nullptr), size(0) { name[0] = '\0'; hostPath[0] = '\0'; }
+    
+    operator bool() const { return file != nullptr || dir != nullptr; }
+    
+    bool open(const char* path);
+    bool openNext(FsFile* directory, int oflag = O_RDONLY);
+    void close();
+    
+    bool isDir() const { return dir != nullptr; }
+    size_t getName(char* buffer, size_t length) const;
+    
+    uint64_t fileSize() const { return size; }
+    uint64_t curPosition() const;
+    bool seekSet(uint64_t position);
+    int read(void* buffer, size_t count);
+    
+private:
+    FILE* file;
+    DIR* dir;
+    uint64_t size;
+    char name[256];
+    char hostPath[1024];
+};
+
+// Modelled card timing: every read() costs latencyMicros plus its bytes at
+// bytesPerSecond. Nothing waits; the time is only added up in busyMicros.
+struct HostSdTiming {
+    uint32_t latencyMicros;
+    uint32_t bytesPerSecond;    // 0: reads cost nothing
+    uint32_t reads;
+    uint64_t bytes;
+    double busyMicros;
+};
+
+class SdFs {
+public:
+    bool begin(SdSpiConfig config) { (void)config; return true; }
+    FsFile open(const char* path, int oflag = O_RDONLY);
+    
+    static void setHostRoot(const char* directory);
+    static HostSdTiming& hostTiming() { return timing; }
+    
+private:
+    static const char* hostRoot;
+    static HostSdTiming timing;
+};
+
+#endif
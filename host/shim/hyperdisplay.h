@@ -0,0 +1,153 @@
+//
+// Stand-in for SparkFun's HyperDisplay base class in host builds. Only the
+// parts the LCD driver and DisplayManager use are provided: the window
+// structures, color sequence bookkeeping, and pixel, rectangle and window
+// fills drawn through the driver's hardware primitives.
+//
+
+#ifndef HOST_HYPERDISPLAY_H
+#define HOST_HYPERDISPLAY_H
+
+#include <Arduino.h>
+
+typedef uint16_t hd_hw_extent_t;
+typedef int32_t hd_extent_t;
+typedef uint32_t hd_pixels_t;
+typedef uint16_t hd_colors_t;
+typedef void* color_t;
+
+struct char_info_t {
+    color_t data;
+    hd_extent_t* xLoc;
+    hd_extent_t* yLoc;
+    uint8_t xDim;
+    uint8_t yDim;
+    uint32_t numPixels;
+    bool show;
+    bool causesNewline;
+};
+
+struct wind_info_t {
+    hd_extent_t xMin;
+    hd_extent_t yMin;
+    hd_extent_t xMax;
+    hd_extent_t yMax;
+    hd_extent_t cursorX;
+    hd_extent_t cursorY;
+    hd_extent_t xReset;
+    hd_extent_t yReset;
+    char_info_t lastCharacter;
+    bool bufferMode;
+    color_t data;
+    hd_pixels_t numPixels;
+    bool dynamic;
+    color_t currentSequenceData;
+    hd_colors_t currentColorCycleLength;
+    hd_colors_t currentColorOffset;
+};
+
+class hyperdisplay {
+public:
+    hyperdisplay(uint16_t xSize, uint16_t ySize) : xExt(xSize), yExt(ySize), pCurrentWindow(&hyperdisplayDefaultWindow) {
+        memset(&hyperdisplayDefaultWindow, 0, sizeof(hyperdisplayDefaultWindow));
+    }
+    virtual ~hyperdisplay() {}
+    
+    uint16_t xExt;
+    uint16_t yExt;
+    wind_info_t* pCurrentWindow;
+    
+    // Coordinates are window coordinates, as in the library.
+    void pixel(hd_extent_t x0, hd_extent_t y0, color_t data = NULL, hd_colors_t colorCycleLength = 1,
+               hd_colors_t startColorOffset = 0) {
+        hwpixel(x0 + pCurrentWindow->xMin, y0 + pCurrentWindow->yMin, data, colorCycleLength, startColorOffset);
+    }
+    
+    void rectangle(hd_extent_t x0, hd_extent_t y0, hd_extent_t x1, hd_extent_t y1, bool filled = false,
+                   color_t data = NULL, hd_colors_t colorCycleLength = 1, hd_colors_t startColorOffset = 0,
+                   bool reverseGradient = false) {
+        (void)reverseGradient;
+        if (x1 < x0) {
+            std::swap(x0, x1);
+        }
+        if (y1 < y0) {
+            std::swap(y0, y1);
+        }
+        hd_hw_extent_t left = x0 + pCurrentWindow->xMin;
+        hd_hw_extent_t top = y0 + pCurrentWindow->yMin;
+        hd_hw_extent_t width = x1 - x0 + 1;
+        hd_hw_extent_t height = y1 - y0 + 1;
+        
+        if (filled) {
+            for (hd_hw_extent_t row = 0; row < height; row++) {
+                hwxline(left, top + row, width, data, colorCycleLength, startColorOffset);
+            }
+            return;
+        }
+        hwxline(left, top, width, data, colorCycleLength, startColorOffset);
+        hwxline(left, top + height - 1, width, data, colorCycleLength, startColorOffset);
+        hwyline(left, top, height, data, colorCycleLength, startColorOffset);
+        hwyline(left + width - 1, top, height, data, colorCycleLength, startColorOffset);
+    }
+    
+    void fillWindow(color_t color, hd_colors_t colorCycleLength = 1, hd_colors_t startColorOffset = 0) {
+        rectangle(0, 0, pCurrentWindow->xMax - pCurrentWindow->xMin, pCurrentWindow->yMax - pCurrentWindow->yMin,
+                  true, color, colorCycleLength, startColorOffset);
+    }
+    
+    virtual void setWindowDefaults(wind_info_t* pwindow) { (void)pwindow; }
+    
+    virtual void hwxline(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t len, color_t data = NULL,
+                         hd_colors_t colorCycleLength = 1, hd_colors_t startColorOffset = 0, bool goLeft = false) {
+        for (hd_hw_extent_t i = 0; i < len; i++) {
+            hwpixel(goLeft ? x0 - i : x0 + i, y0, data, colorCycleLength,
+                    getNewColorOffset(colorCycleLength, startColorOffset, i));
+        }
+    }
+    virtual void hwyline(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t len, color_t data = NULL,
+                         hd_colors_t colorCycleLength = 1, hd_colors_t startColorOffset = 0, bool goUp = false) {
+        for (hd_hw_extent_t i = 0; i < len; i++) {
+            hwpixel(x0, goUp ? y0 - i : y0 + i, data, colorCycleLength,
+                    getNewColorOffset(colorCycleLength, startColorOffset, i));
+        }
+    }
+    virtual void hwfillFromArray(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t x1, hd_hw_extent_t y1,
+                                 color_t data = NULL, hd_pixels_t numPixels = 0, bool Vh = false) {
+        (void)Vh;
+        hd_pixels_t drawn = 0;
+        for (hd_hw_extent_t y = y0; y <= y1 && drawn < numPixels; y++) {
+            for (hd_hw_extent_t x = x0; x <= x1 && drawn < numPixels; x++) {
+                hwpixel(x, y, getOffsetColor(data, drawn++));
+            }
+        }
+    }
+    
+protected:
+    wind_info_t hyperdisplayDefaultWindow;
+    
+    virtual color_t getOffsetColor(color_t base, uint32_t numPixels) = 0;
+    virtual void hwpixel(hd_hw_extent_t x0, hd_hw_extent_t y0, color_t data = NULL, hd_colors_t colorCycleLength = 1,
+                         hd_colors_t startColorOffset = 0) = 0;
+    virtual void swpixel(hd_extent_t x0, hd_extent_t y0, color_t data = NULL, hd_colors_t colorCycleLength = 1,
+                         hd_colors_t startColorOffset = 0) = 0;
+    
+    hd_colors_t getNewColorOffset(hd_colors_t colorCycleLength, hd_colors_t startColorOffset, hd_pixels_t numWritten) {
+        if (colorCycleLength == 0) {
+            return 0;
+        }
+        return (startColorOffset + numWritten) % colorCycleLength;
+    }
+    
+    void setWindowColorSequence(wind_info_t* pwindow, color_t data, hd_colors_t colorCycleLength = 1,
+                                hd_colors_t startColorOffset = 0) {
+        pwindow->currentSequenceData = data;
+        pwindow->currentColorCycleLength = colorCycleLength ? colorCycleLength : 1;
+        pwindow->currentColorOffset = startColorOffset;
+    }
+    
+    hd_pixels_t wToPix(wind_info_t* pwindow, hd_hw_extent_t x0, hd_hw_extent_t y0) {
+        return (hd_pixels_t)y0 * (pwindow->xMax - pwindow->xMin + 1) + x0;
+    }
+};
+
+#endif
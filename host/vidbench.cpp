@@ -0,0 +1,217 @@
+//
+// Host benchmark: reads and decodes every frame of a .vid file through a
+// VideoSource, either the SD path (SDFileReader against the file-backed SdFat
+// stand-in, with SD timing statistics) or a zero-copy mmap() of the file.
+// Audio chunks are skipped, or decoded through AudioTrack and written to a raw
+// 16-bit mono PCM file with --audio-out. Repeat frames are read for their
+// audio only. Tiled and rectangle frames are decoded over the previous picture.
+// A row dictionary is read once, before the timed loop.
+//
+// Usage: vidbench [--mmap] [--audio-out file.pcm] <sd-root-dir> <path-on-card> [loops]
+//
+
+#include <Arduino.h>
+#include "SDFileReader.h"
+#include "SDVideoSource.h"
+#include "MmapVideoSource.h"
+#include "MockAudioSink.h"
+#include "RLEDecoder.h"
+#include "TileDecoder.h"
+#include "RectDecoder.h"
+#include "SpanDecoder.h"
+#include "RowDecoder.h"
+#include "VideoFormat.h"
+#include "Profiler.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+static uint8_t audioStorage[64 * 1024];
+
+int main(int argc, char** argv) {
+    bool useMmap = false;
+    const char* audioOut = nullptr;
+    int arg = 1;
+    
+    while (arg < argc && strncmp(argv[arg], "--", 2) == 0) {
+        if (strcmp(argv[arg], "--mmap") == 0) {
+            useMmap = true;
+        } else if (strcmp(argv[arg], "--audio-out") == 0 && arg + 1 < argc) {
+            audioOut = argv[++arg];
+        } else {
+            break;
+        }
+        arg++;
+    }
+    
+    if (argc - arg < 2) {
+        fprintf(stderr, "Usage: %s [--mmap] [--audio-out file.pcm] <sd-root-dir> <path-on-card> [loops]\n", argv[0]);
+        return 1;
+    }
+    
+    const char* root = argv[arg];
+    const char* path = argv[arg + 1];
+    uint32_t loops = argc - arg > 2 ? (uint32_t)atoi(argv[arg + 2]) : 1;
+    std::string hostPath = std::string(root) + (path[0] == '/' ? "" : "/") + path;
+    
+    SdFs::setHostRoot(root);
+    SDFileReader reader(10);
+    SDVideoSource sdSource(&reader, 0, path);
+    MmapVideoSource mmapSource(hostPath.c_str());
+    VideoSource* source = useMmap ? (VideoSource*)&mmapSource : (VideoSource*)&sdSource;
+    
+    if (!reader.begin() || !source->open()) {
+        fprintf(stderr, "Cannot open %s\n", hostPath.c_str());
+        return 1;
+    }
+    
+    VideoHeader header;
+    if (!source->read((uint8_t*)&header, sizeof(header), 0) || memcmp(header.magic, "VID0", 4) != 0) {
+        fprintf(stderr, "%s is not a VID0 file\n", path);
+        return 1;
+    }
+    source->setLayoutFlags(header.flags);
+    
+    AudioHeader audioHeader;
+    bool hasAudio = (header.flags & VID_FLAG_AUDIO) != 0;
+    if (hasAudio && !source->read((uint8_t*)&audioHeader, sizeof(audioHeader), videoHeaderSize(header.flags))) {
+        fprintf(stderr, "Cannot read audio header\n");
+        return 1;
+    }
+    
+    AudioTrack audioTrack;
+    MockAudioSink audioSink(false, audioOut);
+    bool decodeAudio = hasAudio && audioOut;
+    if (decodeAudio) {
+        uint32_t fpsNumerator = header.flags & VID_FLAG_NTSC_RATE ? header.fps * 1000 : header.fps;
+        uint32_t fpsDenominator = header.flags & VID_FLAG_NTSC_RATE ? 1001 : 1;
+        
+        audioTrack.setStorage(audioStorage, sizeof(audioStorage));
+        audioTrack.setSink(&audioSink);
+        if (!audioTrack.open(audioHeader, fpsNumerator, fpsDenominator)) {
+            fprintf(stderr, "Unsupported audio track\n");
+            return 1;
+        }
+        audioTrack.restart(0, micros());
+    }
+    
+    RowDictionaryHeader dictionaryHeader;
+    std::vector<uint16_t> dictionary;
+    if (header.flags & VID_FLAG_ROW_DICTIONARY) {
+        if (!source->read((uint8_t*)&dictionaryHeader, sizeof(dictionaryHeader), rowDictionaryOffset(header.flags))) {
+            fprintf(stderr, "Cannot read row dictionary\n");
+            return 1;
+        }
+        dictionary.resize((size_t)dictionaryHeader.rowCount * header.frameWidth);
+        if (!source->read((uint8_t*)dictionary.data(), dictionary.size() * sizeof(uint16_t),
+                          rowDictionaryOffset(header.flags) + sizeof(dictionaryHeader))) {
+            fprintf(stderr, "Cannot read row dictionary\n");
+            return 1;
+        }
+        for (uint16_t& pixel : dictionary) {
+            pixel = __builtin_bswap16(pixel);
+        }
+    }
+    
+    std::vector<FrameIndexEntry> index(header.frameCount);
+    if (!source->read((uint8_t*)index.data(), header.frameCount * sizeof(FrameIndexEntry), header.indexOffset)) {
+        fprintf(stderr, "Cannot read frame index\n");
+        return 1;
+    }
+    
+    std::vector<bool> repeats(header.frameCount);
+    uint32_t largestFrame = 0;
+    for (uint32_t frame = 0; frame < header.frameCount; frame++) {
+        repeats[frame] = (index[frame].size & VID_INDEX_REPEAT) != 0;
+        index[frame].size &= ~VID_INDEX_FLAGS;
+        largestFrame = max(largestFrame, index[frame].size);
+    }
+    
+    std::vector<uint8_t> scratch(largestFrame + source->getReadSlack());
+    std::vector<uint16_t> pixels((size_t)header.frameWidth * header.frameHeight);
+    TileLayout layout;
+    layout.set(header.frameWidth, header.frameHeight, header.tileShape);
+    
+    reader.resetTimingStats();
+    auto start = std::chrono::steady_clock::now();
+    
+    for (uint32_t loop = 0; loop < loops; loop++) {
+        for (uint32_t frame = 0; frame < header.frameCount; frame++) {
+            if (repeats[frame] && !hasAudio) {
+                continue;
+            }
+            source->setTimingTag(frame);
+            const uint8_t* data = source->getFrame(index[frame], scratch.data(), scratch.size());
+            if (!data) {
+                fprintf(stderr, "Read failed at frame %u\n", frame);
+                return 1;
+            }
+            uint32_t size = index[frame].size;
+            if (hasAudio) {
+                AudioChunkHeader chunk;
+                memcpy(&chunk, data, sizeof(chunk));
+                uint32_t audioSize = sizeof(chunk) + chunk.audioBytes;
+                if (audioSize > size) {
+                    fprintf(stderr, "Bad audio chunk at frame %u\n", frame);
+                    return 1;
+                }
+                if (decodeAudio && loop == 0) {
+                    audioTrack.queueChunk(frame, chunk, data + sizeof(chunk));
+                    do {
+                        audioTrack.service();
+                    } while (audioSink.pull(AudioTrack::BLOCK_SAMPLES) > 0);
+                }
+                data += audioSize;
+                size -= audioSize;
+            }
+            // A repeat keeps the picture already decoded.
+            bool decoded = repeats[frame];
+            uint8_t codec = header.compression;
+            if (!decoded && size && codec == VID_COMPRESSION_PER_FRAME) {
+                codec = *data++;
+                size--;
+            }
+            if (!decoded && codec == VID_COMPRESSION_TILES) {
+                decoded = TileDecoder::decode(data, size, layout, pixels.data());
+            } else if (!decoded && codec == VID_COMPRESSION_RECTS) {
+                decoded = RectDecoder::decode(data, size, header.frameWidth, header.frameHeight, pixels.data());
+            } else if (!decoded && codec == VID_COMPRESSION_SPANS) {
+                decoded = SpanDecoder::decode(data, size, header.frameWidth, header.frameHeight, pixels.data());
+            } else if (!decoded && codec == VID_COMPRESSION_ROWS) {
+                decoded = RowDecoder::decode(data, size, header.frameWidth, header.frameHeight, dictionary.data(),
+                                             dictionary.size() / header.frameWidth, pixels.data());
+            } else if (!decoded && codec == VID_COMPRESSION_RAW) {
+                decoded = size >= pixels.size() * sizeof(uint16_t);
+                if (decoded) {
+                    memcpy(pixels.data(), data, pixels.size() * sizeof(uint16_t));
+                }
+            } else if (!decoded) {
+                decoded = RLEDecoder::decode(data, size, pixels.data(), pixels.size()) == pixels.size();
+            }
+            if (!decoded) {
+                fprintf(stderr, "Decode failed at frame %u\n", frame);
+                return 1;
+            }
+        }
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint32_t frames = loops * header.frameCount;
+    
+    printf("# bench,source,frames,seconds,frames_per_s\n");
+    printf("bench,%s,%u,%.6f,%.1f\n", useMmap ? "mmap" : "sd", frames, seconds, frames / seconds);
+    
+    if (decodeAudio) {
+        printf("# audiodecode,samples,expected\n");
+        printf("audiodecode,%llu,%u\n", (unsigned long long)audioSink.getDeliveredSamples(), audioHeader.sampleCount);
+    }
+    
+    if (!useMmap) {
+        reader.printTimingSummary();
+    }
+    Profiler::print();
+    
+    source->close();
+    reader.end();
+    return 0;
+}
@@ -0,0 +1,352 @@
+//
+// Host simulator: plays a .vid through the firmware's own VideoPlayer,
+// DisplayManager, SDFileReader and LCD driver, with the SD card file-backed
+// and the display a VirtualPanel on the SPI shim. Every frame is drawn with
+// playFrameSegmented() at the position the firmware uses, and its time is
+// predicted from the modelled card (the reads the player actually made), the
+// bytes that actually crossed the display bus and a decode cost per RLE
+// packet and pixel decoded, the same model as the converter's budget report.
+// In tiled files only RLE and raw tiles are decoded; solid tiles cost bus
+// time only. Rectangle files decode no pixels and are charged each rectangle
+// as a packet; span files are charged each run of one colour. In
+// row-dictionary files only literal rows are decoded, and each copy of a
+// dictionary row is charged as a packet.
+//
+// Usage: vidsim [options] <sd-root-dir> <path-on-card>
+//   --sd-latency-us N        card latency per read (250)
+//   --sd-mbps X              card throughput (20)
+//   --spi-mhz X              display clock; default the driver's own
+//   --cpu-ns-per-packet N    decode cost per RLE packet (40)
+//   --cpu-ns-per-pixel X     decode cost per pixel (2.0)
+//   --frames N               stop after N frames
+//   --ppm-dir DIR            write the panel after each frame as DIR/frame_NNNNN.ppm
+//   --ppm-every N            only every Nth frame (1)
+//   --per-frame              print a timing line for every frame
+//
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "DisplayManager.h"
+#include "SDFileReader.h"
+#include "SDVideoSource.h"
+#include "MmapVideoSource.h"
+#include "MemoryPlanner.h"
+#include "VideoPlayer.h"
+#include "VirtualPanel.h"
+#include <string>
+#include <vector>
+
+#define PIN_SPI_CS    4
+#define PIN_SPI_DC    5
+#define PIN_BACKLIGHT 3
+#define PIN_SD_CS     10
+
+#define FAST_MEMORY_KB 104
+#define DMA_MEMORY_KB  160
+
+static uint8_t fastMemory[FAST_MEMORY_KB * 1024] __attribute__((aligned(32)));
+static uint8_t dmaMemory[DMA_MEMORY_KB * 1024] __attribute__((aligned(32)));
+
+// The same packet walk as RLEDecoder, counting instead of writing.
+static uint32_t countPackets(const uint8_t* data, uint32_t size) {
+    uint32_t packets = 0;
+    uint32_t pos = 0;
+    while (pos < size) {
+        uint8_t header = data[pos];
+        pos += header & 0x80 ? 3 : 1 + 2 * ((header & 0x7F) + 1);
+        packets++;
+    }
+    return packets;
+}
+
+// The tile walk of TileDecoder, counting the RLE packets and the pixels it
+// decodes.
+static void countTileWork(const uint8_t* data, uint32_t size, const TileLayout& layout, uint32_t& packets,
+                          uint32_t& pixels) {
+    uint32_t pos = layout.mapBytes();
+    uint32_t tile = 0;
+    packets = 0;
+    pixels = 0;
+    for (uint32_t top = 0; top < layout.frameHeight; top += layout.tileHeight) {
+        for (uint32_t left = 0; left < layout.frameWidth; left += layout.tileWidth) {
+            uint32_t count = min((uint32_t)layout.tileWidth, layout.frameWidth - left) *
+                             min((uint32_t)layout.tileHeight, layout.frameHeight - top);
+            uint8_t mode = TileDecoder::tileMode(data, tile++);
+            if (mode == TILE_SOLID) {
+                pos += 2;
+            } else if (mode == TILE_RAW) {
+                pos += 2 * count;
+                pixels += count;
+            } else if (mode == TILE_RLE) {
+                pixels += count;
+                for (uint32_t done = 0; done < count && pos < size; packets++) {
+                    uint8_t header = data[pos];
+                    done += (header & 0x7F) + 1;
+                    pos += header & 0x80 ? 3 : 1 + 2 * ((header & 0x7F) + 1);
+                }
+            }
+        }
+    }
+}
+
+// The group walk of RectDecoder, counting rectangles.
+static uint32_t countRects(const uint8_t* data, uint32_t size) {
+    uint32_t rects = 0;
+    uint32_t pos = 0;
+    while (pos + RECT_GROUP_BYTES <= size) {
+        uint32_t count = data[pos + 2] + 1;
+        pos += RECT_GROUP_BYTES + count * RECT_BYTES;
+        rects += count;
+    }
+    return rects;
+}
+
+// The row walk of SpanDecoder, counting runs of one colour.
+static uint32_t countSpanRuns(const uint8_t* data, uint32_t size, uint16_t height) {
+    uint32_t pos = 4;
+    uint32_t runs = 0;
+    uint32_t count = 0;
+    uint32_t code;
+    for (uint16_t row = 0; row < height && readVarint(data, size, pos, code); row++) {
+        if (code != SPAN_ROW_SAME) {
+            count = code == SPAN_ROW_PREDICTED ? count : code - SPAN_ROW_LITERAL;
+            uint32_t offset;
+            for (uint32_t i = 0; i < count; i++) {
+                readVarint(data, size, pos, offset);
+            }
+        }
+        runs += count + 1;
+    }
+    return runs;
+}
+
+// The row walk of RowDecoder: literal rows count their RLE packets and
+// pixels, and a dictionary row is one copy, charged as a packet.
+static void countRowWork(const uint8_t* data, uint32_t size, uint16_t width, uint16_t height, uint32_t& packets,
+                         uint32_t& pixels) {
+    uint32_t pos = 0;
+    uint32_t code;
+    packets = 0;
+    pixels = 0;
+    for (uint16_t row = 0; row < height && readVarint(data, size, pos, code); row++) {
+        if (code != ROW_LITERAL) {
+            packets++;
+            continue;
+        }
+        pixels += width;
+        for (uint32_t done = 0; done < width && pos < size; packets++) {
+            uint8_t header = data[pos];
+            done += (header & 0x7F) + 1;
+            pos += header & 0x80 ? 3 : 1 + 2 * ((header & 0x7F) + 1);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t sdLatencyMicros = 250;
+    double sdMbps = 20.0;
+    double spiMhz = 0;
+    double nsPerPacket = 40;
+    double nsPerPixel = 2.0;
+    uint32_t frameLimit = 0;
+    const char* ppmDir = nullptr;
+    uint32_t ppmEvery = 1;
+    bool perFrame = false;
+    int arg = 1;
+    
+    while (arg < argc && strncmp(argv[arg], "--", 2) == 0) {
+        bool hasValue = arg + 1 < argc;
+        if (strcmp(argv[arg], "--per-frame") == 0) {
+            perFrame = true;
+        } else if (strcmp(argv[arg], "--sd-latency-us") == 0 && hasValue) {
+            sdLatencyMicros = (uint32_t)atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--sd-mbps") == 0 && hasValue) {
+            sdMbps = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--spi-mhz") == 0 && hasValue) {
+            spiMhz = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--cpu-ns-per-packet") == 0 && hasValue) {
+            nsPerPacket = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--cpu-ns-per-pixel") == 0 && hasValue) {
+            nsPerPixel = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--frames") == 0 && hasValue) {
+            frameLimit = (uint32_t)atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--ppm-dir") == 0 && hasValue) {
+            ppmDir = argv[++arg];
+        } else if (strcmp(argv[arg], "--ppm-every") == 0 && hasValue) {
+            ppmEvery = max(atoi(argv[++arg]), 1);
+        } else {
+            break;
+        }
+        arg++;
+    }
+    
+    if (argc - arg < 2) {
+        fprintf(stderr, "Usage: %s [--sd-latency-us N] [--sd-mbps X] [--spi-mhz X] [--cpu-ns-per-packet N] "
+                "[--cpu-ns-per-pixel X] [--frames N] [--ppm-dir DIR] [--ppm-every N] [--per-frame] "
+                "<sd-root-dir> <path-on-card>\n", argv[0]);
+        return 1;
+    }
+    
+    const char* root = argv[arg];
+    const char* path = argv[arg + 1];
+    std::string hostPath = std::string(root) + (path[0] == '/' ? "" : "/") + path;
+    
+    SdFs::setHostRoot(root);
+    HostSdTiming& sdTiming = SdFs::hostTiming();
+    sdTiming.latencyMicros = sdLatencyMicros;
+    sdTiming.bytesPerSecond = (uint32_t)(sdMbps * 1000000);
+    
+    VirtualPanel panel(PIN_SPI_CS, PIN_SPI_DC, (uint32_t)(spiMhz * 1000000));
+    SPI.setListener(&panel);
+    
+    DisplayManager display(PIN_SPI_CS, PIN_SPI_DC, PIN_BACKLIGHT);
+    SDFileReader reader(PIN_SD_CS);
+    SDVideoSource source(&reader, 0, path);
+    MemoryPlanner planner;
+    planner.setPool(MEMORY_FAST, fastMemory, sizeof(fastMemory));
+    planner.setPool(MEMORY_DMA, dmaMemory, sizeof(dmaMemory));
+    
+    if (!reader.begin() || !display.begin()) {
+        fprintf(stderr, "Cannot start the card or the display\n");
+        return 1;
+    }
+    display.clear();
+    
+    VideoPlayer video(&source, &display);
+    video.setMemoryPlanner(&planner);
+    if (!video.begin()) {
+        fprintf(stderr, "Cannot play %s\n", hostPath.c_str());
+        return 1;
+    }
+    
+    // The decode model needs each frame's packets; they are counted from an
+    // untimed mapping of the same file.
+    MmapVideoSource mapped(hostPath.c_str());
+    VideoHeader header;
+    if (!mapped.open() || !mapped.read((uint8_t*)&header, sizeof(header), 0)) {
+        fprintf(stderr, "Cannot map %s\n", hostPath.c_str());
+        return 1;
+    }
+    mapped.setLayoutFlags(header.flags);
+    std::vector<FrameIndexEntry> index(header.frameCount);
+    if (!mapped.read((uint8_t*)index.data(), header.frameCount * sizeof(FrameIndexEntry), header.indexOffset)) {
+        fprintf(stderr, "Cannot read frame index\n");
+        return 1;
+    }
+    bool hasAudio = (header.flags & VID_FLAG_AUDIO) != 0;
+    std::vector<bool> repeats(header.frameCount);
+    for (uint32_t frame = 0; frame < header.frameCount; frame++) {
+        repeats[frame] = (index[frame].size & VID_INDEX_REPEAT) != 0;
+        index[frame].size &= ~VID_INDEX_FLAGS;
+    }
+    
+    uint16_t x = (VirtualPanel::WIDTH - video.getWidth()) / 2;
+    uint16_t y = (VirtualPanel::HEIGHT - video.getHeight()) / 2;
+    uint32_t pixels = (uint32_t)video.getWidth() * video.getHeight();
+    TileLayout layout;
+    layout.set(header.frameWidth, header.frameHeight, header.tileShape);
+    double periodMicros = header.flags & VID_FLAG_NTSC_RATE ? 1001000.0 / header.fps : 1000000.0 / header.fps;
+    uint32_t frames = frameLimit ? min(frameLimit, header.frameCount) : header.frameCount;
+    
+    if (perFrame) {
+        printf("# simframe,frame,bytes,packets,sd_reads,sd_us,decode_us,lcd_bytes,lcd_us,total_us,late\n");
+    }
+    
+    double totalSum = 0;
+    double sdSum = 0;
+    double decodeSum = 0;
+    double lcdSum = 0;
+    double slowest = 0;
+    uint32_t slowestFrame = 0;
+    uint32_t lateFrames = 0;
+    
+    // A repeat costs the decode of the frame it repeats when the player has
+    // to draw that, and nothing when the picture is still on the panel.
+    uint32_t sourcePackets = 0;
+    uint32_t sourcePixels = 0;
+    
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        const uint8_t* data = mapped.getFrame(index[frame], nullptr, 0);
+        uint32_t size = index[frame].size;
+        if (data && hasAudio) {
+            AudioChunkHeader chunk;
+            memcpy(&chunk, data, sizeof(chunk));
+            data += sizeof(chunk) + chunk.audioBytes;
+            size -= sizeof(chunk) + chunk.audioBytes;
+        }
+        uint8_t codec = header.compression;
+        if (data && size && !repeats[frame] && codec == VID_COMPRESSION_PER_FRAME) {
+            codec = *data++;
+            size--;
+        }
+        if (!repeats[frame] && codec == VID_COMPRESSION_TILES) {
+            countTileWork(data, size, layout, sourcePackets, sourcePixels);
+        } else if (!repeats[frame] && codec == VID_COMPRESSION_RECTS) {
+            sourcePackets = data ? countRects(data, size) : 0;
+            sourcePixels = 0;
+        } else if (!repeats[frame] && codec == VID_COMPRESSION_SPANS) {
+            sourcePackets = data ? countSpanRuns(data, size, header.frameHeight) : 0;
+            sourcePixels = pixels;
+        } else if (!repeats[frame] && codec == VID_COMPRESSION_ROWS) {
+            countRowWork(data, size, header.frameWidth, header.frameHeight, sourcePackets, sourcePixels);
+        } else if (!repeats[frame] && codec == VID_COMPRESSION_RAW) {
+            sourcePackets = 0;
+            sourcePixels = pixels;
+        } else if (!repeats[frame]) {
+            sourcePackets = data ? countPackets(data, size) : 0;
+            sourcePixels = pixels;
+        }
+        
+        uint32_t reads = sdTiming.reads;
+        double sdStart = sdTiming.busyMicros;
+        panel.resetCounters();
+        if (!video.playFrameSegmented(frame, x, y)) {
+            fprintf(stderr, "Playback failed at frame %u\n", frame);
+            return 1;
+        }
+        
+        double sdMicros = sdTiming.busyMicros - sdStart;
+        bool drawn = !repeats[frame] || panel.getPixelsWritten() > 0;
+        uint32_t packets = drawn ? sourcePackets : 0;
+        double decodeMicros = drawn ? (packets * nsPerPacket + sourcePixels * nsPerPixel) / 1000 : 0;
+        double lcdMicros = panel.getBusMicros();
+        double total = sdMicros + decodeMicros + lcdMicros;
+        bool late = total > periodMicros;
+        
+        totalSum += total;
+        sdSum += sdMicros;
+        decodeSum += decodeMicros;
+        lcdSum += lcdMicros;
+        lateFrames += late;
+        if (total > slowest) {
+            slowest = total;
+            slowestFrame = frame;
+        }
+        
+        if (perFrame) {
+            printf("simframe,%u,%u,%u,%u,%.0f,%.0f,%llu,%.0f,%.0f,%d\n", frame, index[frame].size, packets,
+                   sdTiming.reads - reads, sdMicros, decodeMicros, (unsigned long long)panel.getBusBytes(),
+                   lcdMicros, total, late ? 1 : 0);
+        }
+        if (ppmDir && frame % ppmEvery == 0) {
+            char ppmPath[1024];
+            snprintf(ppmPath, sizeof(ppmPath), "%s/frame_%05u.ppm", ppmDir, frame);
+            if (!panel.writePPM(ppmPath)) {
+                fprintf(stderr, "Cannot write %s\n", ppmPath);
+                return 1;
+            }
+        }
+    }
+    
+    // Averages are per displayed frame; fps is what the modelled frame time allows.
+    double average = frames ? totalSum / frames : 0;
+    printf("# sim,frames,period_us,sd_us,decode_us,lcd_us,total_us,max_us,max_frame,late,fps,gram_hash\n");
+    printf("sim,%u,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%u,%u,%.1f,%08x\n", frames, periodMicros,
+           frames ? sdSum / frames : 0, frames ? decodeSum / frames : 0, frames ? lcdSum / frames : 0,
+           average, slowest, slowestFrame, lateFrames, average > 0 ? 1000000.0 / average : 0, panel.hash());
+    
+    video.end();
+    mapped.close();
+    reader.end();
+    return 0;
+}
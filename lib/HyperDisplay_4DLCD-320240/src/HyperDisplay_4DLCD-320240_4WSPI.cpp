@@ -1,4 +1,5 @@
 #include "HyperDisplay_4DLCD-320240_4WSPI.h"
+#include "Profiler.h"
 
 #define ARDUINO_STILL_BROKEN 1 // Referring to the epic fail that is SPI.transfer(buf, len)
 
@@ -13,6 +14,8 @@ LCD320240_4WSPI::LCD320240_4WSPI() : hyperdisplay(LCD320240_WIDTH, LCD320240_HEI
 	_intfc = LCD320240_INTFC_4WSPI;
 	SPISettings tempSettings(LCD320240_SPI_MAX_FREQ, LCD320240_SPI_DATA_ORDER, LCD320240_SPI_MODE);
 	_spisettings = tempSettings;
+	_transferBusy = false;
+	_fillBatch = false;
 }
 
 ////////////////////////////////////////////////////////////
@@ -115,7 +118,7 @@ void LCD320240_4WSPI::swpixel( hd_extent_t x0, hd_extent_t y0, color_t data, hd_
 
 	hd_pixels_t pixOffst = wToPix(pCurrentWindow, x0, y0);			// It was already ensured that this will be in range 
 	color_t dest = getOffsetColor(pCurrentWindow->data, pixOffst);	// Rely on the user's definition of a pixel's width in memory
-	uint32_t len = (uint32_t)getOffsetColor(0x00, 1);				// Getting the offset from zero for one pixel tells us how many bytes to copy
+	uint32_t len = (uint32_t)(uintptr_t)getOffsetColor(0x00, 1);				// Getting the offset from zero for one pixel tells us how many bytes to copy
 
 	memcpy((void*)dest, (void*)value, (size_t)len);		// Copy data into the window's buffer
 }
@@ -125,6 +128,7 @@ void LCD320240_4WSPI::swpixel( hd_extent_t x0, hd_extent_t y0, color_t data, hd_
 ////////////////////////////////////////////////////////////
 LCD320240_STAT_t LCD320240_4WSPI::writePacket(LCD320240_CMD_t* pcmd, uint8_t* pdata, uint16_t dlen)
 {
+	PROFILE_ZONE("lcd_writePacket");
 	selectDriver();
 	_spi->beginTransaction(_spisettings);
 
@@ -150,6 +154,7 @@ LCD320240_STAT_t LCD320240_4WSPI::writePacket(LCD320240_CMD_t* pcmd, uint8_t* pd
 }
 
 LCD320240_STAT_t LCD320240_4WSPI::transferSPIbuffer(uint8_t* pdata, size_t count, bool arduinoStillBroken ){
+	PROFILE_ZONE("lcd_transferSPIbuffer");
 	// For Teensy 4.x, we can use the faster DMA-enabled transfer
 	#if defined(__IMXRT1062__)
 		// The Teensy 4.x SPI library has optimized DMA transfers for large blocks
@@ -720,6 +725,7 @@ void LCD320240_4WSPI::hwfillFromArray(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_h
 {
 	if(numPixels == 0){ return; }
 	if(data == NULL ){ return; }
+	PROFILE_ZONE("lcd_hwfillFromArray");
 
 	uint8_t bpp = getBytesPerPixel();
 
@@ -748,7 +754,10 @@ void LCD320240_4WSPI::hwfillFromArray(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_h
 	#if defined(__IMXRT1062__)
 		// Check if data is already in the correct byte order (big-endian)
 		// If the VideoPlayer already swapped bytes, we can send directly
-		_spi->transfer((uint8_t*)data, bpp*numPixels);
+		{
+			PROFILE_ZONE("lcd_fillTransfer");
+			_spi->transfer((uint8_t*)data, bpp*numPixels);
+		}
 	#else
 		transferSPIbuffer((uint8_t*)data, bpp*numPixels, ARDUINO_STILL_BROKEN);
 	#endif
@@ -759,6 +768,141 @@ void LCD320240_4WSPI::hwfillFromArray(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_h
 	if( Vh ){ setMemoryAccessControl( true, true, false, false, true, false ); }
 }
 
+LCD320240_STAT_t LCD320240_4WSPI::hwfillSolid(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t x1, hd_hw_extent_t y1, color_t data)
+{
+	if(data == NULL ){ return LCD320240_STAT_Error; }
+	if(_transferBusy){ return LCD320240_STAT_Error; }
+	PROFILE_ZONE("lcd_hwfillSolid");
+
+	uint8_t bpp = getBytesPerPixel();
+	uint32_t remaining = (uint32_t)(x1 - x0 + 1) * (y1 - y0 + 1);
+	uint16_t chunk = (remaining < LCD320240_MAX_X) ? remaining : LCD320240_MAX_X;
+
+	// Up to a line's worth of the color, sent as many times as the window needs
+	uint8_t speedupArry[LCD320240_MAX_X*LCD320240_MAX_BPP];
+	for(uint16_t indi = 0; indi < chunk; indi++)
+	{
+		for(uint8_t indj = 0; indj < bpp; indj++)
+		{
+			speedupArry[ indj + (indi*bpp) ] = *((uint8_t*)(data) + indj);
+		}
+	}
+
+	// The window commands go out in the same transaction as the pixels
+	uint8_t window[2][4] = {
+		{(uint8_t)(x0 >> 8), (uint8_t)(x0 & 0x00FF), (uint8_t)(x1 >> 8), (uint8_t)(x1 & 0x00FF)},
+		{(uint8_t)(y0 >> 8), (uint8_t)(y0 & 0x00FF), (uint8_t)(y1 >> 8), (uint8_t)(y1 & 0x00FF)}
+	};
+	if(!_fillBatch)
+	{
+		selectDriver();
+		_spi->beginTransaction(_spisettings);
+	}
+
+	digitalWrite(_dc, LOW);
+	_spi->transfer(LCD320240_CMD_CASET);
+	digitalWrite(_dc, HIGH);
+	transferSPIbuffer(window[0], 4, false);
+	digitalWrite(_dc, LOW);
+	_spi->transfer(LCD320240_CMD_RASET);
+	digitalWrite(_dc, HIGH);
+	transferSPIbuffer(window[1], 4, false);
+	digitalWrite(_dc, LOW);
+	_spi->transfer(LCD320240_CMD_WRRAM);
+	digitalWrite(_dc, HIGH);
+
+	while(remaining != 0)
+	{
+		uint16_t pixelsToDraw = (remaining < chunk) ? remaining : chunk;
+		#if defined(__IMXRT1062__)
+			// No receive buffer, so the color is still there for the next round
+			_spi->transfer(speedupArry, NULL, pixelsToDraw*bpp);
+		#else
+			transferSPIbuffer(speedupArry, pixelsToDraw*bpp, ARDUINO_STILL_BROKEN);
+		#endif
+		remaining -= pixelsToDraw;
+	}
+
+	if(!_fillBatch)
+	{
+		_spi->endTransaction();
+		deselectDriver();
+	}
+
+	return LCD320240_STAT_Nominal;
+}
+
+LCD320240_STAT_t LCD320240_4WSPI::beginFillBatch( void )
+{
+	if(_transferBusy || _fillBatch){ return LCD320240_STAT_Error; }
+
+	selectDriver();
+	_spi->beginTransaction(_spisettings);
+	_fillBatch = true;
+	return LCD320240_STAT_Nominal;
+}
+
+LCD320240_STAT_t LCD320240_4WSPI::endFillBatch( void )
+{
+	if(!_fillBatch){ return LCD320240_STAT_Error; }
+
+	_spi->endTransaction();
+	deselectDriver();
+	_fillBatch = false;
+	return LCD320240_STAT_Nominal;
+}
+
+LCD320240_STAT_t LCD320240_4WSPI::hwfillFromArrayAsync(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t x1, hd_hw_extent_t y1, color_t data, hd_pixels_t numPixels)
+{
+	if(numPixels == 0){ return LCD320240_STAT_Error; }
+	if(data == NULL ){ return LCD320240_STAT_Error; }
+	if(_transferBusy){ return LCD320240_STAT_Error; }
+	PROFILE_ZONE("lcd_hwfillFromArrayAsync");
+
+	size_t count = getBytesPerPixel()*numPixels;
+
+	setColumnAddress( x0, x1);
+	setRowAddress(y0, y1);
+
+	LCD320240_CMD_t cmd = LCD320240_CMD_WRRAM;
+	writePacket(&cmd);
+
+	selectDriver();
+	digitalWrite(_dc, HIGH);
+	_spi->beginTransaction(_spisettings);
+
+	#if defined(__IMXRT1062__)
+		// No receive buffer, so unlike transfer(buf, count) the pixels are not overwritten
+		_transferBusy = true;
+		_transferEvent.setContext(this);
+		_transferEvent.attachImmediate(&LCD320240_4WSPI::transferComplete);
+		if(!_spi->transfer(data, NULL, count, _transferEvent))
+		{
+			_transferBusy = false;
+			transferSPIbuffer((uint8_t*)data, count, false);
+		}
+	#else
+		transferSPIbuffer((uint8_t*)data, count, ARDUINO_STILL_BROKEN);
+	#endif
+
+	return LCD320240_STAT_Nominal;
+}
+
+#if defined(__IMXRT1062__)
+void LCD320240_4WSPI::transferComplete(EventResponderRef event)
+{
+	((LCD320240_4WSPI*)event.getContext())->_transferBusy = false;
+}
+#endif
+
+LCD320240_STAT_t LCD320240_4WSPI::finishTransfer( void )
+{
+	while(_transferBusy){ }
+	_spi->endTransaction();
+	deselectDriver();
+	return LCD320240_STAT_Nominal;
+}
+
 ////////////////////////////////////////////////////////////
 //			Display-specific Implementation				  //
 ////////////////////////////////////////////////////////////
@@ -13,6 +13,9 @@
 #include "hyperdisplay.h"		// Inherit drawing functions from this library
 #include "fast_hsv2rgb.h"		// Used to work with HSV color space		
 #include <SPI.h>				// Arduino SPI support
+#if defined(__IMXRT1062__)
+#include <EventResponder.h>		// Completion callback for background SPI transfers
+#endif
 
 ////////////////////////////////////////////////////////////
 //							Defines     				  //
@@ -155,6 +158,12 @@ protected:
 	uint8_t _dc, _rst, _cs, _bl;		// Pin definitions
 	SPIClass * _spi;			// Which SPI port to use
 	SPISettings _spisettings;
+	volatile bool _transferBusy;	// A background window fill is still running
+	bool _fillBatch;				// Between beginFillBatch() and endFillBatch()
+	#if defined(__IMXRT1062__)
+	EventResponder _transferEvent;
+	static void transferComplete(EventResponderRef event);
+	#endif
 
 	// Pure virtual functions from HyperDisplay Implemented:
 	color_t getOffsetColor(color_t base, uint32_t numPixels);
@@ -226,6 +235,23 @@ public:
 	virtual void    hwyline(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t len, color_t data = NULL, hd_colors_t colorCycleLength = 1, hd_colors_t startColorOffset = 0, bool goUp = false);
 	virtual void 	hwfillFromArray(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t x1, hd_hw_extent_t y1, color_t data = NULL, hd_pixels_t numPixels = 0, bool Vh = false);
 
+	// Solid window fill: one window setup, then the single color in data (as sent on the
+	// bus) repeated over the whole window, instead of a window per line as rectangle() does.
+	LCD320240_STAT_t hwfillSolid(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t x1, hd_hw_extent_t y1, color_t data);
+
+	// Batched solid fills: the bus stays selected from beginFillBatch() to endFillBatch(), so
+	// each hwfillSolid() in between only sends its window and color. Nothing else may be
+	// drawn meanwhile.
+	LCD320240_STAT_t beginFillBatch( void );
+	LCD320240_STAT_t endFillBatch( void );
+
+	// Background window fill: one window setup, then the whole buffer as a single DMA
+	// transfer where the SPI library supports it (blocking elsewhere). The buffer must
+	// stay untouched until transferBusy() is false; finishTransfer() releases the bus.
+	LCD320240_STAT_t hwfillFromArrayAsync(hd_hw_extent_t x0, hd_hw_extent_t y0, hd_hw_extent_t x1, hd_hw_extent_t y1, color_t data, hd_pixels_t numPixels);
+	bool 			transferBusy( void ){ return _transferBusy; }
+	LCD320240_STAT_t finishTransfer( void );
+
 	// Display-specific functions
 	LCD320240_STAT_t begin(uint8_t dcPin, uint8_t csPin, uint8_t blPin, SPIClass &spiInterface = SPI, uint32_t spiFreq = LCD320240_SPI_DEFAULT_FREQ);
 	LCD320240_STAT_t defaultConfigure( void ); // The recommended settings from the datasheet
@@ -0,0 +1,41 @@
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#include <Arduino.h>
+
+// Free-running tick source for cheap interval timing. On the Teensy 4 this is
+// the Cortex-M7 DWT cycle counter (enabled by the core at startup); host builds
+// use a nanosecond steady clock. Ticks are 32-bit and wrap, so only differences
+// of intervals shorter than the wrap period (~7 s at 600 MHz) are meaningful.
+// The Teensy rate follows the core clock, so convert an interval as soon as it
+// ends, and do not time across a clock change.
+#if defined(__IMXRT1062__)
+
+class CycleCounter {
+public:
+    static inline uint32_t now() { return ARM_DWT_CYCCNT; }
+    static inline uint32_t ticksPerMicro() { return F_CPU_ACTUAL / 1000000; }
+    static inline uint32_t toMicros(uint32_t ticks) { return ticks / ticksPerMicro(); }
+    static inline uint32_t toNanos(uint32_t ticks) {
+        return (uint32_t)(((uint64_t)ticks * (65536000 / ticksPerMicro())) >> 16);
+    }
+};
+
+#else
+
+#include <chrono>
+
+class CycleCounter {
+public:
+    static inline uint32_t now() {
+        return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static inline uint32_t ticksPerMicro() { return 1000; }
+    static inline uint32_t toMicros(uint32_t ticks) { return ticks / 1000; }
+    static inline uint32_t toNanos(uint32_t ticks) { return ticks; }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#include "Profiler.h"
+
+ProfileZoneStats Profiler::zones[MAX_ZONES];
+uint8_t Profiler::zoneCount = 0;
+
+ProfileZoneStats* Profiler::zone(const char* name) {
+    for (uint8_t i = 0; i < zoneCount; i++) {
+        if (strcmp(zones[i].name, name) == 0) {
+            return &zones[i];
+        }
+    }
+    if (zoneCount >= MAX_ZONES) {
+        return nullptr;
+    }
+    
+    ProfileZoneStats* entry = &zones[zoneCount++];
+    entry->name = name;
+    entry->count = 0;
+    entry->totalNanos = 0;
+    entry->minNanos = UINT32_MAX;
+    entry->maxNanos = 0;
+    return entry;
+}
+
+void Profiler::record(ProfileZoneStats* zone, uint32_t ticks) {
+    if (!zone) {
+        return;
+    }
+    
+    uint32_t nanos = CycleCounter::toNanos(ticks);
+    zone->count++;
+    zone->totalNanos += nanos;
+    if (nanos < zone->minNanos) {
+        zone->minNanos = nanos;
+    }
+    if (nanos > zone->maxNanos) {
+        zone->maxNanos = nanos;
+    }
+}
+
+// Registered zones stay in the table so their cached pointers remain valid.
+void Profiler::reset() {
+    for (uint8_t i = 0; i < zoneCount; i++) {
+        zones[i].count = 0;
+        zones[i].totalNanos = 0;
+        zones[i].minNanos = UINT32_MAX;
+        zones[i].maxNanos = 0;
+    }
+}
+
+// Nested zones each report their full time, so totals overlap. Times are in
+// nanoseconds to resolve short zones such as a single SPI packet.
+void Profiler::print() {
+    Serial.println("# zone,name,count,total_us,avg_ns,min_ns,max_ns");
+    for (uint8_t i = 0; i < zoneCount; i++) {
+        const ProfileZoneStats& zone = zones[i];
+        Serial.printf("zone,%s,%lu,%lu,%lu,%lu,%lu\n",
+                      zone.name,
+                      (unsigned long)zone.count,
+                      (unsigned long)(zone.totalNanos / 1000),
+                      zone.count ? (unsigned long)(zone.totalNanos / zone.count) : 0UL,
+                      zone.count ? (unsigned long)zone.minNanos : 0UL,
+                      (unsigned long)zone.maxNanos);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "CycleCounter.h"
+
+// Build with -DPROFILER=0 to compile all profiling zones out.
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+struct ProfileZoneStats {
+    const char* name;
+    uint32_t count;
+    uint64_t totalNanos;
+    uint32_t minNanos;
+    uint32_t maxNanos;
+};
+
+// Fixed table of named timing zones. A zone is registered the first time its
+// PROFILE_ZONE runs and keeps the pointer in a function-local static, so each
+// later pass costs two cycle counter reads and a few adds. Each pass is
+// converted to nanoseconds when it ends, at the clock it ran at, so zones stay
+// right when the power manager scales the clock. Zones beyond MAX_ZONES are
+// not timed.
+class Profiler {
+public:
+    static const uint8_t MAX_ZONES = 32;
+    
+    static ProfileZoneStats* zone(const char* name);
+    static void record(ProfileZoneStats* zone, uint32_t ticks);
+    static void reset();
+    static void print();
+    
+private:
+    static ProfileZoneStats zones[MAX_ZONES];
+    static uint8_t zoneCount;
+};
+
+#if PROFILER
+
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileZoneStats* profileZone) : zone(profileZone), start(CycleCounter::now()) {}
+    ~ProfileScope() { Profiler::record(zone, CycleCounter::now() - start); }
+    
+private:
+    ProfileZoneStats* zone;
+    uint32_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) \
+    static ProfileZoneStats* const PROFILE_CONCAT(profileZone, __LINE__) = Profiler::zone(name); \
+    ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileZone, __LINE__))
+
+#else
+
+#define PROFILE_ZONE(name) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#include "AllocCounter.h"
+
+#ifdef ALLOC_COUNTER
+
+static volatile uint32_t allocationCount = 0;
+static volatile uint32_t allocatedBytes = 0;
+
+extern "C" void* __real_malloc(size_t size);
+
+extern "C" void* __wrap_malloc(size_t size) {
+    allocationCount++;
+    allocatedBytes += size;
+    return __real_malloc(size);
+}
+
+uint32_t AllocCounter::getAllocationCount() {
+    return allocationCount;
+}
+
+uint32_t AllocCounter::getAllocatedBytes() {
+    return allocatedBytes;
+}
+
+bool AllocCounter::isEnabled() {
+    return true;
+}
+
+#else
+
+uint32_t AllocCounter::getAllocationCount() {
+    return 0;
+}
+
+uint32_t AllocCounter::getAllocatedBytes() {
+    return 0;
+}
+
+bool AllocCounter::isEnabled() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <Arduino.h>
+
+// Counts heap allocations when built with -DALLOC_COUNTER -Wl,--wrap=malloc
+// (see the teensymm_alloccheck environment). Otherwise every call returns 0.
+class AllocCounter {
+public:
+    static uint32_t getAllocationCount();
+    static uint32_t getAllocatedBytes();
+    static bool isEnabled();
+};
+
+#endif
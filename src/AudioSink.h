@@ -0,0 +1,24 @@
+#ifndef AUDIO_SINK_H
+#define AUDIO_SINK_H
+
+#include <Arduino.h>
+
+class AudioTrack;
+
+// Where decoded audio goes: an I2S codec, a DAC or a PWM pin on the board, or
+// a mock on the host. Once begun, the sink pulls samples from the track at the
+// sample rate with AudioTrack::read(), usually from an interrupt; the samples
+// it pulls are the clock the video follows.
+class AudioSink {
+public:
+    virtual ~AudioSink() {}
+    
+    virtual bool begin(AudioTrack* track, uint32_t sampleRate) = 0;
+    virtual void end() = 0;
+    
+    // Called from AudioTrack::service() for sinks without an interrupt of
+    // their own, which pull everything that became due since the last call.
+    virtual void poll() {}
+};
+
+#endif
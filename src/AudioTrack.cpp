@@ -0,0 +1,439 @@
+#include "AudioTrack.h"
+#include <atomic>
+
+static const int16_t ADPCM_STEPS[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+
+static const int8_t ADPCM_INDEX_STEPS[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// IMA ADPCM chunks start with the predictor (int16) and step index (uint8)
+// plus one reserved byte.
+static const uint32_t ADPCM_PREAMBLE_BYTES = 4;
+
+AudioTrack::AudioTrack()
+    : sink(nullptr), fillBlock(0), fillPosition(0), playBlock(0), playPosition(0), played(0),
+      ring(nullptr), ringSize(0), ringRead(0), ringUsed(0), sampleRate(0), fpsNumerator(30),
+      fpsDenominator(1), active(false), expecting(false), expectedChunk(0), queuedSamples(0),
+      skipSamples(0), chunkSamples(0), chunkBytes(0), predictor(0), stepIndex(0), nibbles(0),
+      highNibble(false), followingAudio(false), epochMicros(0), epochSamples(0),
+      freeStartMicros(0), lastPlayed(0), lastProgressMicros(0) {
+    blocks[0] = nullptr;
+    blocks[1] = nullptr;
+    blockState[0] = BLOCK_FREE;
+    blockState[1] = BLOCK_FREE;
+    blockLength[0] = 0;
+    blockLength[1] = 0;
+    memset(&header, 0, sizeof(header));
+    resetStats();
+}
+
+void AudioTrack::setStorage(uint8_t* storage, size_t size) {
+    stop();
+    
+    size_t blockBytes = BLOCK_SAMPLES * sizeof(int16_t);
+    if (!storage || size <= 2 * blockBytes) {
+        blocks[0] = nullptr;
+        blocks[1] = nullptr;
+        ring = nullptr;
+        ringSize = 0;
+        return;
+    }
+    
+    blocks[0] = (int16_t*)storage;
+    blocks[1] = blocks[0] + BLOCK_SAMPLES;
+    ring = storage + 2 * blockBytes;
+    ringSize = size - 2 * blockBytes;
+    flush();
+}
+
+void AudioTrack::setSink(AudioSink* audioSink) {
+    if (sink && sampleRate) {
+        sink->end();
+    }
+    sink = audioSink;
+    if (sink && sampleRate) {
+        sink->begin(this, sampleRate);
+    }
+}
+
+bool AudioTrack::open(const AudioHeader& audio, uint32_t numerator, uint32_t denominator) {
+    // A chunk may arrive while leadFrames more are still queued ahead of the
+    // one playing.
+    uint32_t ringNeeded = ((uint32_t)audio.leadFrames + 2) * (sizeof(AudioChunkHeader) + audio.maxChunkBytes);
+    bool supported = memcmp(audio.magic, "AUD0", 4) == 0 &&
+                     audio.sampleRate != 0 && audio.channels == 1 &&
+                     (audio.codec == AUDIO_CODEC_PCM16 || audio.codec == AUDIO_CODEC_IMA_ADPCM) &&
+                     blocks[0] && ringSize >= ringNeeded && numerator && denominator;
+                     
+    if (!supported) {
+        close();
+        return false;
+    }
+    
+    bool continuing = active && audio.sampleRate == sampleRate && audio.codec == header.codec;
+    uint32_t previousRate = sampleRate;
+    
+    if (!continuing) {
+        stop();
+    }
+    header = audio;
+    sampleRate = audio.sampleRate;
+    fpsNumerator = numerator;
+    fpsDenominator = denominator;
+    
+    if (sink && sampleRate != previousRate) {
+        if (previousRate) {
+            sink->end();
+        }
+        sink->begin(this, sampleRate);
+    }
+    return true;
+}
+
+void AudioTrack::close() {
+    stop();
+    if (sink && sampleRate) {
+        sink->end();
+    }
+    sampleRate = 0;
+}
+
+void AudioTrack::flush() {
+    noInterrupts();
+    blockState[0] = BLOCK_FREE;
+    blockState[1] = BLOCK_FREE;
+    playBlock = 0;
+    playPosition = 0;
+    expecting = false;
+    interrupts();
+    
+    fillBlock = 0;
+    fillPosition = 0;
+    ringRead = 0;
+    ringUsed = 0;
+    chunkSamples = 0;
+    chunkBytes = 0;
+}
+
+// Chunk 0 carries the audio of frames 0 to leadFrames; chunk n > 0 carries
+// frame n + leadFrames, so audio is always queued ahead of the frame shown.
+// The clock holds at frameMicros until the frame's first sample plays.
+void AudioTrack::restart(uint32_t frame, uint32_t frameMicros) {
+    if (!isOpen()) {
+        return;
+    }
+    
+    flush();
+    expectedChunk = frame > header.leadFrames ? frame - header.leadFrames : 0;
+    queuedSamples = chunkStartSample(expectedChunk);
+    skipSamples = frameStartSample(frame) - queuedSamples;
+    active = true;
+    expecting = queuedSamples < header.sampleCount;
+    
+    followingAudio = true;
+    epochMicros = frameMicros;
+    epochSamples = played;
+    lastPlayed = played;
+    lastProgressMicros = micros();
+    stats.restarts++;
+}
+
+void AudioTrack::rewind() {
+    expectedChunk = 0;
+    queuedSamples = 0;
+    skipSamples = 0;
+}
+
+void AudioTrack::stop() {
+    flush();
+    active = false;
+    skipSamples = 0;
+}
+
+uint32_t AudioTrack::frameStartSample(uint32_t frame) const {
+    uint64_t sample = (uint64_t)frame * sampleRate * fpsDenominator / fpsNumerator;
+    return sample < header.sampleCount ? (uint32_t)sample : header.sampleCount;
+}
+
+uint32_t AudioTrack::chunkStartSample(uint32_t chunk) const {
+    return chunk == 0 ? 0 : frameStartSample(chunk + header.leadFrames);
+}
+
+bool AudioTrack::queueChunk(uint32_t frame, const AudioChunkHeader& chunk, const uint8_t* payload) {
+    if (!active || frame != expectedChunk) {
+        return false;
+    }
+    
+    expectedChunk++;
+    queuedSamples = chunkStartSample(frame) + chunk.sampleCount;
+    if (chunk.sampleCount == 0) {
+        return true;
+    }
+    
+    uint32_t bytes = sizeof(chunk) + chunk.audioBytes;
+    if (ringSize - ringUsed < bytes) {
+        stats.overflows++;
+        return false;
+    }
+    
+    uint32_t position = ringRead + ringUsed;
+    if (position >= ringSize) {
+        position -= ringSize;
+    }
+    
+    // The header and payload may wrap around the end of the ring.
+    const uint8_t* parts[2] = { (const uint8_t*)&chunk, payload };
+    uint32_t lengths[2] = { sizeof(chunk), chunk.audioBytes };
+    for (uint8_t i = 0; i < 2; i++) {
+        uint32_t first = min(lengths[i], ringSize - position);
+        memcpy(ring + position, parts[i], first);
+        memcpy(ring, parts[i] + first, lengths[i] - first);
+        position += lengths[i];
+        if (position >= ringSize) {
+            position -= ringSize;
+        }
+    }
+    
+    ringUsed += bytes;
+    stats.chunks++;
+    return true;
+}
+
+uint8_t AudioTrack::ringByte() {
+    uint8_t value = ring[ringRead];
+    ringRead = ringRead + 1 == ringSize ? 0 : ringRead + 1;
+    ringUsed--;
+    return value;
+}
+
+bool AudioTrack::decodeSample(int16_t& sample) {
+    while (true) {
+        while (chunkSamples == 0) {
+            while (chunkBytes) {
+                ringByte();
+                chunkBytes--;
+            }
+            if (ringUsed < sizeof(AudioChunkHeader)) {
+                return false;
+            }
+            
+            AudioChunkHeader chunk;
+            uint8_t* bytes = (uint8_t*)&chunk;
+            for (uint32_t i = 0; i < sizeof(chunk); i++) {
+                bytes[i] = ringByte();
+            }
+            chunkSamples = chunk.sampleCount;
+            chunkBytes = chunk.audioBytes;
+            
+            if (header.codec == AUDIO_CODEC_IMA_ADPCM && chunkSamples) {
+                if (chunkBytes < ADPCM_PREAMBLE_BYTES) {
+                    chunkSamples = 0;
+                    continue;
+                }
+                uint8_t low = ringByte();
+                uint8_t high = ringByte();
+                predictor = (int16_t)(low | (high << 8));
+                stepIndex = ringByte();
+                stepIndex = stepIndex > 88 ? 88 : stepIndex;
+                ringByte();
+                chunkBytes -= ADPCM_PREAMBLE_BYTES;
+                highNibble = false;
+            }
+        }
+        
+        int16_t value;
+        if (header.codec == AUDIO_CODEC_PCM16) {
+            if (chunkBytes < 2) {
+                chunkSamples = 0;
+                continue;
+            }
+            uint8_t low = ringByte();
+            uint8_t high = ringByte();
+            chunkBytes -= 2;
+            value = (int16_t)(low | (high << 8));
+        } else {
+            if (!highNibble) {
+                if (!chunkBytes) {
+                    chunkSamples = 0;
+                    continue;
+                }
+                nibbles = ringByte();
+                chunkBytes--;
+            }
+            uint8_t code = highNibble ? nibbles >> 4 : nibbles & 0x0F;
+            highNibble = !highNibble;
+            
+            int32_t step = ADPCM_STEPS[stepIndex];
+            int32_t difference = step >> 3;
+            if (code & 1) difference += step >> 2;
+            if (code & 2) difference += step >> 1;
+            if (code & 4) difference += step;
+            predictor += (code & 8) ? -difference : difference;
+            predictor = predictor < -32768 ? -32768 : (predictor > 32767 ? 32767 : predictor);
+            
+            stepIndex += ADPCM_INDEX_STEPS[code & 7];
+            stepIndex = stepIndex < 0 ? 0 : (stepIndex > 88 ? 88 : stepIndex);
+            value = (int16_t)predictor;
+        }
+        
+        chunkSamples--;
+        if (skipSamples) {
+            skipSamples--;
+            continue;
+        }
+        sample = value;
+        return true;
+    }
+}
+
+// Fills free blocks from the ring. A block is handed to the sink when full,
+// or partly filled once the whole stream has been decoded; an empty ring
+// otherwise leaves it to be completed by the next chunk, so a loop or the
+// next clip continues it without a gap.
+void AudioTrack::service() {
+    if (!isOpen()) {
+        return;
+    }
+    if (sink) {
+        sink->poll();
+    }
+    
+    while (active && blockState[fillBlock] == BLOCK_FREE) {
+        int16_t* block = blocks[fillBlock];
+        int16_t sample;
+        
+        while (fillPosition < BLOCK_SAMPLES && decodeSample(sample)) {
+            block[fillPosition++] = sample;
+        }
+        if (fillPosition < BLOCK_SAMPLES && (fillPosition == 0 || queuedSamples < header.sampleCount)) {
+            break;
+        }
+        
+        blockLength[fillBlock] = fillPosition;
+        fillPosition = 0;
+        std::atomic_signal_fence(std::memory_order_release);
+        blockState[fillBlock] = BLOCK_READY;
+        fillBlock ^= 1;
+    }
+    
+    expecting = active && (queuedSamples < header.sampleCount || ringUsed || chunkSamples || fillPosition);
+}
+
+bool AudioTrack::isDrained() const {
+    return queuedSamples >= header.sampleCount && !ringUsed && !chunkSamples && !fillPosition &&
+           blockState[0] == BLOCK_FREE && blockState[1] == BLOCK_FREE;
+}
+
+// 0xFFFFFFFF while no audio is expected.
+uint32_t AudioTrack::bufferedMicros() const {
+    if (!expecting) {
+        return 0xFFFFFFFF;
+    }
+    
+    uint8_t block = playBlock;
+    uint32_t samples = 0;
+    if (blockState[block] == BLOCK_READY) {
+        samples = blockLength[block] - playPosition;
+        if (blockState[block ^ 1] == BLOCK_READY) {
+            samples += blockLength[block ^ 1];
+        }
+    }
+    return (uint32_t)((uint64_t)samples * 1000000 / sampleRate);
+}
+
+uint32_t AudioTrack::read(int16_t* out, uint32_t count) {
+    uint32_t done = 0;
+    
+    while (done < count && blockState[playBlock] == BLOCK_READY) {
+        std::atomic_signal_fence(std::memory_order_acquire);
+        uint8_t block = playBlock;
+        uint32_t available = blockLength[block] - playPosition;
+        uint32_t samples = min(count - done, available);
+        
+        memcpy(out + done, blocks[block] + playPosition, samples * sizeof(int16_t));
+        done += samples;
+        playPosition += samples;
+        if (playPosition >= blockLength[block]) {
+            playPosition = 0;
+            blockState[block] = BLOCK_FREE;
+            playBlock = block ^ 1;
+        }
+    }
+    
+    played += done;
+    if (done < count) {
+        memset(out + done, 0, (count - done) * sizeof(int16_t));
+        if (expecting) {
+            stats.underrunSamples += count - done;
+        }
+    }
+    return done;
+}
+
+uint32_t AudioTrack::currentClock(uint32_t nowMicros, uint32_t samples) const {
+    if (followingAudio) {
+        return epochMicros + (uint32_t)((uint64_t)(samples - epochSamples) * 1000000 / sampleRate);
+    }
+    return epochMicros + (nowMicros - freeStartMicros);
+}
+
+void AudioTrack::setFollowing(bool follow, uint32_t nowMicros, uint32_t samples) {
+    epochMicros = currentClock(nowMicros, samples);
+    epochSamples = samples;
+    freeStartMicros = nowMicros;
+    followingAudio = follow;
+}
+
+uint32_t AudioTrack::clockMicros() {
+    if (sink && isOpen()) {
+        sink->poll();
+    }
+    
+    uint32_t now = micros();
+    uint32_t samples = played;
+    if (samples != lastPlayed) {
+        lastPlayed = samples;
+        lastProgressMicros = now;
+    }
+    
+    bool follow = active && !isDrained();
+    if (follow && now - lastProgressMicros >= MAX_STALL_MICROS) {
+        if (followingAudio) {
+            stats.stalls++;
+        }
+        follow = false;
+    }
+    if (follow != followingAudio) {
+        setFollowing(follow, now, samples);
+    }
+    return currentClock(now, samples);
+}
+
+void AudioTrack::resetStats() {
+    memset((void*)&stats, 0, sizeof(stats));
+}
+
+void AudioTrack::printStats() const {
+    static const char* const CODEC_NAMES[] = { "none", "pcm16", "ima_adpcm" };
+    uint8_t codec = isOpen() && header.codec <= AUDIO_CODEC_IMA_ADPCM ? header.codec : 0;
+    
+    Serial.println("# audio,codec,rate,lead_frames,active,played,chunks,overflows,restarts,underrun_samples,stalls");
+    Serial.printf("audio,%s,%lu,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                  CODEC_NAMES[codec],
+                  (unsigned long)sampleRate,
+                  isOpen() ? header.leadFrames : 0,
+                  active ? 1 : 0,
+                  (unsigned long)played,
+                  (unsigned long)stats.chunks,
+                  (unsigned long)stats.overflows,
+                  (unsigned long)stats.restarts,
+                  (unsigned long)stats.underrunSamples,
+                  (unsigned long)stats.stalls);
+}
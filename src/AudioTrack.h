@@ -0,0 +1,133 @@
+#ifndef AUDIO_TRACK_H
+#define AUDIO_TRACK_H
+
+#include <Arduino.h>
+#include "VideoFormat.h"
+#include "AudioSink.h"
+
+struct AudioTrackStats {
+    uint32_t chunks;            // chunks queued
+    uint32_t overflows;         // chunks dropped because the ring was full
+    uint32_t restarts;          // seeks, speed changes and resyncs
+    uint32_t underrunSamples;   // samples the sink asked for while audio was expected
+    uint32_t stalls;            // times the clock ran free after waiting too long for audio
+};
+
+// The sound of a clip with VID_FLAG_AUDIO set, and the clock that paces its
+// video. The player hands over the audio chunk that starts every frame's data;
+// chunks are kept compressed in a ring and decoded into one of two blocks while
+// the sink plays the other.
+//
+// The clock follows the samples the sink has pulled while audio is playing or
+// expected, so video waits for audio and never drifts from it. It runs on
+// micros() instead when the clip is silent, audio is stopped (speed changes,
+// scrubbing), the stream has ended or no audio has arrived for
+// MAX_STALL_MICROS, and carries on from the same value when audio resumes.
+class AudioTrack {
+public:
+    static const uint32_t BLOCK_SAMPLES = 512;
+    static const uint32_t MAX_STALL_MICROS = 250000;
+    static const uint32_t NO_CHUNK = 0xFFFFFFFF;
+    
+    AudioTrack();
+    
+    // Storage for the two output blocks and the compressed ring.
+    void setStorage(uint8_t* storage, size_t size);
+    void setSink(AudioSink* audioSink);
+    
+    // Sets the stream of the next clip. Queued audio keeps playing when the
+    // sample rate is unchanged, so playlists switch without a gap. Returns
+    // false (and closes) for codecs or layouts the track cannot play.
+    bool open(const AudioHeader& audio, uint32_t fpsNumerator, uint32_t fpsDenominator);
+    void close();
+    bool isOpen() const { return sampleRate != 0; }
+    
+    // restart() drops queued audio and continues the stream at a frame due
+    // at frameMicros; rewind() keeps it and expects chunk 0 next (loops, the
+    // next clip); stop() drops it and lets the clock run free until the next
+    // restart().
+    void restart(uint32_t frame, uint32_t frameMicros);
+    void rewind();
+    void stop();
+    bool isActive() const { return active; }
+    
+    // Chunk the track expects next, NO_CHUNK when stopped. Chunks must arrive
+    // in order; others are ignored.
+    uint32_t nextChunk() const { return active ? expectedChunk : NO_CHUNK; }
+    bool queueChunk(uint32_t frame, const AudioChunkHeader& chunk, const uint8_t* payload);
+    
+    // Decodes into free blocks; call often (VideoPlayer::update() does), at
+    // the latest before bufferedMicros() of decoded audio has played.
+    void service();
+    uint32_t bufferedMicros() const;
+    uint32_t clockMicros();
+    
+    // Sink side, usually in interrupt context: copies up to count samples and
+    // returns how many were available.
+    uint32_t read(int16_t* out, uint32_t count);
+    
+    uint32_t frameStartSample(uint32_t frame) const;
+    uint32_t chunkStartSample(uint32_t chunk) const;
+    uint32_t getSampleRate() const { return sampleRate; }
+    uint32_t getPlayedSamples() const { return played; }
+    const AudioTrackStats& getStats() const { return stats; }
+    void resetStats();
+    void printStats() const;
+    
+private:
+    enum BlockState : uint8_t {
+        BLOCK_FREE = 0,
+        BLOCK_READY
+    };
+    
+    AudioSink* sink;
+    int16_t* blocks[2];
+    volatile uint8_t blockState[2];
+    volatile uint32_t blockLength[2];
+    uint8_t fillBlock;
+    uint32_t fillPosition;
+    volatile uint8_t playBlock;
+    volatile uint32_t playPosition;
+    volatile uint32_t played;
+    
+    uint8_t* ring;
+    uint32_t ringSize;
+    uint32_t ringRead;
+    uint32_t ringUsed;
+    
+    AudioHeader header;
+    uint32_t sampleRate;
+    uint32_t fpsNumerator;
+    uint32_t fpsDenominator;
+    volatile bool active;
+    volatile bool expecting;
+    uint32_t expectedChunk;
+    uint32_t queuedSamples;
+    uint32_t skipSamples;
+    
+    // Decoder position inside the chunk at the front of the ring.
+    uint32_t chunkSamples;
+    uint32_t chunkBytes;
+    int32_t predictor;
+    int32_t stepIndex;
+    uint8_t nibbles;
+    bool highNibble;
+    
+    bool followingAudio;
+    uint32_t epochMicros;
+    uint32_t epochSamples;
+    uint32_t freeStartMicros;
+    uint32_t lastPlayed;
+    uint32_t lastProgressMicros;
+    
+    AudioTrackStats stats;
+    
+    void flush();
+    bool isDrained() const;
+    bool decodeSample(int16_t& sample);
+    uint8_t ringByte();
+    uint32_t currentClock(uint32_t nowMicros, uint32_t samples) const;
+    void setFollowing(bool follow, uint32_t nowMicros, uint32_t samples);
+};
+
+#endif
@@ -1,9 +1,10 @@
 #include "DisplayManager.h"
+#include "MemoryPlanner.h"
 #include <SPI.h>
 
 DisplayManager::DisplayManager(uint8_t csPin, uint8_t dcPin, uint8_t backlightPin) 
     : pinCS(csPin), pinDC(dcPin), pinBacklight(backlightPin), 
-      display(nullptr), displayInitialized(false) {
+      display(nullptr), displayInitialized(false), transferActive(false) {
 }
 
 DisplayManager::~DisplayManager() {
@@ -127,12 +128,66 @@ void DisplayManager::drawRectangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16
     display->rectangle(x0, y0, x1, y1, filled, &color);
 }
 
+void DisplayManager::fillRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t color) {
+    if (!display || !displayInitialized || width == 0 || height == 0) {
+        return;
+    }
+    
+    uint16_t wireColor = __builtin_bswap16(color);
+    display->hwfillSolid(x, y, x + width - 1, y + height - 1, &wireColor);
+}
+
+bool DisplayManager::beginFills() {
+    if (!display || !displayInitialized || transferActive) {
+        return false;
+    }
+    
+    return display->beginFillBatch() == LCD320240_STAT_Nominal;
+}
+
+void DisplayManager::endFills() {
+    if (!display || !displayInitialized) {
+        return;
+    }
+    
+    display->endFillBatch();
+}
+
 void DisplayManager::drawFrameBuffer(uint16_t* frameBuffer, uint16_t width, uint16_t height,
                                     uint16_t x, uint16_t y) {
     if (!display || !displayInitialized || !frameBuffer) {
         return;
     }
     
+    MemoryPlanner::prepareDeviceRead(frameBuffer, (size_t)width * height * sizeof(uint16_t));
     display->hwfillFromArray(x, y, x + width - 1, y + height - 1, 
                             frameBuffer, width * height, false);
+}
+
+bool DisplayManager::beginFrameTransfer(uint16_t* frameBuffer, uint16_t width, uint16_t height,
+                                        uint16_t x, uint16_t y) {
+    if (!display || !displayInitialized || !frameBuffer || transferActive) {
+        return false;
+    }
+    
+    MemoryPlanner::prepareDeviceRead(frameBuffer, (size_t)width * height * sizeof(uint16_t));
+    if (display->hwfillFromArrayAsync(x, y, x + width - 1, y + height - 1,
+                                      frameBuffer, width * height) != LCD320240_STAT_Nominal) {
+        return false;
+    }
+    transferActive = true;
+    return true;
+}
+
+bool DisplayManager::isTransferDone() {
+    if (!transferActive) {
+        return true;
+    }
+    if (display->transferBusy()) {
+        return false;
+    }
+    
+    display->finishTransfer();
+    transferActive = false;
+    return true;
 }
\ No newline at end of file
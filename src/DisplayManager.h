@@ -11,6 +11,7 @@ private:
     uint8_t pinBacklight;
     LCD320240_4WSPI* display;
     bool displayInitialized;
+    bool transferActive;
     
 public:
     DisplayManager(uint8_t csPin, uint8_t dcPin, uint8_t backlightPin);
@@ -33,11 +34,28 @@ public:
     void drawFrameBuffer(uint16_t* frameBuffer, uint16_t width, uint16_t height,
                         uint16_t x = 0, uint16_t y = 0);
     
+    // Sends a buffer with one window setup and a single background DMA
+    // transfer. The buffer must not change until isTransferDone() returns
+    // true, which also releases the bus.
+    bool beginFrameTransfer(uint16_t* frameBuffer, uint16_t width, uint16_t height,
+                            uint16_t x = 0, uint16_t y = 0);
+    bool isTransferDone();
+    
     void drawPixel(uint16_t x, uint16_t y, uint16_t color);
     
     void drawRectangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, 
                        uint16_t color, bool filled = true);
     
+    // A filled rectangle as one window and the color repeated through it; the
+    // color is RGB565 as decoded from a frame.
+    void fillRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t color);
+    
+    // Between beginFills() and endFills() the bus stays selected, so each
+    // fillRectangle() only sends its window and color. Nothing else may be
+    // drawn in between.
+    bool beginFills();
+    void endFills();
+    
     void releaseSPI();
     
 private:
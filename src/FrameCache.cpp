@@ -0,0 +1,269 @@
+#include "FrameCache.h"
+
+static inline uint32_t alignUp(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+FrameCache::FrameCache()
+    : storage(nullptr), capacity(0), admission(ADMIT_ALL), clipKey(0), entryCount(0),
+      useClock(0), inUseFrame(NO_FRAME), pinnedFull(false), pinRanges(0) {
+    resetStats();
+}
+
+void FrameCache::setStorage(uint8_t* buffer, size_t size) {
+    uint8_t* aligned = (uint8_t*)(((uintptr_t)buffer + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+    size_t lost = aligned - buffer;
+    
+    storage = size > lost ? aligned : nullptr;
+    capacity = size > lost ? size - lost : 0;
+    clear();
+}
+
+void FrameCache::setClip(uint32_t key) {
+    if (key != clipKey) {
+        clipKey = key;
+        clear();
+    }
+}
+
+void FrameCache::clear() {
+    entryCount = 0;
+    inUseFrame = NO_FRAME;
+    pinnedFull = false;
+}
+
+bool FrameCache::pinRange(uint32_t firstFrame, uint32_t count) {
+    if (pinRanges >= MAX_PINNED_RANGES || count == 0) {
+        return false;
+    }
+    
+    pinFirst[pinRanges] = firstFrame;
+    pinCount[pinRanges] = count;
+    pinRanges++;
+    pinnedFull = false;
+    
+    for (uint16_t i = 0; i < entryCount; i++) {
+        if (entries[i].frame - firstFrame < count) {
+            entries[i].pinned = true;
+        }
+    }
+    return true;
+}
+
+void FrameCache::clearPins() {
+    pinRanges = 0;
+    for (uint16_t i = 0; i < entryCount; i++) {
+        entries[i].pinned = false;
+    }
+}
+
+bool FrameCache::isPinned(uint32_t frame) const {
+    for (uint8_t i = 0; i < pinRanges; i++) {
+        if (frame - pinFirst[i] < pinCount[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameCache::wants(uint32_t frame) const {
+    if (!storage || contains(frame)) {
+        return false;
+    }
+    return admission == ADMIT_ALL || isPinned(frame);
+}
+
+int FrameCache::findEntry(uint32_t frame) const {
+    for (uint16_t i = 0; i < entryCount; i++) {
+        if (entries[i].frame == frame) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool FrameCache::contains(uint32_t frame) const {
+    int position = findEntry(frame);
+    return position >= 0 && entries[position].valid;
+}
+
+const uint8_t* FrameCache::lookup(uint32_t frame) {
+    if (!storage) {
+        return nullptr;
+    }
+    
+    int position = findEntry(frame);
+    if (position < 0 || !entries[position].valid) {
+        stats.misses++;
+        inUseFrame = NO_FRAME;
+        return nullptr;
+    }
+    
+    stats.hits++;
+    entries[position].lastUse = ++useClock;
+    inUseFrame = frame;
+    return storage + entries[position].offset;
+}
+
+// First-fit: the lowest gap between entries (or after the last one) that
+// holds the frame. position is where the new entry goes in the sorted table.
+bool FrameCache::findGap(uint32_t size, uint32_t& offset, uint16_t& position) const {
+    uint32_t cursor = 0;
+    
+    for (uint16_t i = 0; i < entryCount; i++) {
+        if (entries[i].offset >= cursor + size) {
+            offset = cursor;
+            position = i;
+            return true;
+        }
+        cursor = alignUp(entries[i].offset + entries[i].size, ALIGNMENT);
+    }
+    
+    if (cursor + size <= capacity) {
+        offset = cursor;
+        position = entryCount;
+        return true;
+    }
+    return false;
+}
+
+bool FrameCache::evictOne() {
+    int victim = -1;
+    
+    for (uint16_t i = 0; i < entryCount; i++) {
+        const FrameCacheEntry& entry = entries[i];
+        if (entry.pinned || !entry.valid || entry.frame == inUseFrame) {
+            continue;
+        }
+        if (victim < 0 || entry.lastUse < entries[victim].lastUse) {
+            victim = i;
+        }
+    }
+    
+    if (victim < 0) {
+        return false;
+    }
+    
+    removeAt(victim);
+    stats.evictions++;
+    return true;
+}
+
+void FrameCache::removeAt(uint16_t position) {
+    for (uint16_t i = position; i + 1 < entryCount; i++) {
+        entries[i] = entries[i + 1];
+    }
+    entryCount--;
+}
+
+uint8_t* FrameCache::reserve(uint32_t frame, uint32_t size) {
+    if (!storage || size > capacity || findEntry(frame) >= 0) {
+        return nullptr;
+    }
+    
+    bool pinned = isPinned(frame);
+    uint32_t offset;
+    uint16_t position;
+    
+    while (entryCount >= MAX_ENTRIES || !findGap(size, offset, position)) {
+        if (!evictOne()) {
+            if (pinned) {
+                pinnedFull = true;
+            }
+            return nullptr;
+        }
+    }
+    
+    for (uint16_t i = entryCount; i > position; i--) {
+        entries[i] = entries[i - 1];
+    }
+    entryCount++;
+    
+    FrameCacheEntry& entry = entries[position];
+    entry.frame = frame;
+    entry.offset = offset;
+    entry.size = size;
+    entry.lastUse = ++useClock;
+    entry.pinned = pinned;
+    entry.valid = false;
+    
+    return storage + offset;
+}
+
+void FrameCache::commit(uint32_t frame, bool prefetched) {
+    int position = findEntry(frame);
+    if (position >= 0) {
+        entries[position].valid = true;
+        stats.inserts++;
+        if (prefetched) {
+            stats.prefills++;
+        }
+    }
+}
+
+void FrameCache::release(uint32_t frame) {
+    int position = findEntry(frame);
+    if (position >= 0 && !entries[position].valid) {
+        removeAt(position);
+    }
+}
+
+bool FrameCache::insert(uint32_t frame, const uint8_t* data, uint32_t size) {
+    uint8_t* destination = reserve(frame, size);
+    if (!destination) {
+        return false;
+    }
+    memcpy(destination, data, size);
+    commit(frame);
+    return true;
+}
+
+uint32_t FrameCache::nextUncachedPinned(uint32_t frameCount) const {
+    if (!storage || pinnedFull) {
+        return NO_FRAME;
+    }
+    
+    for (uint8_t i = 0; i < pinRanges; i++) {
+        for (uint32_t frame = pinFirst[i]; frame - pinFirst[i] < pinCount[i] && frame < frameCount; frame++) {
+            if (findEntry(frame) < 0) {
+                return frame;
+            }
+        }
+    }
+    return NO_FRAME;
+}
+
+size_t FrameCache::getBytesUsed() const {
+    size_t used = 0;
+    for (uint16_t i = 0; i < entryCount; i++) {
+        used += entries[i].size;
+    }
+    return used;
+}
+
+void FrameCache::resetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void FrameCache::printStats() const {
+    uint32_t lookups = stats.hits + stats.misses;
+    uint32_t pinnedEntries = 0;
+    for (uint16_t i = 0; i < entryCount; i++) {
+        if (entries[i].pinned) {
+            pinnedEntries++;
+        }
+    }
+    
+    Serial.println("# fcache,entries,pinned,bytes_used,capacity,hits,misses,hit_pct,inserts,evictions,prefills");
+    Serial.printf("fcache,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                  entryCount,
+                  (unsigned long)pinnedEntries,
+                  (unsigned long)getBytesUsed(),
+                  (unsigned long)capacity,
+                  (unsigned long)stats.hits,
+                  (unsigned long)stats.misses,
+                  (unsigned long)(lookups ? (uint64_t)stats.hits * 100 / lookups : 0),
+                  (unsigned long)stats.inserts,
+                  (unsigned long)stats.evictions,
+                  (unsigned long)stats.prefills);
+}
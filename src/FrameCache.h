@@ -0,0 +1,104 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <Arduino.h>
+
+struct FrameCacheEntry {
+    uint32_t frame;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t lastUse;
+    bool pinned;
+    bool valid;     // false while a reserved frame is still being filled
+};
+
+struct FrameCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t inserts;
+    uint32_t evictions;
+    uint32_t prefills;
+};
+
+// Compressed frames kept in RAM (typically a DMAMEM buffer) so repeated
+// playback of the same frames skips the SD card. Frames inside pinned ranges
+// are never evicted; other frames are admitted according to the admission
+// policy and evicted least recently used first. Frames are keyed by frame
+// number within one clip, identified by a caller-supplied key.
+class FrameCache {
+public:
+    static const uint16_t MAX_ENTRIES = 256;
+    static const uint8_t MAX_PINNED_RANGES = 4;
+    static const uint32_t NO_FRAME = 0xFFFFFFFF;
+    static const uint32_t ALIGNMENT = 32;
+    
+    enum Admission : uint8_t {
+        ADMIT_PINNED = 0,   // only frames in pinned ranges
+        ADMIT_ALL           // every frame read, evicting LRU unpinned frames
+    };
+    
+    FrameCache();
+    
+    void setStorage(uint8_t* storage, size_t size);
+    void setAdmission(Admission policy) { admission = policy; }
+    // Drops every cached frame when the key differs from the current clip's.
+    void setClip(uint32_t key);
+    void clear();
+    
+    bool pinRange(uint32_t firstFrame, uint32_t count);
+    void clearPins();
+    bool isPinned(uint32_t frame) const;
+    
+    bool isEnabled() const { return storage != nullptr; }
+    bool wants(uint32_t frame) const;
+    bool contains(uint32_t frame) const;
+    
+    // Returns the cached frame or nullptr, counting a hit or miss. A hit stays
+    // protected from eviction until the next lookup.
+    const uint8_t* lookup(uint32_t frame);
+    
+    // reserve() returns space for a frame (evicting as needed) that the caller
+    // fills and then commits, or releases on failure. Empty frames (repeats
+    // without audio) take a table entry and no space.
+    uint8_t* reserve(uint32_t frame, uint32_t size);
+    void commit(uint32_t frame, bool prefetched = false);
+    void release(uint32_t frame);
+    bool insert(uint32_t frame, const uint8_t* data, uint32_t size);
+    
+    // First pinned frame below frameCount that is not cached yet, for filling
+    // when the pipeline has slack. NO_FRAME once pinned frames stop fitting.
+    uint32_t nextUncachedPinned(uint32_t frameCount) const;
+    
+    uint16_t getEntryCount() const { return entryCount; }
+    size_t getBytesUsed() const;
+    size_t getCapacity() const { return capacity; }
+    const FrameCacheStats& getStats() const { return stats; }
+    void resetStats();
+    void printStats() const;
+    
+private:
+    uint8_t* storage;
+    size_t capacity;
+    Admission admission;
+    uint32_t clipKey;
+    
+    // Sorted by storage offset so free gaps can be found in one pass.
+    FrameCacheEntry entries[MAX_ENTRIES];
+    uint16_t entryCount;
+    uint32_t useClock;
+    uint32_t inUseFrame;
+    bool pinnedFull;
+    
+    uint32_t pinFirst[MAX_PINNED_RANGES];
+    uint32_t pinCount[MAX_PINNED_RANGES];
+    uint8_t pinRanges;
+    
+    FrameCacheStats stats;
+    
+    int findEntry(uint32_t frame) const;
+    bool findGap(uint32_t size, uint32_t& offset, uint16_t& position) const;
+    bool evictOne();
+    void removeAt(uint16_t position);
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "FrameScheduler.h"
+
+static const char* const POLICY_NAMES[] = { "skip_display", "skip_decode", "slow_down" };
+
+FrameScheduler::FrameScheduler()
+    : fpsNumerator(30), fpsDenominator(1), speedPercent(100), frameBudget(0), stride(1),
+      originMicros(0), originFrame(0), nextFrame(0),
+      latePolicy(LATE_SKIP_DECODE), lateThreshold(0), hasLastPresent(false),
+      lastPresentFrame(0), lastPresentMicros(0) {
+    resetStats();
+}
+
+const char* FrameScheduler::policyName(uint8_t policy) {
+    return policy <= LATE_SLOW_DOWN ? POLICY_NAMES[policy] : "unknown";
+}
+
+void FrameScheduler::setRate(uint32_t numerator, uint32_t denominator) {
+    if (numerator == 0 || denominator == 0) {
+        return;
+    }
+    fpsNumerator = numerator;
+    fpsDenominator = denominator;
+    updateStride();
+}
+
+bool FrameScheduler::setSpeed(int32_t percent, uint32_t nowMicros) {
+    int32_t magnitude = percent < 0 ? -percent : percent;
+    if (magnitude < MIN_SPEED_PERCENT || magnitude > MAX_SPEED_PERCENT) {
+        return false;
+    }
+    
+    // Frames already picked in the old direction are replaced by the neighbour
+    // of the last one shown.
+    if ((percent < 0) != (speedPercent < 0) && hasLastPresent) {
+        nextFrame = (int64_t)lastPresentFrame + (percent < 0 ? -1 : 1);
+    }
+    
+    speedPercent = percent;
+    updateStride();
+    originMicros = nowMicros;
+    originFrame = nextFrame;
+    hasLastPresent = false;
+    return true;
+}
+
+void FrameScheduler::setFrameBudget(uint32_t micros) {
+    frameBudget = micros;
+    updateStride();
+}
+
+// Smallest frame step that keeps displayed frames at least one budget apart.
+void FrameScheduler::updateStride() {
+    uint64_t perSecond = 1000000ULL * fpsDenominator * 100;
+    uint64_t budget = frameBudget ? (uint64_t)frameBudget * fpsNumerator : perSecond / 100;
+    stride = (uint32_t)((budget * speedMagnitude() + perSecond - 1) / perSecond);
+    if (stride == 0) {
+        stride = 1;
+    }
+}
+
+uint32_t FrameScheduler::displayInterval() const {
+    return (uint32_t)(100000000ULL * fpsDenominator * stride / ((uint64_t)fpsNumerator * speedMagnitude()));
+}
+
+uint32_t FrameScheduler::millisToFrame(uint32_t milliseconds) const {
+    return (uint32_t)((uint64_t)milliseconds * fpsNumerator / (1000ULL * fpsDenominator));
+}
+
+uint32_t FrameScheduler::frameToMillis(uint32_t frame) const {
+    return (uint32_t)((uint64_t)frame * 1000 * fpsDenominator / fpsNumerator);
+}
+
+void FrameScheduler::start(uint32_t origin, uint32_t firstFrame) {
+    originMicros = origin;
+    originFrame = firstFrame;
+    nextFrame = firstFrame;
+    hasLastPresent = false;
+}
+
+uint32_t FrameScheduler::deadlineOf(int64_t frame) const {
+    int64_t frames = (frame - originFrame) * direction();
+    return originMicros + (uint32_t)(frames * 100000000LL * fpsDenominator / ((int64_t)fpsNumerator * speedMagnitude()));
+}
+
+// Frame position at nowMicros: the last frame whose deadline has passed.
+int64_t FrameScheduler::positionAt(uint32_t nowMicros) const {
+    int32_t elapsed = (int32_t)(nowMicros - originMicros);
+    if (elapsed <= 0) {
+        return originFrame;
+    }
+    uint64_t frames = (uint64_t)elapsed * fpsNumerator * speedMagnitude() / (100000000ULL * fpsDenominator);
+    return originFrame + (int64_t)frames * direction();
+}
+
+uint32_t FrameScheduler::next(uint32_t nowMicros, bool& display) {
+    int64_t frame = nextFrame;
+    uint32_t threshold = lateThreshold ? lateThreshold : displayInterval();
+    int32_t late = (int32_t)(nowMicros - deadlineOf(frame));
+    display = true;
+    
+    if (late > (int32_t)threshold) {
+        switch (latePolicy) {
+            case LATE_SKIP_DISPLAY:
+                display = false;
+                stats.dropped++;
+                break;
+            case LATE_SKIP_DECODE: {
+                int64_t due = positionAt(nowMicros);
+                int64_t ahead = (due - frame) * direction();
+                if (ahead > 0) {
+                    stats.skipped += ahead;
+                    frame = due;
+                }
+                break;
+            }
+            case LATE_SLOW_DOWN:
+                originMicros = nowMicros;
+                originFrame = frame;
+                hasLastPresent = false;
+                stats.rebased++;
+                break;
+        }
+    }
+    
+    nextFrame = frame + (int64_t)stride * direction();
+    return (uint32_t)frame;
+}
+
+void FrameScheduler::presented(uint32_t frame, uint32_t nowMicros) {
+    int32_t late = (int32_t)(nowMicros - deadline(frame));
+    
+    stats.presented++;
+    if (late > 0) {
+        stats.lateFrames++;
+        stats.totalLateMicros += late;
+        if ((uint32_t)late > stats.maxLateMicros) {
+            stats.maxLateMicros = late;
+        }
+    }
+    
+    if (hasLastPresent && frame != lastPresentFrame) {
+        int32_t nominal = (int32_t)(deadline(frame) - deadline(lastPresentFrame));
+        int32_t actual = (int32_t)(nowMicros - lastPresentMicros);
+        uint32_t jitter = actual > nominal ? actual - nominal : nominal - actual;
+        
+        stats.jitterSamples++;
+        stats.totalJitterMicros += jitter;
+        if (jitter > stats.maxJitterMicros) {
+            stats.maxJitterMicros = jitter;
+        }
+    }
+    
+    hasLastPresent = true;
+    lastPresentFrame = frame;
+    lastPresentMicros = nowMicros;
+}
+
+void FrameScheduler::resetStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void FrameScheduler::printStats() const {
+    uint32_t averageLate = stats.lateFrames ? (uint32_t)(stats.totalLateMicros / stats.lateFrames) : 0;
+    uint32_t averageJitter = stats.jitterSamples ? (uint32_t)(stats.totalJitterMicros / stats.jitterSamples) : 0;
+    
+    Serial.println("# sched,policy,fps_num,fps_den,speed_pct,presented,dropped,skipped,rebased,late,max_late_us,avg_late_us,max_jitter_us,avg_jitter_us");
+    Serial.printf("sched,%s,%lu,%lu,%ld,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                  policyName(latePolicy),
+                  (unsigned long)fpsNumerator,
+                  (unsigned long)fpsDenominator,
+                  (long)speedPercent,
+                  (unsigned long)stats.presented,
+                  (unsigned long)stats.dropped,
+                  (unsigned long)stats.skipped,
+                  (unsigned long)stats.rebased,
+                  (unsigned long)stats.lateFrames,
+                  (unsigned long)stats.maxLateMicros,
+                  (unsigned long)averageLate,
+                  (unsigned long)stats.maxJitterMicros,
+                  (unsigned long)averageJitter);
+}
@@ -0,0 +1,101 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <Arduino.h>
+
+struct FrameSchedulerStats {
+    uint32_t presented;
+    uint32_t dropped;           // read but not drawn (LATE_SKIP_DISPLAY)
+    uint32_t skipped;           // jumped over via the index (LATE_SKIP_DECODE)
+    uint32_t rebased;           // clock shifted back (LATE_SLOW_DOWN)
+    uint32_t lateFrames;        // presented after their deadline
+    uint32_t maxLateMicros;
+    uint64_t totalLateMicros;
+    uint32_t maxJitterMicros;   // worst |actual - nominal| interval between presented frames
+    uint64_t totalJitterMicros;
+    uint32_t jitterSamples;
+};
+
+// Presentation clock for one stream of frames. Deadlines are computed from the
+// clock origin with an exact rational frame period (fpsDenominator / fpsNumerator
+// seconds) rather than accumulated, so long clips do not drift. All times are
+// micros() values and compared wrap-safely.
+//
+// Playback speed is a signed percentage (100 = normal, -100 = reverse). When
+// the speed would show frames faster than one per frame budget, only every
+// stride-th frame is scheduled, so fast-forward stays within the budget.
+class FrameScheduler {
+public:
+    enum LatePolicy : uint8_t {
+        LATE_SKIP_DISPLAY = 0,  // read the late frame but do not decode or draw it
+        LATE_SKIP_DECODE,       // jump straight to the frame due now
+        LATE_SLOW_DOWN          // show every frame, moving the clock back instead
+    };
+    
+    static const int32_t MIN_SPEED_PERCENT = 25;
+    static const int32_t MAX_SPEED_PERCENT = 800;
+    
+    FrameScheduler();
+    
+    void setRate(uint32_t numerator, uint32_t denominator = 1);
+    void setLatePolicy(LatePolicy policy) { latePolicy = policy; }
+    // A frame counts as late once it is this far past its deadline; 0 means one display interval.
+    void setLateThreshold(uint32_t micros) { lateThreshold = micros; }
+    // Changes speed from nowMicros on, keeping the next frame in place. Returns
+    // false for speeds outside MIN_SPEED_PERCENT..MAX_SPEED_PERCENT.
+    bool setSpeed(int32_t percent, uint32_t nowMicros);
+    // Minimum time between displayed frames; 0 means one frame period at normal speed.
+    void setFrameBudget(uint32_t micros);
+    
+    void start(uint32_t originMicros, uint32_t firstFrame = 0);
+    
+    uint32_t deadline(uint32_t frame) const { return deadlineOf(frame); }
+    uint32_t nextDeadline() const { return deadlineOf(nextFrame); }
+    uint32_t frameAt(uint32_t nowMicros) const { return (uint32_t)positionAt(nowMicros); }
+    uint32_t millisToFrame(uint32_t milliseconds) const;
+    uint32_t frameToMillis(uint32_t frame) const;
+    uint32_t framePeriod() const { return (uint32_t)(1000000ULL * fpsDenominator / fpsNumerator); }
+    uint32_t displayInterval() const;
+    
+    // Picks the frame to show next under the late policy. display is cleared
+    // when the frame should only be consumed, not drawn. Past either end of the
+    // clip the returned frame is out of range (reverse wraps below 0).
+    uint32_t next(uint32_t nowMicros, bool& display);
+    void presented(uint32_t frame, uint32_t nowMicros);
+    
+    uint32_t getNextFrame() const { return (uint32_t)nextFrame; }
+    int32_t getSpeed() const { return speedPercent; }
+    uint32_t getStride() const { return stride; }
+    LatePolicy getLatePolicy() const { return latePolicy; }
+    const FrameSchedulerStats& getStats() const { return stats; }
+    void resetStats();
+    void printStats() const;
+    
+    static const char* policyName(uint8_t policy);
+    
+private:
+    uint32_t fpsNumerator;
+    uint32_t fpsDenominator;
+    int32_t speedPercent;
+    uint32_t frameBudget;
+    uint32_t stride;
+    uint32_t originMicros;
+    int64_t originFrame;
+    int64_t nextFrame;
+    LatePolicy latePolicy;
+    uint32_t lateThreshold;
+    
+    bool hasLastPresent;
+    uint32_t lastPresentFrame;
+    uint32_t lastPresentMicros;
+    
+    FrameSchedulerStats stats;
+    
+    int32_t direction() const { return speedPercent < 0 ? -1 : 1; }
+    uint32_t speedMagnitude() const { return speedPercent < 0 ? -speedPercent : speedPercent; }
+    uint32_t deadlineOf(int64_t frame) const;
+    int64_t positionAt(uint32_t nowMicros) const;
+    void updateStride();
+};
+
+#endif
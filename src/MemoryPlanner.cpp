@@ -0,0 +1,123 @@
+#include "MemoryPlanner.h"
+
+static const char* const POOL_NAMES[MEMORY_POOL_COUNT] = { "fast", "dma" };
+
+MemoryPlanner::MemoryPlanner() : regionCount(0) {
+    for (uint8_t i = 0; i < MEMORY_POOL_COUNT; i++) {
+        bases[i] = nullptr;
+        sizes[i] = 0;
+        used[i] = 0;
+    }
+}
+
+const char* MemoryPlanner::poolName(uint8_t pool) {
+    return pool < MEMORY_POOL_COUNT ? POOL_NAMES[pool] : "unknown";
+}
+
+void MemoryPlanner::setPool(MemoryPool pool, uint8_t* storage, size_t size) {
+    uint8_t* aligned = storage ? (uint8_t*)(((uintptr_t)storage + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1)) : nullptr;
+    size_t lost = aligned - storage;
+    
+    bases[pool] = size > lost ? aligned : nullptr;
+    sizes[pool] = size > lost ? (size - lost) & ~(ALIGNMENT - 1) : 0;
+    reset();
+}
+
+void MemoryPlanner::reset() {
+    for (uint8_t i = 0; i < MEMORY_POOL_COUNT; i++) {
+        used[i] = 0;
+    }
+    regionCount = 0;
+}
+
+size_t MemoryPlanner::available(MemoryPool pool) const {
+    return sizes[pool] - used[pool];
+}
+
+uint8_t* MemoryPlanner::carve(const char* name, size_t bytes, MemoryPool preferred) {
+    if (regionCount >= MAX_REGIONS) {
+        return nullptr;
+    }
+    
+    size_t aligned = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    MemoryPool pool = preferred;
+    if (available(pool) < aligned) {
+        pool = preferred == MEMORY_FAST ? MEMORY_DMA : MEMORY_FAST;
+        if (available(pool) < aligned) {
+            return nullptr;
+        }
+    }
+    
+    uint8_t* address = bases[pool] + used[pool];
+    used[pool] += aligned;
+    
+    MemoryRegion& region = regions[regionCount++];
+    region.name = name;
+    region.pool = pool;
+    region.address = address;
+    region.bytes = bytes;
+    return address;
+}
+
+void MemoryPlanner::printMap() const {
+    Serial.println("# mempool,pool,address,used,capacity,cached");
+    for (uint8_t i = 0; i < MEMORY_POOL_COUNT; i++) {
+        if (!sizes[i]) {
+            continue;
+        }
+        Serial.printf("mempool,%s,0x%08lx,%lu,%lu,%u\n",
+                      POOL_NAMES[i],
+                      (unsigned long)(uintptr_t)bases[i],
+                      (unsigned long)used[i],
+                      (unsigned long)sizes[i],
+                      isCached(bases[i]) ? 1 : 0);
+    }
+    
+    Serial.println("# memregion,name,pool,address,bytes");
+    for (uint8_t i = 0; i < regionCount; i++) {
+        const MemoryRegion& region = regions[i];
+        Serial.printf("memregion,%s,%s,0x%08lx,%lu\n",
+                      region.name,
+                      POOL_NAMES[region.pool],
+                      (unsigned long)(uintptr_t)region.address,
+                      (unsigned long)region.bytes);
+    }
+}
+
+#if defined(__IMXRT1062__)
+
+// DTCM (RAM1) is not cached; OCRAM (RAM2), EXTMEM and flash are.
+bool MemoryPlanner::isCached(const void* buffer) {
+    return (uintptr_t)buffer >= 0x20200000;
+}
+
+void MemoryPlanner::prepareDeviceRead(const void* buffer, size_t bytes) {
+    if (bytes && isCached(buffer)) {
+        arm_dcache_flush((void*)buffer, bytes);
+    }
+}
+
+void MemoryPlanner::prepareDeviceWrite(void* buffer, size_t bytes) {
+    if (bytes && isCached(buffer)) {
+        arm_dcache_flush_delete(buffer, bytes);
+    }
+}
+
+#else
+
+bool MemoryPlanner::isCached(const void* buffer) {
+    (void)buffer;
+    return false;
+}
+
+void MemoryPlanner::prepareDeviceRead(const void* buffer, size_t bytes) {
+    (void)buffer;
+    (void)bytes;
+}
+
+void MemoryPlanner::prepareDeviceWrite(void* buffer, size_t bytes) {
+    (void)buffer;
+    (void)bytes;
+}
+
+#endif
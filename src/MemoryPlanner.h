@@ -0,0 +1,60 @@
+#ifndef MEMORY_PLANNER_H
+#define MEMORY_PLANNER_H
+
+#include <Arduino.h>
+
+enum MemoryPool : uint8_t {
+    MEMORY_FAST = 0,    // tightly coupled, uncached (DTCM on the Teensy 4)
+    MEMORY_DMA,         // bulk RAM reachable by DMA, cached (DMAMEM / OCRAM)
+    MEMORY_POOL_COUNT
+};
+
+struct MemoryRegion {
+    const char* name;
+    MemoryPool pool;
+    uint8_t* address;
+    size_t bytes;
+};
+
+// Places named buffers in caller-supplied pools. Each carve() tries the
+// preferred pool first and falls back to the other, and every region starts
+// on a cache line so DMA transfers never share a line with other data.
+// reset() releases all regions at once; nothing is ever freed individually.
+class MemoryPlanner {
+public:
+    static const uint8_t MAX_REGIONS = 8;
+    static const size_t ALIGNMENT = 32;
+    
+    MemoryPlanner();
+    
+    void setPool(MemoryPool pool, uint8_t* storage, size_t size);
+    void reset();
+    
+    uint8_t* carve(const char* name, size_t bytes, MemoryPool preferred);
+    size_t available(MemoryPool pool) const;
+    size_t capacity(MemoryPool pool) const { return sizes[pool]; }
+    bool hasPool(MemoryPool pool) const { return sizes[pool] != 0; }
+    
+    void printMap() const;
+    
+    static const char* poolName(uint8_t pool);
+    
+    // Cache maintenance around DMA. Call prepareDeviceRead() before a device
+    // reads a buffer the CPU wrote (cleans dirty lines) and prepareDeviceWrite()
+    // before a device fills a buffer the CPU will read (cleans and drops the
+    // lines so no stale or evicted data lands on top). Both are no-ops for
+    // uncached memory and on the host.
+    static void prepareDeviceRead(const void* buffer, size_t bytes);
+    static void prepareDeviceWrite(void* buffer, size_t bytes);
+    static bool isCached(const void* buffer);
+    
+private:
+    uint8_t* bases[MEMORY_POOL_COUNT];
+    size_t sizes[MEMORY_POOL_COUNT];
+    size_t used[MEMORY_POOL_COUNT];
+    
+    MemoryRegion regions[MAX_REGIONS];
+    uint8_t regionCount;
+};
+
+#endif
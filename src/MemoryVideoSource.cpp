@@ -0,0 +1,29 @@
+#include "MemoryVideoSource.h"
+
+MemoryVideoSource::MemoryVideoSource(const uint8_t* imageData, size_t imageSize)
+    : data(imageData), size(imageSize) {
+}
+
+bool MemoryVideoSource::open() {
+    return data != nullptr && size >= sizeof(VideoHeader);
+}
+
+bool MemoryVideoSource::read(uint8_t* buffer, size_t bytesToRead, size_t offset) {
+    if (!data || !buffer || offset > size || bytesToRead > size - offset) {
+        return false;
+    }
+    
+    memcpy(buffer, data + offset, bytesToRead);
+    return true;
+}
+
+const uint8_t* MemoryVideoSource::getFrame(const FrameIndexEntry& entry, uint8_t* scratch, size_t scratchSize) {
+    (void)scratch;
+    (void)scratchSize;
+    
+    if (!data || entry.offset > size || entry.size > size - entry.offset) {
+        return nullptr;
+    }
+    
+    return data + entry.offset;
+}
@@ -0,0 +1,27 @@
+#ifndef MEMORY_VIDEO_SOURCE_H
+#define MEMORY_VIDEO_SOURCE_H
+
+#include <Arduino.h>
+#include "VideoSource.h"
+
+// A .vid image that is directly addressable: baked into memory-mapped program
+// flash (see vid/embed_video.py), placed in EXTMEM, or mmap()ed on the host.
+// Frames are decoded in place, with no copy into a read buffer.
+class MemoryVideoSource : public VideoSource {
+protected:
+    const uint8_t* data;
+    size_t size;
+    
+public:
+    MemoryVideoSource(const uint8_t* imageData = nullptr, size_t imageSize = 0);
+    
+    void setImage(const uint8_t* imageData, size_t imageSize) { data = imageData; size = imageSize; }
+    
+    bool open() override;
+    void close() override {}
+    bool read(uint8_t* buffer, size_t bytesToRead, size_t offset) override;
+    const uint8_t* getFrame(const FrameIndexEntry& entry, uint8_t* scratch, size_t scratchSize) override;
+    bool isMemoryMapped() const override { return true; }
+};
+
+#endif
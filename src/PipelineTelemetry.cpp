@@ -0,0 +1,61 @@
+#include "PipelineTelemetry.h"
+
+#if PIPELINE_TELEMETRY
+
+PipelineTelemetry::PipelineTelemetry() : head(0), tail(0), sentBytes(0), enabled(false), overflows(0) {
+}
+
+void PipelineTelemetry::setEnabled(bool on) {
+    enabled = on;
+    if (!on) {
+        head = tail;
+        sentBytes = 0;
+    }
+}
+
+void PipelineTelemetry::record(PipelineStage stage, uint32_t frame, uint8_t segment, uint32_t start, uint32_t value) {
+    uint16_t next = (head + 1) % RING_RECORDS;
+    if (next == tail) {
+        overflows++;
+        return;
+    }
+    
+    TelemetryRecord& entry = ring[head];
+    entry.sync = SYNC;
+    entry.stage = stage;
+    entry.segment = segment;
+    entry.frame = frame;
+    entry.start = start;
+    entry.value = value;
+    
+    const uint8_t* bytes = (const uint8_t*)&entry;
+    uint8_t check = 0;
+    for (uint8_t i = 4; i < sizeof(TelemetryRecord); i++) {
+        check ^= bytes[i];
+    }
+    entry.check = check;
+    
+    head = next;
+}
+
+// Sends whole or partial records, never more than the transmit buffer takes.
+void PipelineTelemetry::flush() {
+    while (tail != head) {
+        int room = Serial.availableForWrite();
+        if (room <= 0) {
+            return;
+        }
+        
+        uint8_t pending = sizeof(TelemetryRecord) - sentBytes;
+        uint8_t count = (uint32_t)room < pending ? room : pending;
+        Serial.write((const uint8_t*)&ring[tail] + sentBytes, count);
+        sentBytes += count;
+        
+        if (sentBytes == sizeof(TelemetryRecord)) {
+            sentBytes = 0;
+            tail = (tail + 1) % RING_RECORDS;
+        }
+    }
+}
+
+#endif
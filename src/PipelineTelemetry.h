@@ -0,0 +1,99 @@
+#ifndef PIPELINE_TELEMETRY_H
+#define PIPELINE_TELEMETRY_H
+
+#include <Arduino.h>
+
+// Build with -DPIPELINE_TELEMETRY=0 to compile the per-frame telemetry out.
+#ifndef PIPELINE_TELEMETRY
+#define PIPELINE_TELEMETRY 1
+#endif
+
+enum PipelineStage : uint8_t {
+    STAGE_INDEX = 0,    // index lookup (value: duration us)
+    STAGE_READ,         // one read of compressed data (segment: chunk number)
+    STAGE_CACHE,        // frame served from the frame cache
+    STAGE_DECODE,       // RLE decode of one segment
+    STAGE_SWAP,         // byte swap of one segment
+    STAGE_SPI,          // transfer of one segment to the LCD
+    STAGE_PRESENT,      // frame presented (start: deadline, value: signed lateness us)
+    STAGE_SKIP,         // frames jumped over by the late policy (value: count)
+    STAGE_DROP,         // frame read but not drawn by the late policy
+    STAGE_COUNT
+};
+
+// 16-byte wire record. `check` is the XOR of bytes 4..15 so a reader can
+// resynchronise on `sync` when records are mixed with text on the same port.
+#pragma pack(push, 1)
+struct TelemetryRecord {
+    uint8_t sync;
+    uint8_t stage;
+    uint8_t segment;
+    uint8_t check;
+    uint32_t frame;
+    uint32_t start;
+    uint32_t value;
+};
+#pragma pack(pop)
+
+#if PIPELINE_TELEMETRY
+
+// Records go into a fixed ring and are drained to Serial only as far as the
+// USB transmit buffer has room, so recording never blocks playback; records
+// that do not fit in the ring are counted and dropped. Off until enabled.
+class PipelineTelemetry {
+public:
+    static const uint16_t RING_RECORDS = 256;
+    static const uint8_t SYNC = 0xA5;
+    
+    PipelineTelemetry();
+    
+    void setEnabled(bool on);
+    bool isEnabled() const { return enabled; }
+    
+    void record(PipelineStage stage, uint32_t frame, uint8_t segment, uint32_t start, uint32_t value);
+    void flush();
+    
+    uint32_t getOverflowCount() const { return overflows; }
+    
+private:
+    TelemetryRecord ring[RING_RECORDS];
+    uint16_t head;
+    uint16_t tail;
+    uint8_t sentBytes;
+    bool enabled;
+    uint32_t overflows;
+};
+
+class PipelineTimingScope {
+public:
+    PipelineTimingScope(PipelineTelemetry& pipelineTelemetry, PipelineStage pipelineStage, uint32_t frameNumber, uint8_t segmentNumber)
+        : telemetry(pipelineTelemetry), stage(pipelineStage), frame(frameNumber), segment(segmentNumber),
+          start(pipelineTelemetry.isEnabled() ? micros() : 0) {}
+    ~PipelineTimingScope() {
+        if (telemetry.isEnabled()) {
+            telemetry.record(stage, frame, segment, start, micros() - start);
+        }
+    }
+    
+private:
+    PipelineTelemetry& telemetry;
+    PipelineStage stage;
+    uint32_t frame;
+    uint8_t segment;
+    uint32_t start;
+};
+
+#define PIPELINE_TIMED(stage, frame, segment) PipelineTimingScope pipelineScope(telemetry, (stage), (frame), (segment))
+#define PIPELINE_EVENT(stage, frame, segment, start, value) \
+    do { if (telemetry.isEnabled()) telemetry.record((stage), (frame), (segment), (start), (value)); } while (0)
+#define PIPELINE_FLUSH() telemetry.flush()
+
+#else
+
+#define PIPELINE_TIMED(stage, frame, segment) do {} while (0)
+#define PIPELINE_EVENT(stage, frame, segment, start, value) do {} while (0)
+#define PIPELINE_FLUSH() do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+#include "Playlist.h"
+#include <strings.h>
+
+static const size_t PLAYLIST_FILE_MAX = 2048;
+
+Playlist::Playlist() : count(0) {
+}
+
+void Playlist::clear() {
+    count = 0;
+}
+
+bool Playlist::add(const char* path) {
+    size_t length = strlen(path);
+    
+    if (count >= MAX_ENTRIES || length == 0 || length >= MAX_PATH_LENGTH) {
+        return false;
+    }
+    
+    memcpy(paths[count], path, length + 1);
+    count++;
+    return true;
+}
+
+const char* Playlist::get(uint8_t index) const {
+    return index < count ? paths[index] : nullptr;
+}
+
+uint8_t Playlist::nextIndex(uint8_t index, bool loop) const {
+    if (index + 1 < count) {
+        return index + 1;
+    }
+    return (loop && count > 0) ? 0 : NO_ENTRY;
+}
+
+uint8_t Playlist::loadFromFile(SDFileReader* reader, const char* playlistPath) {
+    uint8_t text[PLAYLIST_FILE_MAX];
+    size_t bytesRead;
+    
+    if (!reader->readPartialFile(playlistPath, text, bytesRead, sizeof(text) - 1, 0)) {
+        return 0;
+    }
+    
+    text[bytesRead] = '\0';
+    
+    char* line = (char*)text;
+    while (line && *line) {
+        char* lineEnd = strchr(line, '\n');
+        if (lineEnd) {
+            *lineEnd = '\0';
+        }
+        
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            line[--length] = '\0';
+        }
+        
+        if (length > 0) {
+            add(line);
+        }
+        
+        line = lineEnd ? lineEnd + 1 : nullptr;
+    }
+    
+    return count;
+}
+
+uint8_t Playlist::scanDirectory(SDFileReader* reader, const char* directory, const char* extension) {
+    FsFile dir = reader->sd.open(directory, O_RDONLY);
+    if (!dir) {
+        return 0;
+    }
+    
+    size_t directoryLength = strlen(directory);
+    bool needsSeparator = directoryLength == 0 || directory[directoryLength - 1] != '/';
+    size_t extensionLength = strlen(extension);
+    
+    FsFile entry;
+    char name[MAX_PATH_LENGTH];
+    char path[MAX_PATH_LENGTH];
+    
+    while (count < MAX_ENTRIES && entry.openNext(&dir, O_RDONLY)) {
+        size_t nameLength = entry.getName(name, sizeof(name));
+        bool isVideo = !entry.isDir() && 
+                       name[0] != '.' &&
+                       nameLength > extensionLength &&
+                       strcasecmp(name + nameLength - extensionLength, extension) == 0;
+        entry.close();
+        
+        if (isVideo && directoryLength + needsSeparator + nameLength < MAX_PATH_LENGTH) {
+            memcpy(path, directory, directoryLength);
+            if (needsSeparator) {
+                path[directoryLength] = '/';
+            }
+            memcpy(path + directoryLength + needsSeparator, name, nameLength + 1);
+            add(path);
+        }
+    }
+    
+    dir.close();
+    sort();
+    
+    return count;
+}
+
+void Playlist::sort() {
+    char swap[MAX_PATH_LENGTH];
+    
+    for (uint8_t i = 1; i < count; i++) {
+        for (uint8_t j = i; j > 0 && strcmp(paths[j - 1], paths[j]) > 0; j--) {
+            memcpy(swap, paths[j], MAX_PATH_LENGTH);
+            memcpy(paths[j], paths[j - 1], MAX_PATH_LENGTH);
+            memcpy(paths[j - 1], swap, MAX_PATH_LENGTH);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <Arduino.h>
+#include "SDFileReader.h"
+
+// Fixed-capacity list of video paths, filled from a playlist file (one path
+// per line, '#' starts a comment) or from a directory scan sorted by name.
+class Playlist {
+public:
+    static const uint8_t MAX_ENTRIES = 32;
+    static const uint8_t MAX_PATH_LENGTH = 64;
+    static const uint8_t NO_ENTRY = 0xFF;
+    
+    Playlist();
+    
+    void clear();
+    bool add(const char* path);
+    
+    uint8_t loadFromFile(SDFileReader* reader, const char* playlistPath);
+    uint8_t scanDirectory(SDFileReader* reader, const char* directory, const char* extension = ".vid");
+    
+    uint8_t getCount() const { return count; }
+    const char* get(uint8_t index) const;
+    
+    // Index of the entry after `index`, wrapping when looping, or NO_ENTRY.
+    uint8_t nextIndex(uint8_t index, bool loop) const;
+    
+private:
+    char paths[MAX_ENTRIES][MAX_PATH_LENGTH];
+    uint8_t count;
+    
+    void sort();
+};
+
+#endif
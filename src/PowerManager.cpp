@@ -0,0 +1,163 @@
+#include "PowerManager.h"
+#include "StatsFormat.h"
+
+#if defined(__IMXRT1062__)
+#include <IntervalTimer.h>
+
+extern "C" uint32_t set_arm_clock(uint32_t frequency);
+
+static IntervalTimer wakeTimer;
+
+// The interrupt itself ends the WFI; there is nothing else to do.
+static void onWake() {
+}
+#endif
+
+const uint32_t PowerManager::LEVEL_HZ[LEVEL_COUNT] = { 150000000, 300000000, 450000000, 600000000 };
+
+// Time a sleep's wake-up takes, taken off the timer so the core is awake by
+// the wake time.
+static const uint32_t WAKE_MARGIN_MICROS = 10;
+
+PowerManager::PowerManager()
+    : clockScaling(false), level(LEVEL_COUNT - 1), lowFrames(0), budget(0), averageWork(0),
+      averageWait(0), averageBytes(0), levelSince(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void PowerManager::setClockScaling(bool enabled) {
+    clockScaling = enabled;
+    lowFrames = 0;
+    averageWork = 0;
+    averageWait = 0;
+    averageBytes = 0;
+    if (!enabled) {
+        setLevel(LEVEL_COUNT - 1);
+    }
+}
+
+void PowerManager::idleUntil(uint32_t wakeMicros) {
+    uint32_t start = micros();
+    int32_t remaining = (int32_t)(wakeMicros - start);
+    if (remaining < (int32_t)MIN_SLEEP_MICROS) {
+        return;
+    }
+    
+#if defined(__IMXRT1062__)
+    wakeTimer.begin(onWake, (uint32_t)remaining - WAKE_MARGIN_MICROS);
+    asm volatile("wfi");
+    wakeTimer.end();
+#else
+    delayMicroseconds(remaining);
+#endif
+    
+    stats.sleeps++;
+    stats.idleMicros += micros() - start;
+}
+
+void PowerManager::planFrames(uint32_t bytes, uint32_t budgetMicros) {
+    budget = budgetMicros;
+    if (!clockScaling || averageBytes == 0) {
+        return;
+    }
+    
+    uint64_t work = (uint64_t)averageWork * max(bytes, averageBytes) / averageBytes;
+    uint64_t allowed = (uint64_t)budgetMicros * TARGET_LOAD_PERCENT / 100;
+    uint8_t wanted = LEVEL_COUNT - 1;
+    for (uint8_t i = 0; i < LEVEL_COUNT - 1; i++) {
+        if (averageWait + work * LEVEL_HZ[LEVEL_COUNT - 1] / LEVEL_HZ[i] <= allowed) {
+            wanted = i;
+            break;
+        }
+    }
+    
+    if (wanted > level) {
+        setLevel(wanted);
+        lowFrames = 0;
+    } else if (wanted < level) {
+        if (++lowFrames >= HOLD_FRAMES) {
+            setLevel(level - 1);
+            lowFrames = 0;
+        }
+    } else {
+        lowFrames = 0;
+    }
+}
+
+void PowerManager::frameDone(uint32_t bytes, uint32_t workMicros, uint32_t waitMicros, uint32_t lateMicros) {
+    if (!clockScaling) {
+        return;
+    }
+    
+    uint32_t work = (uint32_t)((uint64_t)workMicros * LEVEL_HZ[level] / LEVEL_HZ[LEVEL_COUNT - 1]);
+    if (averageBytes == 0) {
+        averageWork = work;
+        averageWait = waitMicros;
+        averageBytes = max(bytes, (uint32_t)1);
+    } else {
+        averageWork = averageWork - averageWork / 8 + work / 8;
+        averageWait = averageWait - averageWait / 8 + waitMicros / 8;
+        averageBytes = max(averageBytes - averageBytes / 8 + bytes / 8, (uint32_t)1);
+    }
+    
+    if (budget && lateMicros > budget / 4 && level < LEVEL_COUNT - 1) {
+        setLevel(LEVEL_COUNT - 1);
+        lowFrames = 0;
+        stats.lateBoosts++;
+    }
+}
+
+// Changes the cycle counter's rate too: intervals on it must not span this
+// call (the player times its slices by micros() while scaling is on).
+void PowerManager::setLevel(uint8_t newLevel) {
+    if (newLevel == level) {
+        return;
+    }
+    
+    updateResidency();
+#if defined(__IMXRT1062__)
+    set_arm_clock(LEVEL_HZ[newLevel]);
+#endif
+    level = newLevel;
+    stats.clockChanges++;
+}
+
+void PowerManager::updateResidency() {
+    uint32_t now = micros();
+    stats.levelMicros[level] += now - levelSince;
+    levelSince = now;
+}
+
+const PowerStats& PowerManager::getStats() {
+    updateResidency();
+    return stats;
+}
+
+void PowerManager::resetStats() {
+    memset(&stats, 0, sizeof(stats));
+    levelSince = micros();
+}
+
+void PowerManager::printStats() {
+    char elapsedText[21];
+    updateResidency();
+    uint64_t elapsed = 0;
+    for (uint8_t i = 0; i < LEVEL_COUNT; i++) {
+        elapsed += stats.levelMicros[i];
+    }
+    
+    Serial.println("# power,clock_scaling,clock_mhz,elapsed_us,idle_pct,sleeps,clock_changes,late_boosts,"
+                   "residency_pct[150,300,450,600_mhz]");
+    Serial.printf("power,%s,%lu,%s,%lu,%lu,%lu,%lu",
+                  clockScaling ? "on" : "off",
+                  (unsigned long)(LEVEL_HZ[level] / 1000000),
+                  formatU64(elapsedText, elapsed),
+                  (unsigned long)(elapsed ? stats.idleMicros * 100 / elapsed : 0),
+                  (unsigned long)stats.sleeps,
+                  (unsigned long)stats.clockChanges,
+                  (unsigned long)stats.lateBoosts);
+    for (uint8_t i = 0; i < LEVEL_COUNT; i++) {
+        Serial.printf(",%lu", (unsigned long)(elapsed ? stats.levelMicros[i] * 100 / elapsed : 0));
+    }
+    Serial.println();
+}
@@ -0,0 +1,75 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+
+struct PowerStats {
+    uint32_t sleeps;            // WFI sleeps taken
+    uint32_t clockChanges;
+    uint32_t lateBoosts;        // jumps to the top clock after a late frame
+    uint64_t idleMicros;        // time spent asleep
+    uint64_t levelMicros[4];    // time at each of PowerManager::LEVEL_HZ, asleep or not
+};
+
+// Spends the player's spare time asleep and, with clock scaling on, runs the
+// core at the lowest clock that still fits the frames coming up.
+//
+// idleUntil() sleeps with WFI until the wake time or any earlier interrupt
+// (the 1 ms systick, USB, the audio timer) and returns, so the caller's loop
+// keeps servicing everything else. A one-shot timer ends the sleep on time
+// between systicks.
+//
+// A frame's cost has two parts: work, measured in micros at the current clock
+// and converted to what it would take at the top clock as if it all scaled
+// with it (SD reads only partly do, so the estimate errs on the slow side),
+// and waiting for a background transfer, which takes the same time at any
+// clock. The next frames are predicted from the average costs and the largest
+// compressed size among them: a frame larger than average is assumed to work
+// proportionally longer. The clock rises at once when a prediction needs it
+// or a frame is late, and falls one level at a time after HOLD_FRAMES frames
+// that would fit a lower one.
+class PowerManager {
+public:
+    // All levels keep the peripheral (IPG) clock at 150 MHz, so PWM
+    // frequencies are the same at every level.
+    static const uint8_t LEVEL_COUNT = 4;
+    static const uint32_t LEVEL_HZ[LEVEL_COUNT];
+    static const uint32_t TARGET_LOAD_PERCENT = 75;
+    static const uint32_t HOLD_FRAMES = 8;
+    static const uint32_t MIN_SLEEP_MICROS = 50;
+    
+    PowerManager();
+    
+    // Off by default; turning it off returns to the top clock.
+    void setClockScaling(bool enabled);
+    bool isClockScaling() const { return clockScaling; }
+    uint32_t getClockHz() const { return LEVEL_HZ[level]; }
+    
+    void idleUntil(uint32_t wakeMicros);
+    
+    // Player side: the heaviest of the next frames and the time available
+    // for each, then the measured cost of every displayed frame and how late
+    // it was presented.
+    void planFrames(uint32_t bytes, uint32_t budgetMicros);
+    void frameDone(uint32_t bytes, uint32_t workMicros, uint32_t waitMicros, uint32_t lateMicros);
+    
+    const PowerStats& getStats();
+    void resetStats();
+    void printStats();
+    
+private:
+    bool clockScaling;
+    uint8_t level;
+    uint32_t lowFrames;
+    uint32_t budget;
+    uint32_t averageWork;       // micros at the top clock
+    uint32_t averageWait;
+    uint32_t averageBytes;
+    uint32_t levelSince;
+    PowerStats stats;
+    
+    void setLevel(uint8_t newLevel);
+    void updateResidency();
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "PwmAudioSink.h"
+
+// A carrier well above the audible range for 8-bit duty cycles.
+static const float PWM_FREQUENCY = 585937.5f;
+
+PwmAudioSink* PwmAudioSink::activeSink = nullptr;
+
+PwmAudioSink::PwmAudioSink(uint8_t outputPin) : pin(outputPin), track(nullptr) {
+}
+
+bool PwmAudioSink::begin(AudioTrack* audioTrack, uint32_t sampleRate) {
+    if (activeSink || !audioTrack || sampleRate == 0) {
+        return false;
+    }
+    
+    track = audioTrack;
+    activeSink = this;
+    analogWriteFrequency(pin, PWM_FREQUENCY);
+    analogWrite(pin, 1 << (PWM_BITS - 1));
+    
+    if (!timer.begin(onSample, 1000000.0f / sampleRate)) {
+        activeSink = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void PwmAudioSink::end() {
+    if (activeSink != this) {
+        return;
+    }
+    timer.end();
+    activeSink = nullptr;
+    analogWrite(pin, 0);
+}
+
+void PwmAudioSink::onSample() {
+    int16_t sample;
+    activeSink->track->read(&sample, 1);
+    analogWrite(activeSink->pin, (uint16_t)(sample + 32768) >> (16 - PWM_BITS));
+}
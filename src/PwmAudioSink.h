@@ -0,0 +1,30 @@
+#ifndef PWM_AUDIO_SINK_H
+#define PWM_AUDIO_SINK_H
+
+#include <Arduino.h>
+#include <IntervalTimer.h>
+#include "AudioSink.h"
+#include "AudioTrack.h"
+
+// Plays the track as 8-bit PWM on one pin (the carrier board's buzzer, or an
+// RC filter into an amplifier), one sample per timer interrupt. Only one
+// PWM sink can be active at a time.
+class PwmAudioSink : public AudioSink {
+public:
+    static const uint8_t PWM_BITS = 8;
+    
+    explicit PwmAudioSink(uint8_t outputPin);
+    
+    bool begin(AudioTrack* audioTrack, uint32_t sampleRate) override;
+    void end() override;
+    
+private:
+    uint8_t pin;
+    AudioTrack* track;
+    IntervalTimer timer;
+    
+    static PwmAudioSink* activeSink;
+    static void onSample();
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "RLEDecoder.h"
+#include "Profiler.h"
 
 uint32_t RLEDecoder::decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t* output, uint32_t maxPixels) {
+    PROFILE_ZONE("rle_decode");
     uint32_t inPos = 0;
     uint32_t outPos = 0;
     
@@ -43,6 +45,7 @@ uint32_t RLEDecoder::decodeSegment(
     uint32_t startPixel, 
     uint32_t pixelCount
 ) {
+    PROFILE_ZONE("rle_decodeSegment");
     uint32_t inPos = findCompressedPosition(compressed, compressedSize, startPixel);
     if (inPos >= compressedSize) return 0;
     
@@ -112,6 +115,63 @@ uint32_t RLEDecoder::decodeSegment(
     return outPos;
 }
 
+uint32_t RLEDecoder::decodeNext(
+    const uint8_t* compressed,
+    uint32_t compressedSize,
+    RLECursor& cursor,
+    uint16_t* output,
+    uint32_t pixelCount
+) {
+    PROFILE_ZONE("rle_decodeNext");
+    uint32_t outPos = 0;
+    
+    while (outPos < pixelCount) {
+        if (cursor.remaining == 0) {
+            if (cursor.inPos >= compressedSize) break;
+            
+            uint8_t header = compressed[cursor.inPos++];
+            cursor.remaining = (header & 0x7F) + 1;
+            cursor.inRun = (header & 0x80) != 0;
+            
+            if (cursor.inRun) {
+                if (cursor.inPos + 1 >= compressedSize) {
+                    cursor.remaining = 0;
+                    break;
+                }
+                cursor.runValue = compressed[cursor.inPos] | (compressed[cursor.inPos + 1] << 8);
+                cursor.inPos += 2;
+            }
+        }
+        
+        uint32_t pixelsToWrite = min(cursor.remaining, pixelCount - outPos);
+        
+        if (cursor.inRun) {
+            for (uint32_t i = 0; i < pixelsToWrite; i++) {
+                output[outPos++] = cursor.runValue;
+            }
+        } else {
+            uint32_t available = (compressedSize - cursor.inPos) / 2;
+            if (pixelsToWrite > available) {
+                pixelsToWrite = available;
+                cursor.remaining = pixelsToWrite;
+            }
+            if (pixelsToWrite == 0) {
+                cursor.remaining = 0;
+                break;
+            }
+            
+            for (uint32_t i = 0; i < pixelsToWrite; i++) {
+                output[outPos++] = compressed[cursor.inPos] | (compressed[cursor.inPos + 1] << 8);
+                cursor.inPos += 2;
+            }
+        }
+        
+        cursor.remaining -= pixelsToWrite;
+    }
+    
+    return outPos;
+}
+
 uint32_t RLEDecoder::getDecompressedSize(const uint8_t* compressed, uint32_t compressedSize) {
     uint32_t inPos = 0;
     uint32_t pixelCount = 0;
@@ -3,6 +3,17 @@
 
 #include <Arduino.h>
 
+// Decoder position inside a compressed frame, so consecutive segments can be
+// decoded without rescanning the frame from the start.
+struct RLECursor {
+    uint32_t inPos;
+    uint32_t remaining;
+    uint16_t runValue;
+    bool inRun;
+    
+    void reset() { inPos = 0; remaining = 0; runValue = 0; inRun = false; }
+};
+
 class RLEDecoder {
 public:
     static uint32_t decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t* output, uint32_t maxPixels);
@@ -15,6 +26,15 @@ public:
         uint32_t pixelCount
     );
     
+    // Decodes the next pixelCount pixels after the cursor and advances it.
+    static uint32_t decodeNext(
+        const uint8_t* compressed,
+        uint32_t compressedSize,
+        RLECursor& cursor,
+        uint16_t* output,
+        uint32_t pixelCount
+    );
+    
     static uint32_t getDecompressedSize(const uint8_t* compressed, uint32_t compressedSize);
     
 private:
@@ -0,0 +1,73 @@
+#include "RectDecoder.h"
+#include "VideoFormat.h"
+#include "Profiler.h"
+
+bool RectDecoder::decodeNext(
+    const uint8_t* compressed,
+    uint32_t compressedSize,
+    uint16_t frameWidth,
+    uint16_t frameHeight,
+    RectCursor& cursor,
+    RectInfo* rects,
+    uint16_t maxRects,
+    uint16_t& rectCount
+) {
+    PROFILE_ZONE("rect_decodeNext");
+    const uint32_t fieldMask = (1 << RECT_FIELD_BITS) - 1;
+    rectCount = 0;
+    
+    while (rectCount < maxRects && !cursor.atEnd(compressedSize)) {
+        if (cursor.groupLeft == 0) {
+            if (cursor.inPos + RECT_GROUP_BYTES > compressedSize) return false;
+            
+            const uint8_t* group = compressed + cursor.inPos;
+            cursor.color = group[0] | (group[1] << 8);
+            cursor.groupLeft = group[2] + 1;
+            cursor.inPos += RECT_GROUP_BYTES;
+        }
+        if (cursor.inPos + RECT_BYTES > compressedSize) return false;
+        
+        const uint8_t* packed = compressed + cursor.inPos;
+        uint32_t low = packed[0] | (packed[1] << 8) | (packed[2] << 16) | ((uint32_t)packed[3] << 24);
+        uint64_t value = low | ((uint64_t)packed[4] << 32);
+        RectInfo& rect = rects[rectCount++];
+        rect.x = value & fieldMask;
+        rect.y = (value >> RECT_FIELD_BITS) & fieldMask;
+        rect.width = ((value >> (2 * RECT_FIELD_BITS)) & fieldMask) + 1;
+        rect.height = ((value >> (3 * RECT_FIELD_BITS)) & fieldMask) + 1;
+        rect.color = cursor.color;
+        if (rect.x + rect.width > frameWidth || rect.y + rect.height > frameHeight) return false;
+        
+        cursor.inPos += RECT_BYTES;
+        cursor.groupLeft--;
+    }
+    
+    return true;
+}
+
+bool RectDecoder::decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t frameWidth, uint16_t frameHeight,
+                         uint16_t* frame) {
+    PROFILE_ZONE("rect_decode");
+    RectCursor cursor;
+    RectInfo rects[16];
+    uint16_t count;
+    cursor.reset();
+    
+    while (!cursor.atEnd(compressedSize)) {
+        if (!decodeNext(compressed, compressedSize, frameWidth, frameHeight, cursor, rects, 16, count)) return false;
+        
+        for (uint16_t i = 0; i < count; i++) {
+            const RectInfo& rect = rects[i];
+            uint16_t* output = frame + (uint32_t)rect.y * frameWidth + rect.x;
+            
+            for (uint16_t row = 0; row < rect.height; row++) {
+                for (uint16_t x = 0; x < rect.width; x++) {
+                    output[x] = rect.color;
+                }
+                output += frameWidth;
+            }
+        }
+    }
+    
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef RECT_DECODER_H
+#define RECT_DECODER_H
+
+#include <Arduino.h>
+
+// Decoder position inside a rectangle frame: the read position and the colour
+// and rectangles left of the group being read.
+struct RectCursor {
+    uint32_t inPos;
+    uint16_t color;
+    uint16_t groupLeft;
+    
+    void reset() { inPos = 0; color = 0; groupLeft = 0; }
+    bool atEnd(uint32_t compressedSize) const { return groupLeft == 0 && inPos >= compressedSize; }
+};
+
+// One filled rectangle, in frame coordinates; the colour is RGB565.
+struct RectInfo {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint16_t color;
+};
+
+class RectDecoder {
+public:
+    // Decodes up to maxRects rectangles after the cursor into rects and
+    // advances it. Rectangles reaching outside the frame are errors.
+    static bool decodeNext(
+        const uint8_t* compressed,
+        uint32_t compressedSize,
+        uint16_t frameWidth,
+        uint16_t frameHeight,
+        RectCursor& cursor,
+        RectInfo* rects,
+        uint16_t maxRects,
+        uint16_t& rectCount
+    );
+    
+    // Paints a whole frame into a frame buffer holding the frame before it.
+    static bool decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t frameWidth, uint16_t frameHeight,
+                       uint16_t* frame);
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "RowDecoder.h"
+#include "VideoFormat.h"
+#include "Profiler.h"
+
+bool RowDecoder::decodeNext(
+    const uint8_t* compressed,
+    uint32_t compressedSize,
+    uint16_t width,
+    const uint16_t* dictionary,
+    uint16_t dictionaryRows,
+    RowCursor& cursor,
+    uint16_t* output,
+    uint32_t rows
+) {
+    PROFILE_ZONE("row_decodeNext");
+    for (uint32_t row = 0; row < rows; row++) {
+        uint32_t code;
+        if (!readVarint(compressed, compressedSize, cursor.inPos, code)) return false;
+        
+        if (code != ROW_LITERAL) {
+            if (code > dictionaryRows) return false;
+            memcpy(output, dictionary + (code - 1) * width, width * sizeof(uint16_t));
+            output += width;
+            continue;
+        }
+        
+        // A literal row's packets must end with the row; their pixels are
+        // swapped as they are written.
+        uint16_t x = 0;
+        while (x < width) {
+            if (cursor.inPos >= compressedSize) return false;
+            
+            uint8_t header = compressed[cursor.inPos++];
+            uint16_t end = x + (header & 0x7F) + 1;
+            uint32_t bytes = header & 0x80 ? 2 : 2 * (end - x);
+            if (end > width || cursor.inPos + bytes > compressedSize) return false;
+            
+            const uint8_t* in = compressed + cursor.inPos;
+            cursor.inPos += bytes;
+            if (header & 0x80) {
+                uint16_t value = (in[0] << 8) | in[1];
+                for (; x < end; x++) {
+                    output[x] = value;
+                }
+            } else {
+                for (; x < end; x++, in += 2) {
+                    output[x] = (in[0] << 8) | in[1];
+                }
+            }
+        }
+        output += width;
+    }
+    
+    return true;
+}
+
+bool RowDecoder::decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t width, uint16_t height,
+                        const uint16_t* dictionary, uint16_t dictionaryRows, uint16_t* frame) {
+    PROFILE_ZONE("row_decode");
+    RowCursor cursor;
+    cursor.reset();
+    return decodeNext(compressed, compressedSize, width, dictionary, dictionaryRows, cursor, frame, height);
+}
@@ -0,0 +1,34 @@
+#ifndef ROW_DECODER_H
+#define ROW_DECODER_H
+
+#include <Arduino.h>
+
+// Decoder position inside a row-dictionary frame.
+struct RowCursor {
+    uint32_t inPos;
+    
+    void reset() { inPos = 0; }
+};
+
+class RowDecoder {
+public:
+    // Decodes the next rows after the cursor into output and advances it.
+    // The dictionary holds dictionaryRows rows of width pixels already in the
+    // byte order sent to the display; references to it are copied and literal
+    // rows swapped as they are decoded, so output is in that order too.
+    static bool decodeNext(
+        const uint8_t* compressed,
+        uint32_t compressedSize,
+        uint16_t width,
+        const uint16_t* dictionary,
+        uint16_t dictionaryRows,
+        RowCursor& cursor,
+        uint16_t* output,
+        uint32_t rows
+    );
+    
+    static bool decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t width, uint16_t height,
+                       const uint16_t* dictionary, uint16_t dictionaryRows, uint16_t* frame);
+};
+
+#endif
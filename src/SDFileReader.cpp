@@ -1,6 +1,8 @@
 #include "SDFileReader.h"
+#include "Profiler.h"
+#include "MemoryPlanner.h"
 
-SDFileReader::SDFileReader(uint8_t csPin) : chipSelectPin(csPin), sdInitialized(false) {
+SDFileReader::SDFileReader(uint8_t csPin) : chipSelectPin(csPin), sdInitialized(false), timingTag(0) {
     pinMode(chipSelectPin, OUTPUT);
     digitalWrite(chipSelectPin, HIGH);
 }
@@ -36,67 +38,81 @@ void SDFileReader::end() {
         return;
     }
     
+    for (uint8_t slot = 0; slot < MAX_OPEN_FILES; slot++) {
+        closeFile(slot);
+    }
+    
     digitalWrite(chipSelectPin, HIGH);
     
     sdInitialized = false;
 }
 
-uint8_t* SDFileReader::readPartialFile(const char* filename, size_t& bytesRead, size_t bytesToRead, size_t offset) {
+bool SDFileReader::readPartialFile(const char* filename, uint8_t* buffer, size_t& bytesRead, size_t bytesToRead, size_t offset) {
+    PROFILE_ZONE("sd_readPartialFile");
     bytesRead = 0;
     
     if (!sdInitialized) {
-        return nullptr;
+        return false;
+    }
+    
+    if (!buffer) {
+        return false;
     }
     
-    FsFile file = sd.open(filename, O_RDONLY);
+    FsFile file;
+    {
+        SD_TIMED(SD_OP_OPEN);
+        file = sd.open(filename, O_RDONLY);
+    }
     if (!file) {
-        return nullptr;
+        return false;
     }
     
     size_t totalFileSize = file.fileSize();
     
     if (offset >= totalFileSize) {
         file.close();
-        return nullptr;
+        return false;
     }
     
     size_t actualBytesToRead = min(bytesToRead, totalFileSize - offset);
     
-    uint8_t* buffer = new uint8_t[actualBytesToRead];
-    if (!buffer) {
-        file.close();
-        return nullptr;
+    bool seeked;
+    {
+        SD_TIMED(SD_OP_SEEK);
+        seeked = file.seekSet(offset);
     }
-    
-    if (!file.seekSet(offset)) {
-        delete[] buffer;
+    if (!seeked) {
         file.close();
-        return nullptr;
+        return false;
     }
     
-    bytesRead = file.read(buffer, actualBytesToRead);
-    
-    if (bytesRead != actualBytesToRead) {
-        delete[] buffer;
-        file.close();
-        return nullptr;
+    MemoryPlanner::prepareDeviceWrite(buffer, actualBytesToRead);
+    {
+        SD_TIMED(SD_OP_READ);
+        bytesRead = file.read(buffer, actualBytesToRead);
+        SD_TIMED_BYTES(bytesRead);
     }
-    
     file.close();
     
-    return buffer;
+    return bytesRead == actualBytesToRead;
 }
 
-bool SDFileReader::openFile(const char* filename) {
-    if (!sdInitialized) {
+bool SDFileReader::openFile(const char* filename, uint8_t slot) {
+    if (!sdInitialized || slot >= MAX_OPEN_FILES) {
         return false;
     }
     
+    FsFile& currentFile = openFiles[slot];
+    
     if (currentFile) {
         currentFile.close();
     }
     
-    currentFile = sd.open(filename, O_RDONLY);
+    {
+        SD_TIMED(SD_OP_OPEN);
+        currentFile = sd.open(filename, O_RDONLY);
+    }
     
     if (!currentFile) {
         return false;
@@ -105,61 +121,119 @@ bool SDFileReader::openFile(const char* filename) {
     return true;
 }
 
-void SDFileReader::closeFile() {
-    if (currentFile) {
-        currentFile.close();
+void SDFileReader::closeFile(uint8_t slot) {
+    if (slot < MAX_OPEN_FILES && openFiles[slot]) {
+        openFiles[slot].close();
     }
 }
 
-uint8_t* SDFileReader::readSequential(size_t& bytesRead, size_t bytesToRead, size_t offset) {
+bool SDFileReader::isFileOpen(uint8_t slot) {
+    return slot < MAX_OPEN_FILES && openFiles[slot];
+}
+
+bool SDFileReader::readSequentialInto(uint8_t* buffer, size_t& bytesRead, size_t bytesToRead, size_t offset, uint8_t slot) {
+    PROFILE_ZONE("sd_readSequentialInto");
     bytesRead = 0;
     
-    if (!currentFile) {
-        return nullptr;
+    if (!isFileOpen(slot)) {
+        return false;
     }
     
-    uint8_t* buffer = new uint8_t[bytesToRead];
+    FsFile& currentFile = openFiles[slot];
+    
     if (!buffer) {
-        return nullptr;
+        return false;
     }
     
-    if (!currentFile.seekSet(offset)) {
-        delete[] buffer;
-        return nullptr;
+    bool seeked;
+    {
+        SD_TIMED(SD_OP_SEEK);
+        seeked = currentFile.seekSet(offset);
+    }
+    if (!seeked) {
+        return false;
     }
     
-    bytesRead = currentFile.read(buffer, bytesToRead);
+    MemoryPlanner::prepareDeviceWrite(buffer, bytesToRead);
+    {
+        SD_TIMED(SD_OP_READ);
+        bytesRead = currentFile.read(buffer, bytesToRead);
+        SD_TIMED_BYTES(bytesRead);
+    }
     
     if (bytesRead != bytesToRead) {
-        delete[] buffer;
-        return nullptr;
+        return false;
     }
     
-    return buffer;
+    return true;
 }
-bool SDFileReader::readSequentialInto(uint8_t* buffer, size_t& bytesRead, size_t bytesToRead, size_t offset) {
-    bytesRead = 0;
-    
-    if (!currentFile) {
+
+// Reads every whole sector covering [offset, offset + bytesToRead) so SdFat can
+// transfer straight into the caller's buffer instead of staging through its
+// sector cache. The requested bytes start at buffer + dataStart.
+bool SDFileReader::readSectorsInto(uint8_t* buffer, size_t& dataStart, size_t bytesToRead, size_t offset, uint8_t slot) {
+    PROFILE_ZONE("sd_readSectorsInto");
+    dataStart = 0;
+    
+    if (!isFileOpen(slot)) {
         return false;
     }
     
+    FsFile& currentFile = openFiles[slot];
+    
     if (!buffer) {
         return false;
     }
     
-    if (!currentFile.seekSet(offset)) {
+    size_t firstByte = offset & ~(SECTOR_SIZE - 1);
+    size_t endByte = firstByte + sectorSpan(bytesToRead, offset);
+    size_t fileSize = currentFile.fileSize();
+    
+    if (endByte > fileSize) {
+        endByte = fileSize;
+    }
+    
+    if (offset + bytesToRead > endByte) {
         return false;
     }
     
-    bytesRead = currentFile.read(buffer, bytesToRead);
+    if (currentFile.curPosition() != firstByte) {
+        bool seeked;
+        {
+            SD_TIMED(SD_OP_SEEK);
+            seeked = currentFile.seekSet(firstByte);
+        }
+        if (!seeked) {
+            return false;
+        }
+    }
     
-    if (bytesRead != bytesToRead) {
+    size_t spanBytes = endByte - firstByte;
+    size_t bytesRead;
+    MemoryPlanner::prepareDeviceWrite(buffer, spanBytes);
+    {
+        SD_TIMED(SD_OP_SECTOR_READ);
+        bytesRead = currentFile.read(buffer, spanBytes);
+        SD_TIMED_BYTES(bytesRead);
+    }
+    if (bytesRead != spanBytes) {
         return false;
     }
     
+    dataStart = offset - firstByte;
     return true;
 }
 
+size_t SDFileReader::sectorSpan(size_t bytesToRead, size_t offset) {
+    size_t firstByte = offset & ~(SECTOR_SIZE - 1);
+    size_t endByte = (offset + bytesToRead + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+    return endByte - firstByte;
+}
+
+void SDFileReader::resetTimingStats() {
+    timingStats.reset();
+}
+
 void SDFileReader::printTimingSummary() {
+    timingStats.print();
 }
\ No newline at end of file
@@ -3,15 +3,22 @@
 
 #include <Arduino.h>
 #include <SdFat.h>
+#include "SDTimingStats.h"
 
 class SDFileReader {
 public:
+    static const size_t SECTOR_SIZE = 512;
+    static const uint8_t MAX_OPEN_FILES = 2;
+    
     SdFs sd;
     
 private:
     uint8_t chipSelectPin;
     bool sdInitialized;
-    FsFile currentFile;
+    FsFile openFiles[MAX_OPEN_FILES];
+    
+    SDTimingStats timingStats;
+    uint32_t timingTag;
     
 public:
     SDFileReader(uint8_t csPin);
@@ -21,13 +28,21 @@ public:
     
     void end();
     
-    uint8_t* readPartialFile(const char* filename, size_t& bytesRead, size_t bytesToRead, size_t offset = 0);
+    bool readPartialFile(const char* filename, uint8_t* buffer, size_t& bytesRead, size_t bytesToRead, size_t offset = 0);
+    
+    // Up to MAX_OPEN_FILES files can be open at once, one per slot, so the
+    // next video can be opened and validated while the current one plays.
+    bool openFile(const char* filename, uint8_t slot = 0);
+    void closeFile(uint8_t slot = 0);
+    bool isFileOpen(uint8_t slot = 0);
+    bool readSequentialInto(uint8_t* buffer, size_t& bytesRead, size_t bytesToRead, size_t offset, uint8_t slot = 0);
+    bool readSectorsInto(uint8_t* buffer, size_t& dataStart, size_t bytesToRead, size_t offset, uint8_t slot = 0);
     
-    bool openFile(const char* filename);
-    void closeFile();
-    uint8_t* readSequential(size_t& bytesRead, size_t bytesToRead, size_t offset);
-    bool readSequentialInto(uint8_t* buffer, size_t& bytesRead, size_t bytesToRead, size_t offset);
+    static size_t sectorSpan(size_t bytesToRead, size_t offset);
     
+    void setTimingTag(uint32_t tag) { timingTag = tag; }
+    const SDTimingStats& getTimingStats() const { return timingStats; }
+    void resetTimingStats();
     void printTimingSummary();
 };
 
@@ -0,0 +1,120 @@
+#include "SDTimingStats.h"
+#include "StatsFormat.h"
+
+static const char* const OP_NAMES[SD_OP_COUNT] = { "open", "seek", "read", "sector_read" };
+
+SDTimingStats::SDTimingStats() {
+    reset();
+}
+
+void SDTimingStats::reset() {
+    memset(ops, 0, sizeof(ops));
+    for (uint8_t i = 0; i < SD_OP_COUNT; i++) {
+        ops[i].minMicros = UINT32_MAX;
+    }
+    stallCount = 0;
+    windowStartMillis = millis();
+}
+
+const char* SDTimingStats::opName(uint8_t op) {
+    return op < SD_OP_COUNT ? OP_NAMES[op] : "unknown";
+}
+
+void SDTimingStats::record(SDOperation op, uint32_t ticks, uint32_t bytes, uint32_t tag) {
+    SDOperationStats& stats = ops[op];
+    uint32_t micros = CycleCounter::toMicros(ticks);
+    
+    stats.count++;
+    stats.bytes += bytes;
+    stats.totalMicros += micros;
+    
+    if (micros < stats.minMicros) {
+        stats.minMicros = micros;
+    }
+    if (micros > stats.maxMicros) {
+        stats.maxMicros = micros;
+        stats.maxTag = tag;
+    }
+    
+    uint8_t bucket = micros ? 31 - __builtin_clz(micros) : 0;
+    if (bucket >= SDOperationStats::HISTOGRAM_BUCKETS) {
+        bucket = SDOperationStats::HISTOGRAM_BUCKETS - 1;
+    }
+    stats.histogram[bucket]++;
+    
+    if (stallCount < MAX_STALLS || micros > stalls[stallCount - 1].micros) {
+        recordStall(op, micros, tag);
+    }
+}
+
+// Keeps the MAX_STALLS slowest operations, slowest first.
+void SDTimingStats::recordStall(SDOperation op, uint32_t micros, uint32_t tag) {
+    uint8_t pos = stallCount < MAX_STALLS ? stallCount++ : MAX_STALLS - 1;
+    
+    while (pos > 0 && stalls[pos - 1].micros < micros) {
+        stalls[pos] = stalls[pos - 1];
+        pos--;
+    }
+    
+    stalls[pos].op = op;
+    stalls[pos].micros = micros;
+    stalls[pos].tag = tag;
+}
+
+static uint32_t kilobytesPerSecond(uint64_t bytes, uint64_t micros) {
+    return micros ? (uint32_t)(bytes * 1000 / micros) : 0;
+}
+
+// One CSV record per line so the dump can be grepped out of a mixed Serial log.
+void SDTimingStats::print() const {
+    char bytesText[21];
+    char totalText[21];
+    uint32_t windowMillis = millis() - windowStartMillis;
+    
+    Serial.printf("sdtiming,begin,%lu\n", (unsigned long)windowMillis);
+    Serial.printf("# sdop,op,count,bytes,total_us,min_us,max_us,max_frame,kb_per_s,hist_log2_us[0..%u]\n",
+                  SDOperationStats::HISTOGRAM_BUCKETS - 1);
+    
+    uint64_t transferBytes = 0;
+    uint64_t busyMicros = 0;
+    
+    for (uint8_t i = 0; i < SD_OP_COUNT; i++) {
+        const SDOperationStats& stats = ops[i];
+        
+        Serial.printf("sdop,%s,%lu,%s,%s,%lu,%lu,%lu,%lu", 
+                      opName(i), 
+                      (unsigned long)stats.count,
+                      formatU64(bytesText, stats.bytes),
+                      formatU64(totalText, stats.totalMicros),
+                      (unsigned long)(stats.count ? stats.minMicros : 0),
+                      (unsigned long)stats.maxMicros,
+                      (unsigned long)stats.maxTag,
+                      (unsigned long)kilobytesPerSecond(stats.bytes, stats.totalMicros));
+        
+        for (uint8_t b = 0; b < SDOperationStats::HISTOGRAM_BUCKETS; b++) {
+            Serial.printf(",%lu", (unsigned long)stats.histogram[b]);
+        }
+        Serial.printf("\n");
+        
+        transferBytes += stats.bytes;
+        busyMicros += stats.totalMicros;
+    }
+    
+    Serial.printf("# sdthroughput,bytes,busy_us,busy_kb_per_s,wall_kb_per_s\n");
+    Serial.printf("sdthroughput,%s,%s,%lu,%lu\n",
+                  formatU64(bytesText, transferBytes),
+                  formatU64(totalText, busyMicros),
+                  (unsigned long)kilobytesPerSecond(transferBytes, busyMicros),
+                  (unsigned long)kilobytesPerSecond(transferBytes, (uint64_t)windowMillis * 1000));
+    
+    Serial.printf("# sdstall,rank,op,us,frame\n");
+    for (uint8_t i = 0; i < stallCount; i++) {
+        Serial.printf("sdstall,%u,%s,%lu,%lu\n", 
+                      i + 1, 
+                      opName(stalls[i].op), 
+                      (unsigned long)stalls[i].micros, 
+                      (unsigned long)stalls[i].tag);
+    }
+    
+    Serial.printf("sdtiming,end\n");
+}
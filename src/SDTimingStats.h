@@ -0,0 +1,91 @@
+#ifndef SD_TIMING_STATS_H
+#define SD_TIMING_STATS_H
+
+#include <Arduino.h>
+#include "CycleCounter.h"
+
+// Build with -DSD_TIMING=0 to compile all SD instrumentation out.
+#ifndef SD_TIMING
+#define SD_TIMING 1
+#endif
+
+enum SDOperation : uint8_t {
+    SD_OP_OPEN = 0,
+    SD_OP_SEEK,
+    SD_OP_READ,
+    SD_OP_SECTOR_READ,
+    SD_OP_COUNT
+};
+
+struct SDOperationStats {
+    static const uint8_t HISTOGRAM_BUCKETS = 16;
+    
+    uint32_t count;
+    uint64_t bytes;
+    uint64_t totalMicros;
+    uint32_t minMicros;
+    uint32_t maxMicros;
+    uint32_t maxTag;
+    // Bucket i counts operations taking [2^i, 2^(i+1)) us; bucket 0 also holds 0 us
+    // and the last bucket everything slower.
+    uint32_t histogram[HISTOGRAM_BUCKETS];
+};
+
+struct SDStall {
+    uint8_t op;
+    uint32_t micros;
+    uint32_t tag;
+};
+
+class SDTimingStats {
+public:
+    static const uint8_t MAX_STALLS = 8;
+    
+    SDTimingStats();
+    
+    void reset();
+    void record(SDOperation op, uint32_t ticks, uint32_t bytes, uint32_t tag);
+    void print() const;
+    
+    const SDOperationStats& get(SDOperation op) const { return ops[op]; }
+    
+    static const char* opName(uint8_t op);
+    
+private:
+    SDOperationStats ops[SD_OP_COUNT];
+    SDStall stalls[MAX_STALLS];
+    uint8_t stallCount;
+    uint32_t windowStartMillis;
+    
+    void recordStall(SDOperation op, uint32_t micros, uint32_t tag);
+};
+
+#if SD_TIMING
+
+class SDTimingScope {
+public:
+    SDTimingScope(SDTimingStats& timingStats, SDOperation operation, uint32_t timingTag)
+        : stats(timingStats), op(operation), tag(timingTag), bytes(0), start(CycleCounter::now()) {}
+    ~SDTimingScope() { stats.record(op, CycleCounter::now() - start, bytes, tag); }
+    
+    void setBytes(uint32_t count) { bytes = count; }
+    
+private:
+    SDTimingStats& stats;
+    SDOperation op;
+    uint32_t tag;
+    uint32_t bytes;
+    uint32_t start;
+};
+
+#define SD_TIMED(op) SDTimingScope sdTimingScope(timingStats, (op), timingTag)
+#define SD_TIMED_BYTES(count) sdTimingScope.setBytes(count)
+
+#else
+
+#define SD_TIMED(op) do {} while (0)
+#define SD_TIMED_BYTES(count) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#include "SDVideoSource.h"
+
+SDVideoSource::SDVideoSource(SDFileReader* reader, uint8_t fileSlot, const char* filePath)
+    : sdReader(reader), path(filePath), slot(fileSlot), sectorAligned(false) {
+}
+
+bool SDVideoSource::open() {
+    sectorAligned = false;
+    return path && sdReader->openFile(path, slot);
+}
+
+void SDVideoSource::close() {
+    sdReader->closeFile(slot);
+}
+
+bool SDVideoSource::read(uint8_t* buffer, size_t bytesToRead, size_t offset) {
+    size_t bytesRead;
+    return sdReader->readSequentialInto(buffer, bytesRead, bytesToRead, offset, slot);
+}
+
+void SDVideoSource::setLayoutFlags(uint8_t flags) {
+    sectorAligned = (flags & VID_FLAG_SECTOR_ALIGNED) != 0;
+}
+
+const uint8_t* SDVideoSource::getFrame(const FrameIndexEntry& entry, uint8_t* scratch, size_t scratchSize) {
+    if (sectorAligned) {
+        if (SDFileReader::sectorSpan(entry.size, entry.offset) > scratchSize) {
+            return nullptr;
+        }
+        
+        size_t dataStart;
+        if (!sdReader->readSectorsInto(scratch, dataStart, entry.size, entry.offset, slot)) {
+            return nullptr;
+        }
+        return scratch + dataStart;
+    }
+    
+    if (entry.size > scratchSize) {
+        return nullptr;
+    }
+    
+    size_t bytesRead;
+    if (!sdReader->readSequentialInto(scratch, bytesRead, entry.size, entry.offset, slot)) {
+        return nullptr;
+    }
+    return scratch;
+}
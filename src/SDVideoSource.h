@@ -0,0 +1,31 @@
+#ifndef SD_VIDEO_SOURCE_H
+#define SD_VIDEO_SOURCE_H
+
+#include <Arduino.h>
+#include "VideoSource.h"
+#include "SDFileReader.h"
+
+// A .vid file on the SD card, read through one SDFileReader file slot.
+class SDVideoSource : public VideoSource {
+private:
+    SDFileReader* sdReader;
+    const char* path;
+    uint8_t slot;
+    bool sectorAligned;
+    
+public:
+    SDVideoSource(SDFileReader* reader, uint8_t fileSlot = 0, const char* filePath = nullptr);
+    
+    void setPath(const char* filePath) { path = filePath; }
+    const char* getPath() const { return path; }
+    
+    bool open() override;
+    void close() override;
+    bool read(uint8_t* buffer, size_t bytesToRead, size_t offset) override;
+    const uint8_t* getFrame(const FrameIndexEntry& entry, uint8_t* scratch, size_t scratchSize) override;
+    size_t getReadSlack() const override { return 2 * SDFileReader::SECTOR_SIZE; }
+    void setLayoutFlags(uint8_t flags) override;
+    void setTimingTag(uint32_t tag) override { sdReader->setTimingTag(tag); }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "SpanDecoder.h"
+#include "VideoFormat.h"
+#include "Profiler.h"
+
+bool SpanDecoder::decodeNext(
+    const uint8_t* compressed,
+    uint32_t compressedSize,
+    uint16_t width,
+    SpanCursor& cursor,
+    uint16_t* output,
+    uint32_t rows
+) {
+    PROFILE_ZONE("span_decodeNext");
+    if (width > MAX_WIDTH) return false;
+    
+    if (cursor.inPos == 0) {
+        if (compressedSize < 4) return false;
+        cursor.colors[0] = __builtin_bswap16(compressed[0] | (compressed[1] << 8));
+        cursor.colors[1] = __builtin_bswap16(compressed[2] | (compressed[3] << 8));
+        cursor.inPos = 4;
+    }
+    
+    for (uint32_t row = 0; row < rows; row++) {
+        bool same;
+        if (!readPositions(compressed, compressedSize, width, cursor, same)) return false;
+        
+        // A repeated row inside this batch is a copy of the one just written.
+        if (same && row > 0) {
+            memcpy(output, output - width, width * sizeof(uint16_t));
+            output += width;
+            continue;
+        }
+        
+        uint16_t x = 0;
+        for (uint16_t i = 0; i <= cursor.count; i++) {
+            uint16_t end = i < cursor.count ? cursor.positions[i] : width;
+            uint16_t color = cursor.colors[i & 1];
+            
+            for (; x < end; x++) {
+                output[x] = color;
+            }
+        }
+        output += width;
+    }
+    
+    return true;
+}
+
+bool SpanDecoder::decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t width, uint16_t height,
+                         uint16_t* frame) {
+    PROFILE_ZONE("span_decode");
+    SpanCursor cursor;
+    cursor.reset();
+    return decodeNext(compressed, compressedSize, width, cursor, frame, height);
+}
+
+// Reads one row's code and leaves its colour flips in the cursor, checking
+// they rise strictly and stay inside the row.
+bool SpanDecoder::readPositions(const uint8_t* compressed, uint32_t compressedSize, uint16_t width, SpanCursor& cursor,
+                                bool& same) {
+    uint32_t code;
+    if (!readVarint(compressed, compressedSize, cursor.inPos, code)) return false;
+    same = code == SPAN_ROW_SAME;
+    if (same) return true;
+    
+    bool predicted = code == SPAN_ROW_PREDICTED;
+    uint32_t count = predicted ? cursor.count : code - SPAN_ROW_LITERAL;
+    if (count > width) return false;
+    
+    int32_t last = -1;
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t value;
+        if (!readVarint(compressed, compressedSize, cursor.inPos, value) || value > 2u * width) return false;
+        
+        int32_t x = predicted ? cursor.positions[i] + (int32_t)((value >> 1) ^ -(value & 1))
+                              : last + 1 + (int32_t)value;
+        if (x <= last || x >= width) return false;
+        cursor.positions[i] = x;
+        last = x;
+    }
+    cursor.count = count;
+    return true;
+}
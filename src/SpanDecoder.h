@@ -0,0 +1,45 @@
+#ifndef SPAN_DECODER_H
+#define SPAN_DECODER_H
+
+#include <Arduino.h>
+
+struct SpanCursor;
+
+class SpanDecoder {
+public:
+    // A row can flip colour at every pixel of the widest frame the display
+    // shows.
+    static const uint16_t MAX_WIDTH = 320;
+    
+    // Decodes the next rows after the cursor into output and advances it.
+    // Pixels are written in the byte order sent to the display, so no
+    // separate swap pass is needed.
+    static bool decodeNext(
+        const uint8_t* compressed,
+        uint32_t compressedSize,
+        uint16_t width,
+        SpanCursor& cursor,
+        uint16_t* output,
+        uint32_t rows
+    );
+    
+    static bool decode(const uint8_t* compressed, uint32_t compressedSize, uint16_t width, uint16_t height,
+                       uint16_t* frame);
+    
+private:
+    static bool readPositions(const uint8_t* compressed, uint32_t compressedSize, uint16_t width, SpanCursor& cursor,
+                              bool& same);
+};
+
+// Decoder position inside a span frame, with the previous row's colour flips
+// that the next row is predicted from.
+struct SpanCursor {
+    uint32_t inPos;
+    uint16_t colors[2];
+    uint16_t count;
+    uint16_t positions[SpanDecoder::MAX_WIDTH];
+    
+    void reset() { inPos = 0; count = 0; }
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef STATS_FORMAT_H
+#define STATS_FORMAT_H
+
+#include <Arduino.h>
+
+// Decimal text of a 64-bit counter for the CSV stats dumps, which the
+// newlib-nano printf cannot format. buffer must hold 21 characters; the
+// result points into it.
+static inline const char* formatU64(char* buffer, uint64_t value) {
+    char* p = buffer + 20;
+    *p = '\0';
+    do {
+        *--p = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    return p;
+}
+
+#endif
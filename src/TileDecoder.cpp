@@ -0,0 +1,145 @@
+#include "TileDecoder.h"
+#include "RLEDecoder.h"
+#include "VideoFormat.h"
+#include "Profiler.h"
+
+void TileLayout::set(uint16_t width, uint16_t height, uint8_t shape) {
+    frameWidth = width;
+    frameHeight = height;
+    tileWidth = 1 << (shape & 0x0F);
+    tileHeight = 1 << (shape >> 4);
+    columns = (width + tileWidth - 1) / tileWidth;
+    rows = (height + tileHeight - 1) / tileHeight;
+}
+
+bool TileDecoder::isValidShape(uint8_t shape, uint16_t frameWidth) {
+    uint8_t widthShift = shape & 0x0F;
+    uint8_t heightShift = shape >> 4;
+    
+    return widthShift >= MIN_TILE_SHIFT && widthShift <= MAX_TILE_SHIFT &&
+           heightShift >= MIN_TILE_SHIFT && heightShift <= MAX_TILE_SHIFT &&
+           ((frameWidth + (1 << widthShift) - 1) >> widthShift) <= MAX_COLUMNS;
+}
+
+bool TileDecoder::decodeRow(
+    const uint8_t* compressed,
+    uint32_t compressedSize,
+    const TileLayout& layout,
+    TileCursor& cursor,
+    TileInfo* tiles,
+    uint16_t* output,
+    uint32_t maxPixels,
+    uint32_t& packedPixels
+) {
+    PROFILE_ZONE("tile_decodeRow");
+    packedPixels = 0;
+    
+    if (cursor.tile == 0) {
+        cursor.inPos = layout.mapBytes();
+        if (cursor.inPos > compressedSize) return false;
+    }
+    
+    uint32_t top = (cursor.tile / layout.columns) * layout.tileHeight;
+    if (top >= layout.frameHeight) return false;
+    uint16_t height = min((uint32_t)layout.tileHeight, layout.frameHeight - top);
+    
+    for (uint16_t column = 0; column < layout.columns; column++) {
+        uint32_t left = (uint32_t)column * layout.tileWidth;
+        uint16_t width = min((uint32_t)layout.tileWidth, layout.frameWidth - left);
+        TileInfo& tile = tiles[column];
+        tile.mode = tileMode(compressed, cursor.tile++);
+        
+        if (tile.mode == TILE_SOLID) {
+            if (!readColor(compressed, compressedSize, cursor.inPos, tile.color)) return false;
+        } else if (tile.mode != TILE_UNCHANGED) {
+            uint32_t pixels = (uint32_t)width * height;
+            if (packedPixels + pixels > maxPixels) return false;
+            
+            if (!decodeTile(compressed, compressedSize, cursor.inPos, tile.mode, width, height,
+                            output + packedPixels, width)) {
+                return false;
+            }
+            packedPixels += pixels;
+        }
+    }
+    
+    return true;
+}
+
+bool TileDecoder::decode(const uint8_t* compressed, uint32_t compressedSize, const TileLayout& layout, uint16_t* frame) {
+    PROFILE_ZONE("tile_decode");
+    uint32_t inPos = layout.mapBytes();
+    if (inPos > compressedSize) return false;
+    
+    uint32_t tile = 0;
+    for (uint32_t top = 0; top < layout.frameHeight; top += layout.tileHeight) {
+        uint16_t height = min((uint32_t)layout.tileHeight, layout.frameHeight - top);
+        
+        for (uint32_t left = 0; left < layout.frameWidth; left += layout.tileWidth) {
+            uint16_t width = min((uint32_t)layout.tileWidth, layout.frameWidth - left);
+            uint16_t* output = frame + top * layout.frameWidth + left;
+            uint8_t mode = tileMode(compressed, tile++);
+            
+            if (mode == TILE_SOLID) {
+                uint16_t color;
+                if (!readColor(compressed, compressedSize, inPos, color)) return false;
+                
+                for (uint16_t row = 0; row < height; row++) {
+                    for (uint16_t x = 0; x < width; x++) {
+                        output[row * layout.frameWidth + x] = color;
+                    }
+                }
+            } else if (mode != TILE_UNCHANGED &&
+                       !decodeTile(compressed, compressedSize, inPos, mode, width, height, output, layout.frameWidth)) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+bool TileDecoder::readColor(const uint8_t* compressed, uint32_t compressedSize, uint32_t& inPos, uint16_t& color) {
+    if (inPos + 1 >= compressedSize) return false;
+    
+    color = compressed[inPos] | (compressed[inPos + 1] << 8);
+    inPos += 2;
+    return true;
+}
+
+// RLE and raw tiles are stored row-major at the tile's width; the RLE packets
+// of a tile end with it. Rows go to output at the given stride.
+bool TileDecoder::decodeTile(
+    const uint8_t* compressed,
+    uint32_t compressedSize,
+    uint32_t& inPos,
+    uint8_t mode,
+    uint16_t width,
+    uint16_t height,
+    uint16_t* output,
+    uint32_t stride
+) {
+    if (mode == TILE_RAW) {
+        uint32_t rowBytes = width * sizeof(uint16_t);
+        if (inPos + rowBytes * height > compressedSize) return false;
+        
+        // Stored little-endian, as the pixels are in memory on the targets.
+        for (uint16_t row = 0; row < height; row++) {
+            memcpy(output + row * stride, compressed + inPos, rowBytes);
+            inPos += rowBytes;
+        }
+        return true;
+    }
+    
+    RLECursor cursor;
+    cursor.reset();
+    for (uint16_t row = 0; row < height; row++) {
+        if (RLEDecoder::decodeNext(compressed + inPos, compressedSize - inPos, cursor, output + row * stride, width) != width) {
+            return false;
+        }
+    }
+    if (cursor.remaining) return false;
+    
+    inPos += cursor.inPos;
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef TILE_DECODER_H
+#define TILE_DECODER_H
+
+#include <Arduino.h>
+
+// Tile grid of a compression 2 file. Tiles are numbered in raster order; the
+// ones on the right and bottom edges are clipped to the frame.
+struct TileLayout {
+    uint16_t frameWidth;
+    uint16_t frameHeight;
+    uint16_t tileWidth;
+    uint16_t tileHeight;
+    uint16_t columns;
+    uint16_t rows;
+    
+    void set(uint16_t width, uint16_t height, uint8_t shape);
+    uint32_t mapBytes() const { return ((uint32_t)columns * rows + 3) / 4; }
+};
+
+// Decoder position inside a tiled frame, so consecutive rows of tiles are
+// decoded without rescanning the frame from the start.
+struct TileCursor {
+    uint32_t tile;
+    uint32_t inPos;
+    
+    void reset() { tile = 0; inPos = 0; }
+};
+
+// One tile of a decoded row. Solid tiles only keep their colour; the pixels of
+// RLE and raw tiles are packed into the output one tile after the other.
+struct TileInfo {
+    uint8_t mode;
+    uint16_t color;
+};
+
+class TileDecoder {
+public:
+    // Tiles are 8 to 64 pixels on a side, so a 320-pixel row has at most 40.
+    static const uint8_t MIN_TILE_SHIFT = 3;
+    static const uint8_t MAX_TILE_SHIFT = 6;
+    static const uint16_t MAX_COLUMNS = 40;
+    
+    static bool isValidShape(uint8_t shape, uint16_t frameWidth);
+    static uint8_t tileMode(const uint8_t* compressed, uint32_t tile) {
+        return (compressed[tile / 4] >> (2 * (tile % 4))) & 0x03;
+    }
+    
+    // Decodes the row of tiles after the cursor into tiles[] (one per column)
+    // and output, each RLE or raw tile row-major at its own width, and
+    // advances the cursor. packedPixels is the number written to output.
+    static bool decodeRow(
+        const uint8_t* compressed,
+        uint32_t compressedSize,
+        const TileLayout& layout,
+        TileCursor& cursor,
+        TileInfo* tiles,
+        uint16_t* output,
+        uint32_t maxPixels,
+        uint32_t& packedPixels
+    );
+    
+    // Decodes a whole frame into a frame buffer holding the frame before it;
+    // unchanged tiles are left as they are.
+    static bool decode(const uint8_t* compressed, uint32_t compressedSize, const TileLayout& layout, uint16_t* frame);
+    
+private:
+    static bool readColor(const uint8_t* compressed, uint32_t compressedSize, uint32_t& inPos, uint16_t& color);
+    static bool decodeTile(
+        const uint8_t* compressed,
+        uint32_t compressedSize,
+        uint32_t& inPos,
+        uint8_t mode,
+        uint16_t width,
+        uint16_t height,
+        uint16_t* output,
+        uint32_t stride
+    );
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef VIDEO_FORMAT_H
+#define VIDEO_FORMAT_H
+
+#include <Arduino.h>
+
+#define VID_FLAG_SECTOR_ALIGNED 0x01
+#define VID_FLAG_NTSC_RATE      0x02
+#define VID_FLAG_AUDIO          0x04
+#define VID_FLAG_MAX_FRAME_SIZE 0x08
+#define VID_FLAG_REPEATS        0x10
+#define VID_FLAG_ROW_DICTIONARY 0x20
+
+// Set in a FrameIndexEntry's size (VID_FLAG_REPEATS only) when the frame shows
+// the same picture as the frame before it. Its data is then only its audio
+// chunk, or nothing in files without audio.
+#define VID_INDEX_REPEAT 0x80000000u
+
+// Set in a FrameIndexEntry's size (compression 2 and 3, or frames of 7 stored
+// as either) when the frame leaves part of the picture as it was, so it only
+// draws correctly over the frame before it.
+#define VID_INDEX_DELTA 0x40000000u
+#define VID_INDEX_FLAGS (VID_INDEX_REPEAT | VID_INDEX_DELTA)
+
+#define VID_COMPRESSION_RLE   1
+#define VID_COMPRESSION_TILES 2
+#define VID_COMPRESSION_RECTS 3
+#define VID_COMPRESSION_SPANS 4
+#define VID_COMPRESSION_ROWS  5
+#define VID_COMPRESSION_RAW   6   // the pixels themselves, little-endian RGB565
+
+// Compression 7 picks the compression of each frame: its data, after any
+// audio chunk, starts with a byte holding one of the types above.
+#define VID_COMPRESSION_PER_FRAME 7
+#define VID_COMPRESSION_TYPES     7
+
+// Tile modes of compression 2, two bits per tile in each frame's mode map.
+#define TILE_UNCHANGED 0
+#define TILE_SOLID     1
+#define TILE_RLE       2
+#define TILE_RAW       3
+
+// Compression 3 frames are groups of filled rectangles: a 2-byte colour, a
+// byte holding the group's rectangle count less one, then per rectangle 5
+// bytes, a little-endian 40-bit value of x, y, width - 1 and height - 1 at 9
+// bits each.
+#define RECT_GROUP_BYTES 3
+#define RECT_BYTES       5
+#define RECT_FIELD_BITS  9
+
+// Compression 4 frames are two-colour: the two RGB565 colours, then per row
+// a varint code and the x positions where the colour flips, starting from the
+// first colour. Codes: SPAN_ROW_SAME repeats the previous row's positions,
+// SPAN_ROW_PREDICTED gives as many zigzag varint offsets from them, and
+// SPAN_ROW_LITERAL + n gives n positions as varints: the first x, then each
+// gap less one.
+#define SPAN_ROW_SAME      0
+#define SPAN_ROW_PREDICTED 1
+#define SPAN_ROW_LITERAL   2
+
+// Compression 5 frames code each row as a varint: ROW_LITERAL followed by RLE
+// packets ending exactly at the row's end, or n + 1 for row n of the file's
+// row dictionary.
+#define ROW_LITERAL 0
+
+#define AUDIO_CODEC_PCM16     1
+#define AUDIO_CODEC_IMA_ADPCM 2
+
+#pragma pack(push, 1)
+struct VideoHeader {
+    char magic[4];
+    uint32_t frameCount;
+    uint16_t frameWidth;
+    uint16_t frameHeight;
+    uint8_t fps;
+    uint8_t compression;
+    uint8_t flags;
+    uint8_t tileShape;          // compression 2 and 7: log2 of the tile width (low nibble) and height (high nibble)
+    uint32_t indexOffset;
+    uint32_t maxFrameSize;      // largest index entry size; VID_FLAG_MAX_FRAME_SIZE only
+};
+
+// Files without VID_FLAG_MAX_FRAME_SIZE end the header before maxFrameSize,
+// and their audio header starts there.
+inline uint32_t videoHeaderSize(uint8_t flags) {
+    return (flags & VID_FLAG_MAX_FRAME_SIZE) ? sizeof(VideoHeader) : sizeof(VideoHeader) - sizeof(uint32_t);
+}
+
+// Little-endian base-128 varints, as used by span and row-dictionary frames.
+inline bool readVarint(const uint8_t* data, uint32_t size, uint32_t& pos, uint32_t& value) {
+    value = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 7) {
+        if (pos >= size) return false;
+        
+        uint8_t byte = data[pos++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint16_t tileWidth(const VideoHeader& hdr) { return 1 << (hdr.tileShape & 0x0F); }
+inline uint16_t tileHeight(const VideoHeader& hdr) { return 1 << (hdr.tileShape >> 4); }
+
+// Follows the video header when VID_FLAG_AUDIO is set.
+struct AudioHeader {
+    char magic[4];
+    uint32_t sampleRate;
+    uint32_t sampleCount;
+    uint8_t codec;
+    uint8_t channels;
+    uint8_t leadFrames;
+    uint8_t reserved;
+    uint16_t maxChunkBytes;
+    uint16_t reserved2;
+};
+
+// Follows the audio header, or the video header in files without audio, when
+// VID_FLAG_ROW_DICTIONARY is set; rowCount rows of little-endian RGB565
+// pixels, frameWidth each, follow it.
+struct RowDictionaryHeader {
+    char magic[4];
+    uint16_t rowCount;
+    uint16_t reserved;
+};
+
+inline uint32_t rowDictionaryOffset(uint8_t flags) {
+    return videoHeaderSize(flags) + ((flags & VID_FLAG_AUDIO) ? sizeof(AudioHeader) : 0);
+}
+
+// Starts every frame's data when VID_FLAG_AUDIO is set; the audio payload and
+// then the compressed frame follow.
+struct AudioChunkHeader {
+    uint16_t audioBytes;
+    uint16_t sampleCount;
+};
+
+struct FrameIndexEntry {
+    uint32_t offset;
+    uint32_t size;
+};
+#pragma pack(pop)
+
+#endif
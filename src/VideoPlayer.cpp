@@ -1,122 +1,484 @@
 #include "VideoPlayer.h"
+#include "CycleCounter.h"
+#include "Profiler.h"
 #include <Arduino.h>
 #include <cstring>
 
-VideoPlayer::VideoPlayer(SDFileReader* reader, DisplayManager* display, const char* path) 
-    : sdReader(reader), displayManager(display), videoPath(path), isValid(false), 
-      compressedBuffer(nullptr), segmentBuffer(nullptr), frameIndexCache(nullptr), 
-      indexCacheStart(0), indexCacheSize(0) {
+static inline size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// The display takes pixels big-endian.
+static void toWireOrder(uint16_t* pixels, uint32_t count) {
+    uint32_t i = 0;
+    
+    for (; i + 7 < count; i += 8) {
+        pixels[i]     = __builtin_bswap16(pixels[i]);
+        pixels[i + 1] = __builtin_bswap16(pixels[i + 1]);
+        pixels[i + 2] = __builtin_bswap16(pixels[i + 2]);
+        pixels[i + 3] = __builtin_bswap16(pixels[i + 3]);
+        pixels[i + 4] = __builtin_bswap16(pixels[i + 4]);
+        pixels[i + 5] = __builtin_bswap16(pixels[i + 5]);
+        pixels[i + 6] = __builtin_bswap16(pixels[i + 6]);
+        pixels[i + 7] = __builtin_bswap16(pixels[i + 7]);
+    }
+    
+    for (; i < count; i++) {
+        pixels[i] = __builtin_bswap16(pixels[i]);
+    }
+}
+
+// How cheap a frame is to show while scrubbing: self-contained frames by
+// size, then repeats and delta frames all alike, since showing one can mean
+// drawing the frame it repeats or every frame back to the last keyframe, which
+// its own size says nothing about.
+static uint64_t scrubCost(uint32_t size) {
+    return (size & VID_INDEX_FLAGS) ? (uint64_t)1 << 32 : size;
+}
+
+const VideoPlayer::FrameCodec VideoPlayer::FRAME_CODECS[VID_COMPRESSION_TYPES] = {
+    {nullptr, nullptr, false},
+    {&VideoPlayer::decodeRLESegment, &VideoPlayer::transmitRows, true},       // VID_COMPRESSION_RLE
+    {&VideoPlayer::decodeTileRow, &VideoPlayer::transmitTileRow, false},      // VID_COMPRESSION_TILES
+    {&VideoPlayer::decodeRectBatch, &VideoPlayer::transmitRects, false},      // VID_COMPRESSION_RECTS
+    {&VideoPlayer::decodeSpanSegment, &VideoPlayer::transmitRows, true},      // VID_COMPRESSION_SPANS
+    {&VideoPlayer::decodeRowSegment, &VideoPlayer::transmitRows, true},       // VID_COMPRESSION_ROWS
+    {&VideoPlayer::decodeRawSegment, &VideoPlayer::transmitRows, true},       // VID_COMPRESSION_RAW
+};
+
+VideoPlayer::VideoPlayer(VideoSource* videoSource, DisplayManager* display) 
+    : source(videoSource), displayManager(display), isValid(false),
+      nextSource(nullptr), nextReady(false), nextIndexCache(nullptr), nextIndexCacheSize(0),
+      arena(nullptr), arenaCapacity(0), ownsArena(false), planner(nullptr),
+      compressedBuffer(nullptr), compressedCapacity(0), readBufferSize(0), segmentBuffer(nullptr), rowDictionary(nullptr),
+      frameIndexCache(nullptr), 
+      indexCacheStart(0), indexCacheSize(0), state(PLAYBACK_IDLE), drawX(0), drawY(0),
+      currentFrame(0), currentDisplay(false), currentDeadline(0), scrubbing(false), scrubPending(false),
+      scrubTarget(0), currentData(nullptr), readPosition(0),
+      readChunkBytes(DEFAULT_READ_CHUNK_BYTES), currentSegment(0), currentSegmentRows(0),
+      segmentRowLimit(0), frameCodec(VID_COMPRESSION_RLE), frameCache(nullptr), clipKey(0), looping(false),
+      loopCount(0), readStartMicros(0), lastReadMicros(0), lastReadBytes(0), fillFrame(0), fillBuffer(nullptr),
+      fillPosition(0), transferPending(false), transferStartMicros(0), audioTrack(nullptr),
+      powerManager(nullptr), frameWorkMicros(0), transferMicros(0), presentLateMicros(0), waitIdle(false),
+      readFrame(0), currentRepeat(false), shownFrame(NO_FRAME), shownX(0), shownY(0), repeatFrame(NO_FRAME),
+      repeatFrameSource(NO_FRAME), deltaTarget(NO_FRAME) {
+    memset(&audioHeader, 0, sizeof(audioHeader));
+    memset(&nextAudioHeader, 0, sizeof(nextAudioHeader));
+    memset(&rowDictionaryHeader, 0, sizeof(rowDictionaryHeader));
+    memset(&nextRowDictionaryHeader, 0, sizeof(nextRowDictionaryHeader));
+    resetSliceStats();
 }
 
 VideoPlayer::~VideoPlayer() {
     cleanupBuffers();
 }
 
+void VideoPlayer::setArena(uint8_t* storage, size_t size) {
+    cleanupBuffers();
+    arena = storage;
+    arenaCapacity = size;
+    ownsArena = false;
+}
+
+void VideoPlayer::setMemoryPlanner(MemoryPlanner* memoryPlanner) {
+    cleanupBuffers();
+    planner = memoryPlanner;
+}
+
 void VideoPlayer::cleanupBuffers() {
-    if (compressedBuffer) {
-        delete[] compressedBuffer;
-        compressedBuffer = nullptr;
+    if (ownsArena && arena) {
+        delete[] arena;
+        arena = nullptr;
+        arenaCapacity = 0;
+        ownsArena = false;
     }
     
-    if (segmentBuffer) {
-        delete[] segmentBuffer;
-        segmentBuffer = nullptr;
+    compressedBuffer = nullptr;
+    segmentBuffer = nullptr;
+    rowDictionary = nullptr;
+    frameIndexCache = nullptr;
+    nextIndexCache = nullptr;
+}
+
+// Files from the current converter store their largest frame, audio chunk
+// included. Otherwise: a VID0 RLE frame can never exceed one literal header
+// byte per 128 pixels plus the raw pixels (nor can a tiled frame, whose mode
+// map takes 2 bits per 64 pixels or more), and in files with audio the
+// frame's audio chunk comes on top. Rectangle, span and row-dictionary files
+// always store it.
+uint32_t VideoPlayer::maxCompressedFrameSize(const VideoHeader& hdr, const AudioHeader* audio) {
+    if ((hdr.flags & VID_FLAG_MAX_FRAME_SIZE) && hdr.maxFrameSize) {
+        return hdr.maxFrameSize;
     }
     
-    if (frameIndexCache) {
-        delete[] frameIndexCache;
-        frameIndexCache = nullptr;
+    uint32_t pixels = (uint32_t)hdr.frameWidth * hdr.frameHeight;
+    uint32_t size = pixels * sizeof(uint16_t) + (pixels + 127) / 128;
+    
+    if (audio && (hdr.flags & VID_FLAG_AUDIO)) {
+        size += sizeof(AudioChunkHeader) + audio->maxChunkBytes;
     }
+    return size;
 }
 
-bool VideoPlayer::begin() {
-    size_t headerSize;
-    uint8_t* headerData = sdReader->readPartialFile(videoPath, headerSize, sizeof(VideoHeader), 0);
+// Memory-mapped sources are decoded in place and need no read buffer at all.
+size_t VideoPlayer::readBufferSizeFor(const VideoHeader& hdr, const VideoSource* src, const AudioHeader* audio) {
+    if (src && src->isMemoryMapped()) {
+        return 0;
+    }
+    return alignUp(maxCompressedFrameSize(hdr, audio) + (src ? src->getReadSlack() : 0), DMA_ALIGNMENT);
+}
+
+size_t VideoPlayer::requiredArenaSize(const VideoHeader& hdr, const VideoSource* src, const AudioHeader* audio,
+                                      const RowDictionaryHeader* dictionary) {
+    uint32_t rows = SEGMENT_BUFFER_BYTES / sizeof(uint16_t) / hdr.frameWidth;
+    if (rows > hdr.frameHeight) {
+        rows = hdr.frameHeight;
+    }
+    if (hdr.compression == VID_COMPRESSION_RECTS) {
+        rows = 0;
+    }
+    uint32_t dictionaryRows = dictionary && (hdr.flags & VID_FLAG_ROW_DICTIONARY) ? dictionary->rowCount : 0;
     
-    if (!headerData || headerSize < sizeof(VideoHeader)) {
-        if (headerData) delete[] headerData;
-        return false;
+    return DMA_ALIGNMENT
+         + readBufferSizeFor(hdr, src, audio)
+         + alignUp(dictionaryRows * hdr.frameWidth * sizeof(uint16_t), DMA_ALIGNMENT)
+         + alignUp(rows * hdr.frameWidth * sizeof(uint16_t), DMA_ALIGNMENT)
+         + 2 * alignUp(INDEX_CACHE_FRAMES * sizeof(FrameIndexEntry), DMA_ALIGNMENT);
+}
+
+// Without a memory planner every buffer is carved from one arena, so begin()
+// costs at most a single heap allocation and playback none; an existing arena
+// is re-carved in place whenever the new layout fits. Either way regions are
+// cache-line aligned for SD/SPI DMA.
+bool VideoPlayer::allocateBuffers() {
+    MemoryPlanner* plan = planner;
+    
+    if (!plan) {
+        size_t required = requiredArenaSize(header, source, &audioHeader, &rowDictionaryHeader);
+        
+        if (arena && arenaCapacity < required) {
+            if (!ownsArena) {
+                return false;
+            }
+            cleanupBuffers();
+        }
+        
+        if (!arena) {
+            arena = new uint8_t[required];
+            if (!arena) {
+                return false;
+            }
+            arenaCapacity = required;
+            ownsArena = true;
+        }
+        
+        arenaPlanner.setPool(MEMORY_DMA, arena, arenaCapacity);
+        plan = &arenaPlanner;
     }
+    plan->reset();
     
-    memcpy(&header, headerData, sizeof(VideoHeader));
-    delete[] headerData;
+    // The index blocks are small and looked up every frame; the read buffer
+    // is the SD transfer destination.
+    size_t indexBytes = INDEX_CACHE_FRAMES * sizeof(FrameIndexEntry);
+    frameIndexCache = (FrameIndexEntry*)plan->carve("index", indexBytes, MEMORY_FAST);
+    nextIndexCache = (FrameIndexEntry*)plan->carve("next_index", indexBytes, MEMORY_FAST);
     
-    if (memcmp(header.magic, "VID0", 4) != 0) {
+    compressedCapacity = maxCompressedFrameSize(header, &audioHeader);
+    readBufferSize = readBufferSizeFor(header, source, &audioHeader);
+    compressedBuffer = readBufferSize ? plan->carve("read", readBufferSize, MEMORY_DMA) : nullptr;
+    
+    if (!frameIndexCache || !nextIndexCache || (readBufferSize && !compressedBuffer)) {
         return false;
     }
     
-    if (header.compression != 1) {
+    // The row dictionary is read by every frame of the clip.
+    uint32_t dictionaryBytes = (uint32_t)rowDictionaryHeader.rowCount * header.frameWidth * sizeof(uint16_t);
+    rowDictionary = dictionaryBytes ? (uint16_t*)plan->carve("row_dictionary", dictionaryBytes, MEMORY_FAST) : nullptr;
+    if (dictionaryBytes && !rowDictionary) {
         return false;
     }
     
-    if (header.indexOffset == 0) {
-        header.indexOffset = 24;
+    // Rectangles are sent as fills straight from the compressed frame.
+    if (header.compression == VID_COMPRESSION_RECTS) {
+        segmentBuffer = nullptr;
+        segmentSize = 0;
+        rowsPerSegment = 0;
+        return true;
     }
     
-    const uint32_t COMPRESSED_BUFFER_SIZE = 100 * 1024;
-    compressedBuffer = new uint8_t[COMPRESSED_BUFFER_SIZE];
-    if (!compressedBuffer) {
-        cleanupBuffers();
+    // Whole-frame mode: when either pool still holds a full frame, each frame
+    // is decoded once and sent as a single transfer. Otherwise the decoder's
+    // segment buffer goes in fast memory unless the other pool has more room
+    // left, with as many rows as fit, up to SEGMENT_BUFFER_BYTES.
+    uint32_t rowBytes = header.frameWidth * sizeof(uint16_t);
+    uint32_t frameBytes = rowBytes * header.frameHeight;
+    size_t fastRoom = plan->available(MEMORY_FAST);
+    uint32_t rows = header.frameHeight;
+    MemoryPool segmentPool = fastRoom >= frameBytes ? MEMORY_FAST : MEMORY_DMA;
+    
+    if (plan->available(segmentPool) < frameBytes) {
+        rows = min(SEGMENT_BUFFER_BYTES / rowBytes, rows);
+        segmentPool = (fastRoom >= rows * rowBytes || fastRoom >= plan->available(MEMORY_DMA)) ? MEMORY_FAST : MEMORY_DMA;
+        uint32_t fit = plan->available(segmentPool) / rowBytes;
+        
+        if (rows > fit) {
+            rows = fit;
+        }
+        if (rows == 0) {
+            return false;
+        }
+    }
+    
+    segmentBuffer = (uint16_t*)plan->carve("segment", rows * rowBytes, segmentPool);
+    segmentSize = header.frameWidth * rows;
+    rowsPerSegment = (segmentRowLimit && rows > segmentRowLimit) ? segmentRowLimit : rows;
+    
+    // Tiled frames need a whole row of tiles at once.
+    tileLayout.set(header.frameWidth, header.frameHeight, header.tileShape);
+    uint32_t tileRows = min((uint32_t)tileLayout.tileHeight, (uint32_t)header.frameHeight);
+    if (usesCodec(VID_COMPRESSION_TILES) && rows < tileRows) {
         return false;
     }
     
-    const uint32_t SEGMENT_BUFFER_BYTES = 100 * 1024;
-    segmentSize = SEGMENT_BUFFER_BYTES / sizeof(uint16_t);
+    return segmentBuffer != nullptr;
+}
+
+// Dictionary rows are stored little-endian after the headers and swapped once
+// here, so frames copy them to the display as they are.
+bool VideoPlayer::loadRowDictionary() {
+    uint32_t pixels = (uint32_t)rowDictionaryHeader.rowCount * header.frameWidth;
+    if (pixels == 0) {
+        return true;
+    }
+    
+    uint32_t position = rowDictionaryOffset(header.flags) + sizeof(RowDictionaryHeader);
+    if (!source->read((uint8_t*)rowDictionary, pixels * sizeof(uint16_t), position)) {
+        return false;
+    }
+    toWireOrder(rowDictionary, pixels);
+    return true;
+}
+
+bool VideoPlayer::openVideo(VideoSource* src, VideoHeader& hdr, AudioHeader& audio, RowDictionaryHeader& rows) {
+    if (!src || !src->open()) {
+        return false;
+    }
     
-    rowsPerSegment = segmentSize / header.frameWidth;
-    if (rowsPerSegment > header.frameHeight) {
-        rowsPerSegment = header.frameHeight;
-        segmentSize = header.frameWidth * rowsPerSegment;
+    if (!src->read((uint8_t*)&hdr, sizeof(VideoHeader), 0)) {
+        src->close();
+        return false;
     }
     
+    if (memcmp(hdr.magic, "VID0", 4) != 0) {
+        src->close();
+        return false;
+    }
     
-    segmentBuffer = new uint16_t[segmentSize];
-    if (!segmentBuffer) {
-        cleanupBuffers();
+    bool codecKnown = hdr.compression == VID_COMPRESSION_PER_FRAME || codecSupported(hdr, hdr.compression);
+    if (!codecKnown || hdr.frameWidth == 0 || hdr.frameHeight == 0 || hdr.frameCount == 0) {
+        src->close();
         return false;
     }
     
-    frameIndexCache = new FrameIndexEntry[INDEX_CACHE_FRAMES];
-    if (!frameIndexCache) {
-        cleanupBuffers();
+    if (hdr.indexOffset == 0) {
+        hdr.indexOffset = 24;
+    }
+    if (!(hdr.flags & VID_FLAG_MAX_FRAME_SIZE)) {
+        hdr.maxFrameSize = 0;
+    }
+    
+    memset(&audio, 0, sizeof(audio));
+    if ((hdr.flags & VID_FLAG_AUDIO) &&
+        (!src->read((uint8_t*)&audio, sizeof(AudioHeader), videoHeaderSize(hdr.flags)) || memcmp(audio.magic, "AUD0", 4) != 0)) {
+        src->close();
+        return false;
+    }
+    
+    memset(&rows, 0, sizeof(rows));
+    if ((hdr.flags & VID_FLAG_ROW_DICTIONARY) &&
+        (!src->read((uint8_t*)&rows, sizeof(RowDictionaryHeader), rowDictionaryOffset(hdr.flags)) || memcmp(rows.magic, "ROW0", 4) != 0)) {
+        src->close();
         return false;
     }
     
-    loadIndexCache(0);
+    src->setLayoutFlags(hdr.flags);
+    return true;
+}
+
+// NTSC-family files store the nominal rate (30 for 29.97 FPS).
+void VideoPlayer::applyFrameRate() {
+    if (header.flags & VID_FLAG_NTSC_RATE) {
+        scheduler.setRate(header.fps * 1000, 1001);
+    } else {
+        scheduler.setRate(header.fps);
+    }
+}
+
+bool VideoPlayer::begin() {
+    if (!openVideo(source, header, audioHeader, rowDictionaryHeader)) {
+        return false;
+    }
     
-    if (!sdReader->openFile(videoPath)) {
+    if (!allocateBuffers() || !loadRowDictionary() || !loadIndexCache(0)) {
+        source->close();
         cleanupBuffers();
         return false;
     }
     
+    applyFrameRate();
+    openAudio();
+    scheduler.start(clockMicros());
+    scheduler.resetStats();
+    state = PLAYBACK_IDLE;
+    loopCount = 0;
+    shownFrame = NO_FRAME;
+    repeatFrame = NO_FRAME;
+    clipKey = computeClipKey();
+    attachCache();
     isValid = true;
+    syncAudio(0);
+    
+    if (planner) {
+        planner->printMap();
+    }
     return true;
 }
 
 void VideoPlayer::end() {
+    while (!pollTransfer()) {
+    }
+    if (audioTrack) {
+        audioTrack->close();
+    }
+    cancelPrefill();
     isValid = false;
-    sdReader->closeFile();
+    state = PLAYBACK_IDLE;
+    cancelPreload();
+    if (source) {
+        source->close();
+    }
     cleanupBuffers();
 }
 
-bool VideoPlayer::loadIndexCache(uint32_t startFrame) {
-    if (startFrame >= header.frameCount) return false;
+bool VideoPlayer::preload(VideoSource* next) {
+    if (!isValid || !next || next == source) {
+        return false;
+    }
     
-    uint32_t framesToCache = min(INDEX_CACHE_FRAMES, header.frameCount - startFrame);
-    uint32_t indexPosition = header.indexOffset + (startFrame * sizeof(FrameIndexEntry));
-    size_t bytesRead;
+    cancelPreload();
+    
+    if (!openVideo(next, nextHeader, nextAudioHeader, nextRowDictionaryHeader)) {
+        return false;
+    }
+    
+    uint32_t framesToCache = min((uint32_t)INDEX_CACHE_FRAMES, nextHeader.frameCount);
+    if (!next->read((uint8_t*)nextIndexCache, framesToCache * sizeof(FrameIndexEntry), nextHeader.indexOffset)) {
+        next->close();
+        return false;
+    }
+    
+    nextSource = next;
+    nextIndexCacheSize = framesToCache;
+    nextReady = true;
+    return true;
+}
+
+void VideoPlayer::cancelPreload() {
+    if (nextReady) {
+        nextSource->close();
+        nextReady = false;
+    }
+}
+
+bool VideoPlayer::switchToPreloaded() {
+    if (!nextReady) {
+        return false;
+    }
+    
+    bool sameLayout = isValid &&
+                      nextHeader.frameWidth == header.frameWidth &&
+                      nextHeader.frameHeight == header.frameHeight &&
+                      nextHeader.compression == header.compression &&
+                      nextHeader.tileShape == header.tileShape &&
+                      nextRowDictionaryHeader.rowCount == rowDictionaryHeader.rowCount &&
+                      readBufferSizeFor(nextHeader, nextSource, &nextAudioHeader) <= readBufferSize;
+    
+    // The next clip's first frame is due one display interval after the last
+    // frame of this one. In reverse the next clip plays from its end.
+    uint32_t origin = scheduler.nextDeadline();
+    uint32_t firstFrame = scheduler.getSpeed() < 0 ? nextHeader.frameCount - 1 : 0;
+    bool audioContinues = audioTrack && audioTrack->isActive();
     
-    uint8_t* indexData = sdReader->readPartialFile(videoPath, bytesRead, 
-                                                   framesToCache * sizeof(FrameIndexEntry), 
-                                                   indexPosition);
+    cancelPrefill();
+    source->close();
+    source = nextSource;
+    header = nextHeader;
+    audioHeader = nextAudioHeader;
+    rowDictionaryHeader = nextRowDictionaryHeader;
+    nextReady = false;
+    state = PLAYBACK_IDLE;
+    scrubbing = false;
+    shownFrame = NO_FRAME;
+    repeatFrame = NO_FRAME;
+    applyFrameRate();
+    scheduler.start(origin, firstFrame);
     
-    if (!indexData || bytesRead < framesToCache * sizeof(FrameIndexEntry)) {
-        if (indexData) delete[] indexData;
+    // Audio still queued from the last clip plays out and the new clip's
+    // follows it when the formats match.
+    openAudio();
+    if (audioContinues && audioTrack->isActive()) {
+        audioTrack->rewind();
+    } else {
+        syncAudio(firstFrame);
+    }
+    
+    if (sameLayout) {
+        // A dictionary of the same size is read over the old one.
+        if (!loadRowDictionary()) {
+            isValid = false;
+            source->close();
+            cleanupBuffers();
+            return false;
+        }
+        compressedCapacity = maxCompressedFrameSize(header, &audioHeader);
+        FrameIndexEntry* previousCache = frameIndexCache;
+        frameIndexCache = nextIndexCache;
+        nextIndexCache = previousCache;
+        indexCacheStart = 0;
+        indexCacheSize = nextIndexCacheSize;
+        clipKey = computeClipKey();
+        attachCache();
+        return true;
+    }
+    
+    isValid = false;
+    if (!allocateBuffers() || !loadRowDictionary() || !loadIndexCache(0)) {
+        source->close();
+        cleanupBuffers();
         return false;
     }
     
-    memcpy(frameIndexCache, indexData, framesToCache * sizeof(FrameIndexEntry));
-    delete[] indexData;
+    clipKey = computeClipKey();
+    attachCache();
+    isValid = true;
+    
+    if (planner) {
+        planner->printMap();
+    }
+    return true;
+}
+
+bool VideoPlayer::loadIndexCache(uint32_t frameNumber) {
+    if (frameNumber >= header.frameCount) return false;
+    
+    uint32_t startFrame = frameNumber - frameNumber % INDEX_CACHE_FRAMES;
+    uint32_t framesToCache = min((uint32_t)INDEX_CACHE_FRAMES, header.frameCount - startFrame);
+    uint32_t indexPosition = header.indexOffset + (startFrame * sizeof(FrameIndexEntry));
+    
+    if (!source->read((uint8_t*)frameIndexCache, framesToCache * sizeof(FrameIndexEntry), indexPosition)) {
+        indexCacheSize = 0;
+        return false;
+    }
     
     indexCacheStart = startFrame;
     indexCacheSize = framesToCache;
@@ -124,86 +486,1356 @@ bool VideoPlayer::loadIndexCache(uint32_t startFrame) {
     return true;
 }
 
-bool VideoPlayer::playFrameSegmented(uint32_t frameNumber, uint16_t x, uint16_t y) {
+bool VideoPlayer::lookupFrame(uint32_t frameNumber, FrameIndexEntry& entry, bool& repeat) {
     if (!isValid || frameNumber >= header.frameCount) {
         return false;
     }
     
-    FrameIndexEntry frameEntry;
-    if (frameNumber >= indexCacheStart && frameNumber < indexCacheStart + indexCacheSize) {
-        frameEntry = frameIndexCache[frameNumber - indexCacheStart];
-    } else {
-        if (!loadIndexCache(frameNumber)) {
-            return false;
+    source->setTimingTag(frameNumber);
+    PROFILE_ZONE("player_lookupFrame");
+    PIPELINE_TIMED(STAGE_INDEX, frameNumber, 0);
+    
+    if (!isIndexCached(frameNumber) && !loadIndexCache(frameNumber)) {
+        return false;
+    }
+    entry = frameIndexCache[frameNumber - indexCacheStart];
+    repeat = (entry.size & VID_INDEX_REPEAT) != 0;
+    entry.size &= ~VID_INDEX_FLAGS;
+    
+    return entry.size <= compressedCapacity;
+}
+
+// A repeat of the picture last drawn comes back with data nullptr and nothing
+// read but its audio, if queued; a repeat of anything else comes back as the
+// frame it repeats.
+bool VideoPlayer::fetchFrame(uint32_t frameNumber, FrameIndexEntry& entry, const uint8_t*& data, bool queueAudio) {
+    bool repeat;
+    if (!lookupFrame(frameNumber, entry, repeat)) {
+        return false;
+    }
+    
+    currentFrame = frameNumber;
+    readFrame = frameNumber;
+    if (!repeat) {
+        return loadFrame(frameNumber, entry, data, queueAudio);
+    }
+    
+    if (queueAudio && hasAudio() && !loadFrame(frameNumber, entry, data, true)) {
+        return false;
+    }
+    readFrame = repeatSource(frameNumber);
+    data = nullptr;
+    if (readFrame == NO_FRAME) {
+        return false;
+    }
+    if (readFrame == shownFrame) {
+        return true;
+    }
+    
+    sliceStats.repeatsDrawn++;
+    return lookupFrame(readFrame, entry, repeat) && loadFrame(readFrame, entry, data, false);
+}
+
+bool VideoPlayer::loadFrame(uint32_t frameNumber, FrameIndexEntry& entry, const uint8_t*& data, bool queueAudio) {
+    if (frameCache && !source->isMemoryMapped()) {
+        data = frameCache->lookup(frameNumber);
+        if (data) {
+            PIPELINE_EVENT(STAGE_CACHE, frameNumber, 0, micros(), 0);
+            return splitChunk(frameNumber, entry, data, queueAudio);
         }
-        frameEntry = frameIndexCache[0];
     }
     
-    const uint32_t COMPRESSED_BUFFER_SIZE = 100 * 1024;
-    if (frameEntry.size > COMPRESSED_BUFFER_SIZE) {
+    {
+        PIPELINE_TIMED(STAGE_READ, frameNumber, 0);
+        data = source->getFrame(entry, compressedBuffer, readBufferSize);
+    }
+    if (!data) {
         return false;
     }
+    cacheFrame(frameNumber, entry, data);
+    return splitChunk(frameNumber, entry, data, queueAudio);
+}
+
+// In files with an audio track every frame's data starts with its audio
+// chunk. Strips the chunk, handing it to the track when asked to (the track
+// ignores chunks it is not expecting), so entry and data cover the frame.
+bool VideoPlayer::splitChunk(uint32_t frameNumber, FrameIndexEntry& entry, const uint8_t*& data, bool queueAudio) {
+    if (!(header.flags & VID_FLAG_AUDIO)) {
+        return true;
+    }
     
-    size_t readSize;
-    bool readSuccess = sdReader->readSequentialInto(
-        compressedBuffer, 
-        readSize, 
-        frameEntry.size, 
-        frameEntry.offset
-    );
+    AudioChunkHeader chunk;
+    if (entry.size < sizeof(chunk)) {
+        return false;
+    }
+    memcpy(&chunk, data, sizeof(chunk));
+    
+    uint32_t prefix = sizeof(chunk) + chunk.audioBytes;
+    if (prefix > entry.size) {
+        return false;
+    }
+    if (queueAudio && audioTrack) {
+        audioTrack->queueChunk(frameNumber, chunk, data + sizeof(chunk));
+    }
     
-    if (!readSuccess || readSize < frameEntry.size) {
+    entry.offset += prefix;
+    entry.size -= prefix;
+    data += prefix;
+    return true;
+}
+
+// Whether frames of the file may use the given compression type, as the
+// file's own or as the tag of a per-frame file's frames.
+bool VideoPlayer::codecSupported(const VideoHeader& hdr, uint8_t codec) {
+    switch (codec) {
+        case VID_COMPRESSION_RLE:
+        case VID_COMPRESSION_RECTS:
+        case VID_COMPRESSION_RAW:
+            return true;
+        case VID_COMPRESSION_SPANS:
+            return hdr.frameWidth <= SpanDecoder::MAX_WIDTH;
+        case VID_COMPRESSION_ROWS:
+            return (hdr.flags & VID_FLAG_ROW_DICTIONARY) != 0;
+        case VID_COMPRESSION_TILES:
+            return TileDecoder::isValidShape(hdr.tileShape, hdr.frameWidth);
+        default:
+            return false;
+    }
+}
+
+// Frames of per-frame files start with their compression type, which is
+// taken off the data here; other files give every frame the header's.
+bool VideoPlayer::selectCodec(FrameIndexEntry& entry, const uint8_t*& data) {
+    if (header.compression != VID_COMPRESSION_PER_FRAME) {
+        frameCodec = header.compression;
+        return true;
+    }
+    if (entry.size == 0 || !codecSupported(header, data[0])) {
         return false;
     }
+    frameCodec = data[0];
+    entry.offset++;
+    entry.size--;
+    data++;
+    return true;
+}
+
+// Decodes the given segment into segmentBuffer, continuing from the cursor
+// left by the previous segment, and returns its row count (0 on error).
+uint32_t VideoPlayer::decodeSegment(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint32_t segment) {
+    return (this->*FRAME_CODECS[frameCodec].decode)(frameEntry, frameData, segment);
+}
+    
+uint32_t VideoPlayer::segmentRowCount(uint32_t segment) const {
+    uint32_t startRow = segment * rowsPerSegment;
+    return min(startRow + rowsPerSegment, (uint32_t)header.frameHeight) - startRow;
+}
+
+uint32_t VideoPlayer::decodeRLESegment(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint32_t segment) {
+    PROFILE_ZONE("player_decodeSegment");
+    if (segment == 0) {
+        cursor.reset();
+    }
     
-    uint32_t totalRows = header.frameHeight;
-    uint32_t numSegments = (totalRows + rowsPerSegment - 1) / rowsPerSegment;
+    uint32_t rowsInSegment = segmentRowCount(segment);
+    uint32_t pixelCount = rowsInSegment * header.frameWidth;
     
-    for (uint32_t segment = 0; segment < numSegments; segment++) {
-        uint32_t startRow = segment * rowsPerSegment;
-        uint32_t endRow = min(startRow + rowsPerSegment, totalRows);
-        uint32_t rowsInSegment = endRow - startRow;
-        
-        uint32_t startPixel = startRow * header.frameWidth;
-        uint32_t pixelCount = rowsInSegment * header.frameWidth;
-        
-        uint32_t decompressedPixels = RLEDecoder::decodeSegment(
-            compressedBuffer,
+    {
+        PIPELINE_TIMED(STAGE_DECODE, currentFrame, segment);
+        uint32_t decompressedPixels = RLEDecoder::decodeNext(
+            frameData,
             frameEntry.size,
+            cursor,
             segmentBuffer,
-            startPixel,
             pixelCount
         );
         
         if (decompressedPixels != pixelCount) {
-            return false;
+            return 0;
         }
-        
-        uint32_t i = 0;
-        
-        for (; i + 7 < pixelCount; i += 8) {
-            segmentBuffer[i]     = __builtin_bswap16(segmentBuffer[i]);
-            segmentBuffer[i + 1] = __builtin_bswap16(segmentBuffer[i + 1]);
-            segmentBuffer[i + 2] = __builtin_bswap16(segmentBuffer[i + 2]);
-            segmentBuffer[i + 3] = __builtin_bswap16(segmentBuffer[i + 3]);
-            segmentBuffer[i + 4] = __builtin_bswap16(segmentBuffer[i + 4]);
-            segmentBuffer[i + 5] = __builtin_bswap16(segmentBuffer[i + 5]);
-            segmentBuffer[i + 6] = __builtin_bswap16(segmentBuffer[i + 6]);
-            segmentBuffer[i + 7] = __builtin_bswap16(segmentBuffer[i + 7]);
+    }
+    
+    PROFILE_ZONE("player_byteSwap");
+    PIPELINE_TIMED(STAGE_SWAP, currentFrame, segment);
+    toWireOrder(segmentBuffer, pixelCount);
+    
+    return rowsInSegment;
+}
+
+// Raw rows are swapped into wire order as they are copied.
+uint32_t VideoPlayer::decodeRawSegment(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint32_t segment) {
+    PROFILE_ZONE("player_decodeRawSegment");
+    uint32_t rowsInSegment = segmentRowCount(segment);
+    uint32_t first = segment * rowsPerSegment * header.frameWidth;
+    uint32_t pixelCount = rowsInSegment * header.frameWidth;
+    if ((first + pixelCount) * sizeof(uint16_t) > frameEntry.size) {
+        return 0;
+    }
+    
+    PIPELINE_TIMED(STAGE_DECODE, currentFrame, segment);
+    const uint8_t* in = frameData + first * sizeof(uint16_t);
+    for (uint32_t i = 0; i < pixelCount; i++, in += 2) {
+        segmentBuffer[i] = (in[0] << 8) | in[1];
+    }
+    return rowsInSegment;
+}
+
+// Spans and dictionary rows are written in wire order and need no swap pass.
+uint32_t VideoPlayer::decodeSpanSegment(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint32_t segment) {
+    PROFILE_ZONE("player_decodeSpanSegment");
+    if (segment == 0) {
+        spanCursor.reset();
+    }
+    
+    uint32_t rowsInSegment = segmentRowCount(segment);
+    PIPELINE_TIMED(STAGE_DECODE, currentFrame, segment);
+    return SpanDecoder::decodeNext(frameData, frameEntry.size, header.frameWidth, spanCursor, segmentBuffer,
+                                   rowsInSegment) ? rowsInSegment : 0;
+}
+
+uint32_t VideoPlayer::decodeRowSegment(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint32_t segment) {
+    PROFILE_ZONE("player_decodeRowSegment");
+    if (segment == 0) {
+        rowCursor.reset();
+    }
+    
+    uint32_t rowsInSegment = segmentRowCount(segment);
+    PIPELINE_TIMED(STAGE_DECODE, currentFrame, segment);
+    return RowDecoder::decodeNext(frameData, frameEntry.size, header.frameWidth, rowDictionary,
+                                  rowDictionaryHeader.rowCount, rowCursor, segmentBuffer, rowsInSegment)
+           ? rowsInSegment : 0;
+}
+
+// A segment of a tiled frame is one row of tiles: the modes and solid colours
+// go to tileRow and the pixels of the other tiles, packed, to segmentBuffer.
+uint32_t VideoPlayer::decodeTileRow(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint32_t segment) {
+    PROFILE_ZONE("player_decodeTileRow");
+    if (segment == 0) {
+        tileCursor.reset();
+    }
+    
+    uint32_t pixelCount;
+    {
+        PIPELINE_TIMED(STAGE_DECODE, currentFrame, segment);
+        if (!TileDecoder::decodeRow(frameData, frameEntry.size, tileLayout, tileCursor, tileRow,
+                                    segmentBuffer, segmentSize, pixelCount)) {
+            return 0;
+        }
+    }
+    
+    PIPELINE_TIMED(STAGE_SWAP, currentFrame, segment);
+    toWireOrder(segmentBuffer, pixelCount);
+    
+    uint32_t startRow = segment * tileLayout.tileHeight;
+    return min(startRow + tileLayout.tileHeight, (uint32_t)header.frameHeight) - startRow;
+}
+
+// Rectangle frames have no rows: a segment is the next batch of rectangles,
+// decoded into rectBatch, and counts as one row.
+uint32_t VideoPlayer::decodeRectBatch(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint32_t segment) {
+    PROFILE_ZONE("player_decodeRectBatch");
+    if (segment == 0) {
+        rectCursor.reset();
+    }
+    
+    PIPELINE_TIMED(STAGE_DECODE, currentFrame, segment);
+    if (!RectDecoder::decodeNext(frameData, frameEntry.size, header.frameWidth, header.frameHeight, rectCursor,
+                                 rectBatch, RECT_BATCH, rectCount)) {
+        return 0;
+    }
+    return 1;
+}
+
+void VideoPlayer::transmitSegment(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y) {
+    PROFILE_ZONE("player_transmitSegment");
+    PIPELINE_TIMED(STAGE_SPI, currentFrame, segment);
+    (this->*FRAME_CODECS[frameCodec].transmit)(segment, rows, x, y);
+}
+    
+void VideoPlayer::transmitRows(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y) {
+    if (isWholeFrame() && displayManager->beginFrameTransfer(segmentBuffer, header.frameWidth, rows, x, y)) {
+        while (!displayManager->isTransferDone()) {
         }
+        return;
+    }
+    displayManager->drawFrameBuffer(
+        segmentBuffer, 
+        header.frameWidth, 
+        rows,
+        x, 
+        y + segment * rowsPerSegment
+    );
+}
+
+// Unchanged tiles are left alone, runs of solid tiles of one colour are sent
+// as one rectangle fill and every other tile through a window of its own.
+void VideoPlayer::transmitTileRow(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y) {
+    uint16_t top = y + segment * tileLayout.tileHeight;
+    uint16_t* pixels = segmentBuffer;
+    uint16_t column = 0;
+    
+    while (column < tileLayout.columns) {
+        const TileInfo& tile = tileRow[column];
+        uint16_t left = column * tileLayout.tileWidth;
         
-        for (; i < pixelCount; i++) {
-            segmentBuffer[i] = __builtin_bswap16(segmentBuffer[i]);
+        if (tile.mode == TILE_SOLID) {
+            do {
+                column++;
+            } while (column < tileLayout.columns && tileRow[column].mode == TILE_SOLID &&
+                     tileRow[column].color == tile.color);
+            uint16_t right = min((uint32_t)column * tileLayout.tileWidth, (uint32_t)header.frameWidth);
+            displayManager->fillRectangle(x + left, top, right - left, rows, tile.color);
+            continue;
         }
         
-        displayManager->drawFrameBuffer(
-            segmentBuffer, 
-            header.frameWidth, 
-            rowsInSegment,
-            x, 
-            y + startRow
-        );
+        column++;
+        if (tile.mode != TILE_UNCHANGED) {
+            uint16_t width = min((uint32_t)tileLayout.tileWidth, (uint32_t)header.frameWidth - left);
+            displayManager->drawFrameBuffer(pixels, width, rows, x + left, top);
+            pixels += width * rows;
+        }
+    }
+}
+
+// The batch goes out as fills in one bus transaction, or one transaction
+// each if the bus cannot be held.
+void VideoPlayer::transmitRects(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y) {
+    (void)segment;
+    (void)rows;
+    bool held = displayManager->beginFills();
+    
+    for (uint16_t i = 0; i < rectCount; i++) {
+        const RectInfo& rect = rectBatch[i];
+        displayManager->fillRectangle(x + rect.x, y + rect.y, rect.width, rect.height, rect.color);
+    }
+    if (held) {
+        displayManager->endFills();
+    }
+}
+
+// Without data (a repeat from fetchFrame) the picture on screen stands, unless
+// it was drawn elsewhere.
+bool VideoPlayer::drawFrame(const FrameIndexEntry& frameEntry, const uint8_t* frameData, uint16_t x, uint16_t y) {
+    if (!frameData) {
+        if (x == shownX && y == shownY) {
+            sliceStats.repeatsSkipped++;
+            return true;
+        }
+        FrameIndexEntry entry;
+        const uint8_t* data;
+        sliceStats.repeatsDrawn++;
+        return fetchFrame(readFrame, entry, data) && drawFrame(entry, data, x, y);
+    }
+    
+    // A delta frame read without its base on screen: drawing the base reuses
+    // the read buffer, so the frame is read again after.
+    if (deltaStart(readFrame, x, y) != readFrame) {
+        FrameIndexEntry entry;
+        const uint8_t* data;
+        bool repeat;
+        return prepareDelta(readFrame, x, y) && lookupFrame(readFrame, entry, repeat) &&
+               loadFrame(readFrame, entry, data, false) && drawFrame(entry, data, x, y);
+    }
+    
+    FrameIndexEntry entry = frameEntry;
+    const uint8_t* data = frameData;
+    if (!selectCodec(entry, data)) {
+        return false;
     }
     
+    shownFrame = NO_FRAME;
+    for (uint32_t segment = 0; moreSegments(entry, segment); segment++) {
+        uint32_t rows = decodeSegment(entry, data, segment);
+        if (rows == 0) {
+            return false;
+        }
+        transmitSegment(segment, rows, x, y);
+    }
+    
+    markShown(x, y);
+    return true;
+}
+
+void VideoPlayer::markShown(uint16_t x, uint16_t y) {
+    shownFrame = readFrame;
+    shownX = x;
+    shownY = y;
+}
+
+bool VideoPlayer::indexFlags(uint32_t frameNumber, uint32_t& flags) {
+    if (!isIndexCached(frameNumber) && !loadIndexCache(frameNumber)) {
+        return false;
+    }
+    flags = frameIndexCache[frameNumber - indexCacheStart].size & VID_INDEX_FLAGS;
     return true;
-}
\ No newline at end of file
+}
+
+// Delta frames (VID_INDEX_DELTA) leave part of the picture as it was, so they
+// only draw correctly over the frame before them. Returns the first frame
+// that has to be drawn at x, y before frameNumber can be: frameNumber itself
+// when its base is on screen there, else the one after the last frame shown
+// there, or the last self-contained frame, whichever is later. Repeats are
+// never returned: the first frame after the one shown is the first that is
+// not a repeat. NO_FRAME on errors.
+uint32_t VideoPlayer::deltaStart(uint32_t frameNumber, uint16_t x, uint16_t y) {
+    uint32_t flags;
+    if (header.compression == VID_COMPRESSION_RLE) {
+        return frameNumber;
+    }
+    if (!indexFlags(frameNumber, flags)) {
+        return NO_FRAME;
+    }
+    if (!(flags & VID_INDEX_DELTA)) {
+        return frameNumber;
+    }
+    
+    bool here = x == shownX && y == shownY;
+    uint32_t frame = frameNumber;
+    uint32_t after = frameNumber;
+    
+    while (frame-- > 0) {
+        if (!indexFlags(frame, flags)) {
+            return NO_FRAME;
+        }
+        if (flags & VID_INDEX_REPEAT) {
+            continue;
+        }
+        if (here && frame == shownFrame) {
+            return after;
+        }
+        if (!(flags & VID_INDEX_DELTA)) {
+            return frame;
+        }
+        after = frame;
+    }
+    return NO_FRAME;
+}
+
+// Draws the frames a delta frame builds on, as found by deltaStart(). They go
+// through the read buffer, so this runs before frameNumber is read.
+bool VideoPlayer::prepareDelta(uint32_t frameNumber, uint16_t x, uint16_t y) {
+    uint32_t first = deltaStart(frameNumber, x, y);
+    if (first == NO_FRAME) {
+        return false;
+    }
+    
+    uint32_t frame = readFrame;
+    for (readFrame = first; readFrame < frameNumber; readFrame++) {
+        FrameIndexEntry entry;
+        const uint8_t* data;
+        bool repeat;
+        if (!lookupFrame(readFrame, entry, repeat)) {
+            return false;
+        }
+        if (repeat) {
+            continue;
+        }
+        if (!loadFrame(readFrame, entry, data, false) || !drawFrame(entry, data, x, y)) {
+            return false;
+        }
+        sliceStats.deltaBaseFrames++;
+    }
+    readFrame = frame;
+    return true;
+}
+
+// The state machine's counterpart of prepareDelta(), a frame at a time:
+// points readFrame and currentEntry at the first frame target still needs
+// drawn before it, or at target itself, to be read next.
+bool VideoPlayer::nextDeltaFrame(uint32_t target) {
+    uint32_t frame = deltaStart(target, drawX, drawY);
+    if (frame == NO_FRAME) {
+        return false;
+    }
+    readFrame = frame;
+    readPosition = 0;
+    deltaTarget = frame != target ? target : NO_FRAME;
+    return lookupFrame(frame, currentEntry, currentRepeat);
+}
+
+// The frame whose picture a repeat shows: the nearest earlier frame that is
+// not a repeat, loading index blocks as needed. The last answer is kept so a
+// long run of repeats does not scan back over the whole run (and its index
+// blocks) for every frame.
+uint32_t VideoPlayer::repeatSource(uint32_t frameNumber) {
+    uint32_t frame = frameNumber;
+    
+    while (frame-- > 0) {
+        if (frame == repeatFrame) {
+            frame = repeatFrameSource;
+            break;
+        }
+        if (!isIndexCached(frame) && !loadIndexCache(frame)) {
+            return NO_FRAME;
+        }
+        if (!(frameIndexCache[frame - indexCacheStart].size & VID_INDEX_REPEAT)) {
+            break;
+        }
+    }
+    if (frame >= header.frameCount) {
+        return NO_FRAME;
+    }
+    
+    repeatFrame = frameNumber;
+    repeatFrameSource = frame;
+    return frame;
+}
+
+// The audio clock can only be polled, keeping the track decoding meanwhile.
+void VideoPlayer::waitUntil(uint32_t deadlineMicros) {
+    if (audioTrack) {
+        int32_t remaining;
+        while ((remaining = (int32_t)(deadlineMicros - audioTrack->clockMicros())) > 0) {
+            audioTrack->service();
+            if (powerManager) {
+                powerManager->idleUntil(micros() + remaining);
+            }
+        }
+        return;
+    }
+    
+    if (powerManager) {
+        while ((int32_t)(deadlineMicros - micros()) > 0) {
+            powerManager->idleUntil(deadlineMicros);
+        }
+        return;
+    }
+    
+    int32_t remaining = (int32_t)(deadlineMicros - micros());
+    if (remaining > 0) {
+        delayMicroseconds(remaining);
+    }
+}
+
+bool VideoPlayer::playFrameSegmented(uint32_t frameNumber, uint16_t x, uint16_t y) {
+    FrameIndexEntry entry;
+    const uint8_t* data;
+    
+    if (!fetchFrame(frameNumber, entry, data)) {
+        return false;
+    }
+    return drawFrame(entry, data, x, y);
+}
+
+// The read happens before the wait so SD latency is hidden behind the idle
+// time; only decode and transfer start at the deadline.
+bool VideoPlayer::presentAt(uint32_t frameNumber, uint32_t deadlineMicros, uint16_t x, uint16_t y) {
+    FrameIndexEntry entry;
+    const uint8_t* data;
+    
+    if (!fetchFrame(frameNumber, entry, data)) {
+        return false;
+    }
+    PIPELINE_FLUSH();
+    waitUntil(deadlineMicros);
+    PIPELINE_EVENT(STAGE_PRESENT, frameNumber, 0, deadlineMicros, clockMicros() - deadlineMicros);
+    return drawFrame(entry, data, x, y);
+}
+
+void VideoPlayer::startClock() {
+    scheduler.start(clockMicros());
+    syncAudio(0);
+}
+
+bool VideoPlayer::playScheduled(uint16_t x, uint16_t y) {
+    if (scheduler.getNextFrame() >= header.frameCount && !wrapLoop()) {
+        return isValid;
+    }
+    
+    bool display;
+    uint32_t frameNumber = nextScheduledFrame(display);
+    if (frameNumber >= header.frameCount) {
+        return isValid;
+    }
+    
+    FrameIndexEntry entry;
+    const uint8_t* data;
+    
+    while (audioBehind(frameNumber)) {
+        if (!stepAudio()) {
+            return false;
+        }
+    }
+    if (!fetchFrame(frameNumber, entry, data, true)) {
+        return false;
+    }
+    if (!display) {
+        PIPELINE_EVENT(STAGE_DROP, frameNumber, 0, micros(), 1);
+        return true;
+    }
+    
+    PIPELINE_FLUSH();
+    uint32_t deadline = scheduler.deadline(frameNumber);
+    waitUntil(deadline);
+    uint32_t now = clockMicros();
+    PIPELINE_EVENT(STAGE_PRESENT, frameNumber, 0, deadline, now - deadline);
+    scheduler.presented(frameNumber, now);
+    return drawFrame(entry, data, x, y);
+}
+
+void VideoPlayer::setReadChunkBytes(uint32_t bytes) {
+    bytes &= ~(READ_CHUNK_ALIGNMENT - 1);
+    readChunkBytes = bytes ? bytes : READ_CHUNK_ALIGNMENT;
+}
+
+// Takes effect immediately between frames; rows beyond what the segment
+// buffer holds are ignored.
+bool VideoPlayer::setSegmentRows(uint32_t rows) {
+    if (state != PLAYBACK_IDLE) {
+        return false;
+    }
+    
+    segmentRowLimit = rows;
+    if (isValid) {
+        uint32_t fit = segmentSize / header.frameWidth;
+        if (fit > header.frameHeight) {
+            fit = header.frameHeight;
+        }
+        rowsPerSegment = (rows && rows < fit) ? rows : fit;
+    }
+    return true;
+}
+
+bool VideoPlayer::update() {
+    if (audioTrack) {
+        audioTrack->service();
+    }
+    
+    // A slice may change the core clock (planFrames() in the idle step),
+    // which changes the cycle counter's rate, so with clock scaling on the
+    // slice is timed by micros() instead.
+    PlaybackState sliceState = state;
+    bool polling = transferPending;
+    bool scaling = powerManager && powerManager->isClockScaling();
+    uint32_t start = scaling ? micros() : CycleCounter::now();
+    
+    bool ok = step();
+    
+    uint32_t elapsed = scaling ? micros() - start : CycleCounter::toMicros(CycleCounter::now() - start);
+    sliceStats.count[sliceState]++;
+    sliceStats.totalMicros[sliceState] += elapsed;
+    if (elapsed > sliceStats.maxMicros[sliceState]) {
+        sliceStats.maxMicros[sliceState] = elapsed;
+    }
+    
+    if (!ok) {
+        state = PLAYBACK_IDLE;
+    }
+    
+    // A frame's work is every slice from picking it to its last transmit
+    // slice, less the deadline wait (and the cache filling done meanwhile)
+    // and polls of a background transfer, whose duration is reported apart.
+    if (powerManager) {
+        if (!polling && sliceState != PLAYBACK_WAIT) {
+            frameWorkMicros += elapsed;
+        }
+        if (ok && sliceState == PLAYBACK_TRANSMIT && state == PLAYBACK_IDLE && !scrubbing) {
+            powerManager->frameDone(currentEntry.size, frameWorkMicros, transferMicros, presentLateMicros);
+        }
+        if (state == PLAYBACK_IDLE) {
+            frameWorkMicros = 0;
+            transferMicros = 0;
+        }
+    }
+    
+    // Records are only sent between frames and while waiting, outside the
+    // timed slice.
+    if (state == PLAYBACK_IDLE || state == PLAYBACK_WAIT) {
+        PIPELINE_FLUSH();
+    }
+    return ok;
+}
+
+bool VideoPlayer::step() {
+    if (!isValid) {
+        return false;
+    }
+    
+    // A frame transfer abandoned by a seek or speed change still owns the bus
+    // and the segment buffer.
+    if (transferPending && state != PLAYBACK_TRANSMIT && !pollTransfer()) {
+        return true;
+    }
+    
+    switch (state) {
+        case PLAYBACK_IDLE: {
+            deltaTarget = NO_FRAME;
+            if (scrubbing) {
+                if (!scrubPending) {
+                    return true;
+                }
+                scrubPending = false;
+                currentFrame = pickScrubFrame(scrubTarget);
+                currentDisplay = true;
+                currentDeadline = clockMicros();
+            } else {
+                if (scheduler.getNextFrame() >= header.frameCount && !wrapLoop()) {
+                    return true;
+                }
+                
+                currentFrame = nextScheduledFrame(currentDisplay);
+                if (currentFrame >= header.frameCount) {
+                    return true;
+                }
+                currentDeadline = scheduler.deadline(currentFrame);
+            }
+            
+            displayManager->releaseSPI();
+            if (!lookupFrame(currentFrame, currentEntry, currentRepeat)) {
+                return false;
+            }
+            readFrame = currentFrame;
+            readPosition = 0;
+            if (currentDisplay && !currentRepeat && !nextDeltaFrame(currentFrame)) {
+                return false;
+            }
+            if (powerManager && currentDisplay && !scrubbing) {
+                powerManager->planFrames(upcomingFrameBytes(), scheduler.displayInterval());
+            }
+            state = audioBehind(currentFrame) ? PLAYBACK_AUDIO : PLAYBACK_READ;
+            return true;
+        }
+        
+        case PLAYBACK_AUDIO:
+            if (!stepAudio()) {
+                return false;
+            }
+            if (!audioBehind(currentFrame)) {
+                state = PLAYBACK_READ;
+            }
+            return true;
+            
+        case PLAYBACK_READ:
+            if (!stepRead()) {
+                return false;
+            }
+            if (currentData) {
+                if (!splitChunk(readFrame, currentEntry, currentData, readFrame == currentFrame)) {
+                    return false;
+                }
+                if (currentRepeat && currentDisplay) {
+                    return startRepeat();
+                }
+                if (deltaTarget != NO_FRAME) {
+                    return startDecode();
+                }
+                state = currentDisplay ? PLAYBACK_WAIT : PLAYBACK_IDLE;
+                if (!currentDisplay) {
+                    PIPELINE_EVENT(STAGE_DROP, currentFrame, 0, micros(), 1);
+                }
+            }
+            return true;
+            
+        case PLAYBACK_WAIT: {
+            uint32_t now = clockMicros();
+            waitIdle = false;
+            if ((int32_t)(now - currentDeadline) < 0) {
+                // Spend the wait fetching the next frame's index block if
+                // it is not cached, so the next lookup is free, and then
+                // filling the frame cache.
+                if (scrubbing) {
+                    return true;
+                }
+                uint32_t upcoming = upcomingFrame();
+                if (upcoming < header.frameCount && !isIndexCached(upcoming)) {
+                    loadIndexCache(upcoming);
+                } else {
+                    waitIdle = !prefillStep(currentDeadline - now);
+                }
+                return true;
+            }
+            PIPELINE_EVENT(STAGE_PRESENT, currentFrame, 0, currentDeadline, now - currentDeadline);
+            presentLateMicros = now - currentDeadline;
+            if (!scrubbing) {
+                scheduler.presented(currentFrame, now);
+            }
+            if (!currentData) {
+                sliceStats.repeatsSkipped++;
+                state = PLAYBACK_IDLE;
+                return true;
+            }
+            return startDecode();
+        }
+            
+        case PLAYBACK_DECODE:
+            currentSegmentRows = decodeSegment(currentEntry, currentData, currentSegment);
+            if (currentSegmentRows == 0) {
+                return false;
+            }
+            state = PLAYBACK_TRANSMIT;
+            return true;
+            
+        case PLAYBACK_TRANSMIT:
+            if (sendsWholeFrame()) {
+                // The frame goes out as one background transfer; later
+                // slices only poll for its end.
+                if (!transferPending) {
+                    transferStartMicros = micros();
+                    transferPending = displayManager->beginFrameTransfer(
+                        segmentBuffer, header.frameWidth, header.frameHeight, drawX, drawY);
+                    if (transferPending) {
+                        return true;
+                    }
+                    transmitSegment(0, currentSegmentRows, drawX, drawY);
+                } else if (!pollTransfer()) {
+                    return true;
+                }
+                return finishTransmit();
+            }
+            transmitSegment(currentSegment, currentSegmentRows, drawX, drawY);
+            currentSegment++;
+            if (moreSegments(currentEntry, currentSegment)) {
+                state = PLAYBACK_DECODE;
+                return true;
+            }
+            return finishTransmit();
+            
+        default:
+            return false;
+    }
+}
+
+// Once a repeat's own chunk is read: the frame it repeats is read next unless
+// its picture is on screen, leaving only the deadline to keep.
+bool VideoPlayer::startRepeat() {
+    currentRepeat = false;
+    readFrame = repeatSource(currentFrame);
+    if (readFrame == NO_FRAME) {
+        return false;
+    }
+    
+    if (readFrame == shownFrame && drawX == shownX && drawY == shownY) {
+        currentData = nullptr;
+        state = PLAYBACK_WAIT;
+        return true;
+    }
+    sliceStats.repeatsDrawn++;
+    return nextDeltaFrame(readFrame);
+}
+
+bool VideoPlayer::startDecode() {
+    if (!selectCodec(currentEntry, currentData)) {
+        return false;
+    }
+    shownFrame = NO_FRAME;
+    currentSegment = 0;
+    state = PLAYBACK_DECODE;
+    return true;
+}
+
+// After the last segment of a frame: a delta base leads on to the next frame
+// on the way to the one due, read at once.
+bool VideoPlayer::finishTransmit() {
+    markShown(drawX, drawY);
+    if (deltaTarget == NO_FRAME) {
+        state = PLAYBACK_IDLE;
+        return true;
+    }
+    sliceStats.deltaBaseFrames++;
+    state = PLAYBACK_READ;
+    return nextDeltaFrame(deltaTarget);
+}
+
+// Memory-mapped frames are available at once. Everything else is read into
+// the read buffer one chunk per call; chunk boundaries fall on multiples of
+// readChunkBytes in the file, so all but the first and last chunk of a frame
+// are whole sectors. currentData is set once the frame is complete.
+bool VideoPlayer::stepRead() {
+    PROFILE_ZONE("player_stepRead");
+    currentData = nullptr;
+    
+    if (source->isMemoryMapped()) {
+        PIPELINE_TIMED(STAGE_READ, readFrame, 0);
+        currentData = source->getFrame(currentEntry, compressedBuffer, readBufferSize);
+        return currentData != nullptr;
+    }
+    
+    if (readPosition == 0) {
+        if (frameCache) {
+            currentData = frameCache->lookup(readFrame);
+            if (currentData) {
+                PIPELINE_EVENT(STAGE_CACHE, readFrame, 0, micros(), 0);
+                return true;
+            }
+        }
+        readStartMicros = micros();
+    }
+    
+    uint32_t position = currentEntry.offset + readPosition;
+    uint32_t end = chunkEnd(position, currentEntry.offset + currentEntry.size);
+    
+    {
+        PIPELINE_TIMED(STAGE_READ, readFrame, readPosition / readChunkBytes);
+        if (end > position && !source->read(compressedBuffer + readPosition, end - position, position)) {
+            return false;
+        }
+    }
+    
+    readPosition += end - position;
+    if (readPosition >= currentEntry.size) {
+        // An empty repeat entry says nothing about the card's speed.
+        if (currentEntry.size) {
+            lastReadMicros = micros() - readStartMicros;
+            lastReadBytes = currentEntry.size;
+        }
+        currentData = compressedBuffer;
+        cacheFrame(readFrame, currentEntry, currentData);
+    }
+    return true;
+}
+
+bool VideoPlayer::pollTransfer() {
+    if (!transferPending) {
+        return true;
+    }
+    if (!displayManager->isTransferDone()) {
+        return false;
+    }
+    
+    transferPending = false;
+    transferMicros = micros() - transferStartMicros;
+    PIPELINE_EVENT(STAGE_SPI, currentFrame, 0, transferStartMicros, transferMicros);
+    return true;
+}
+
+uint32_t VideoPlayer::chunkEnd(uint32_t position, uint32_t end) const {
+    uint32_t boundary = (position / readChunkBytes + 1) * readChunkBytes;
+    return boundary < end ? boundary : end;
+}
+
+// Reads, decodes and draws the same frames first with the buffer allocated at
+// begin() (whole-frame mode when it holds a frame) and then with segments of
+// half as many rows each pass, printing the average and worst time per frame;
+// rectangle files, without a segment buffer, get one pass. Playback then
+// resumes from where it was, on a fresh clock.
+void VideoPlayer::benchmarkFrameModes(uint32_t frames) {
+    if (!isValid) {
+        return;
+    }
+    
+    uint32_t resume = state == PLAYBACK_IDLE ? scheduler.getNextFrame() : currentFrame;
+    if (resume >= header.frameCount) {
+        resume = 0;
+    }
+    seek(resume);
+    while (!pollTransfer()) {
+    }
+    if (audioTrack) {
+        audioTrack->stop();
+    }
+    
+    if (frames > header.frameCount) {
+        frames = header.frameCount;
+    }
+    uint32_t savedLimit = segmentRowLimit;
+    uint32_t capacityRows = segmentSize / header.frameWidth;
+    
+    Serial.println("# framebench,mode,segment_rows,segments,frames,avg_us,max_us");
+    for (uint32_t rows = capacityRows; rows >= MIN_BENCHMARK_ROWS || rows == capacityRows; rows /= 2) {
+        setSegmentRows(rows);
+        
+        uint64_t totalMicros = 0;
+        uint32_t maxMicros = 0;
+        uint32_t drawn = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            uint32_t start = micros();
+            if (!playFrameSegmented(frame, drawX, drawY)) {
+                break;
+            }
+            uint32_t elapsed = micros() - start;
+            totalMicros += elapsed;
+            if (elapsed > maxMicros) {
+                maxMicros = elapsed;
+            }
+            drawn++;
+        }
+        
+        Serial.printf("framebench,%s,%lu,%lu,%lu,%lu,%lu\n",
+                      header.compression == VID_COMPRESSION_RECTS ? "rects" : isWholeFrame() ? "whole" : "segmented",
+                      (unsigned long)rowsPerSegment,
+                      (unsigned long)(rowsPerSegment ? (header.frameHeight + rowsPerSegment - 1) / rowsPerSegment : 0),
+                      (unsigned long)drawn,
+                      (unsigned long)(drawn ? totalMicros / drawn : 0),
+                      (unsigned long)maxMicros);
+        if (rows == 0) {
+            break;
+        }
+    }
+    
+    setSegmentRows(savedLimit);
+    seek(resume);
+}
+
+void VideoPlayer::resetSliceStats() {
+    memset(&sliceStats, 0, sizeof(sliceStats));
+}
+
+void VideoPlayer::printSliceStats() const {
+    static const char* const STATE_NAMES[PLAYBACK_STATE_COUNT] = { "idle", "read", "wait", "decode", "transmit", "audio" };
+    
+    Serial.println("# slice,state,count,max_us,avg_us");
+    for (uint8_t i = 0; i < PLAYBACK_STATE_COUNT; i++) {
+        uint32_t count = sliceStats.count[i];
+        Serial.printf("slice,%s,%lu,%lu,%lu\n",
+                      STATE_NAMES[i],
+                      (unsigned long)count,
+                      (unsigned long)sliceStats.maxMicros[i],
+                      (unsigned long)(count ? sliceStats.totalMicros[i] / count : 0));
+    }
+    Serial.println("# repeat,skipped,drawn");
+    Serial.printf("repeat,%lu,%lu\n", (unsigned long)sliceStats.repeatsSkipped, (unsigned long)sliceStats.repeatsDrawn);
+    Serial.println("# delta,base_frames");
+    Serial.printf("delta,%lu\n", (unsigned long)sliceStats.deltaBaseFrames);
+}
+
+bool VideoPlayer::seek(uint32_t frameNumber) {
+    if (!isValid || frameNumber >= header.frameCount) {
+        return false;
+    }
+    
+    state = PLAYBACK_IDLE;
+    scrubbing = false;
+    scheduler.start(clockMicros(), frameNumber);
+    syncAudio(frameNumber);
+    return true;
+}
+
+bool VideoPlayer::seekTime(uint32_t milliseconds) {
+    return seek(scheduler.millisToFrame(milliseconds));
+}
+
+bool VideoPlayer::setSpeed(int16_t percent) {
+    int16_t previous = scheduler.getSpeed();
+    if (!scheduler.setSpeed(percent, clockMicros())) {
+        return false;
+    }
+    
+    // A frame still being read or waited for was timed at the old speed.
+    if (!scrubbing && (state == PLAYBACK_AUDIO || state == PLAYBACK_READ || state == PLAYBACK_WAIT)) {
+        state = PLAYBACK_IDLE;
+        scheduler.start(clockMicros(), currentFrame);
+    }
+    if (percent != previous) {
+        syncAudio(scheduler.getNextFrame());
+    }
+    return true;
+}
+
+uint32_t VideoPlayer::getPositionMillis() const {
+    uint32_t frame = state == PLAYBACK_IDLE ? scheduler.getNextFrame() : currentFrame;
+    if (frame >= header.frameCount) {
+        frame = scheduler.getSpeed() < 0 ? 0 : header.frameCount - 1;
+    }
+    return scheduler.frameToMillis(frame);
+}
+
+void VideoPlayer::scrub(uint32_t frameNumber) {
+    if (!isValid) {
+        return;
+    }
+    if (frameNumber >= header.frameCount) {
+        frameNumber = header.frameCount - 1;
+    }
+    
+    if (!scrubbing) {
+        state = PLAYBACK_IDLE;
+        scrubbing = true;
+        syncAudio(frameNumber);
+    }
+    scrubTarget = frameNumber;
+    scrubPending = true;
+}
+
+bool VideoPlayer::endScrub() {
+    if (!scrubbing) {
+        return false;
+    }
+    return seek(scrubTarget);
+}
+
+// Prefers frames that are cheap to read and decode, nearest the target among
+// equals, staying inside the cached index block so choosing costs at most the
+// one read that brings in the target.
+uint32_t VideoPlayer::pickScrubFrame(uint32_t target) {
+    if (!isIndexCached(target) && !loadIndexCache(target)) {
+        return target;
+    }
+    
+    uint32_t first = target > indexCacheStart + SCRUB_RADIUS ? target - SCRUB_RADIUS : indexCacheStart;
+    uint32_t last = min(target + SCRUB_RADIUS, indexCacheStart + indexCacheSize - 1);
+    
+    uint32_t best = target;
+    uint64_t bestCost = scrubCost(frameIndexCache[target - indexCacheStart].size);
+    
+    for (uint32_t frame = first; frame <= last; frame++) {
+        uint64_t cost = scrubCost(frameIndexCache[frame - indexCacheStart].size);
+        uint32_t distance = frame > target ? frame - target : target - frame;
+        uint32_t bestDistance = best > target ? best - target : target - best;
+        
+        if (cost < bestCost || (cost == bestCost && distance < bestDistance)) {
+            best = frame;
+            bestCost = cost;
+        }
+    }
+    
+    return best;
+}
+
+void VideoPlayer::setFrameCache(FrameCache* cache) {
+    cancelPrefill();
+    frameCache = cache;
+    attachCache();
+}
+
+// Identifies a clip by its header and first index block, so reopening the
+// same file (e.g. a one-entry looping playlist) keeps its cached frames.
+uint32_t VideoPlayer::computeClipKey() const {
+    uint32_t hash = 2166136261u;
+    const uint8_t* bytes = (const uint8_t*)&header;
+    
+    for (size_t i = 0; i < sizeof(VideoHeader); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    if (indexCacheStart == 0) {
+        bytes = (const uint8_t*)frameIndexCache;
+        for (size_t i = 0; i < indexCacheSize * sizeof(FrameIndexEntry); i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+void VideoPlayer::attachCache() {
+    if (frameCache) {
+        frameCache->setClip(clipKey);
+    }
+}
+
+void VideoPlayer::cacheFrame(uint32_t frameNumber, const FrameIndexEntry& entry, const uint8_t* data) {
+    if (frameCache && !source->isMemoryMapped() && frameCache->wants(frameNumber)) {
+        frameCache->insert(frameNumber, data, entry.size);
+    }
+}
+
+bool VideoPlayer::readIndexEntry(uint32_t frameNumber, FrameIndexEntry& entry) {
+    if (isIndexCached(frameNumber)) {
+        entry = frameIndexCache[frameNumber - indexCacheStart];
+    } else if (!source->read((uint8_t*)&entry, sizeof(entry), header.indexOffset + frameNumber * sizeof(FrameIndexEntry))) {
+        return false;
+    }
+    entry.size &= ~VID_INDEX_FLAGS;
+    return true;
+}
+
+// Reads one chunk of the next uncached pinned frame into the cache, but only
+// when the chunk is expected to finish well before the deadline (estimated
+// from the last frame read). The index block is left alone so the playback
+// lookups stay cached.
+// Returns false when there was nothing to do in the time remaining.
+bool VideoPlayer::prefillStep(uint32_t remainingMicros) {
+    if (!frameCache || source->isMemoryMapped()) {
+        return false;
+    }
+    
+    if (!fillBuffer) {
+        uint32_t frame = frameCache->nextUncachedPinned(header.frameCount);
+        if (frame == FrameCache::NO_FRAME) {
+            return false;
+        }
+        
+        source->setTimingTag(frame);
+        if (!readIndexEntry(frame, fillEntry) || fillEntry.size > compressedCapacity) {
+            return false;
+        }
+        fillBuffer = frameCache->reserve(frame, fillEntry.size);
+        fillFrame = frame;
+        fillPosition = 0;
+        return true;
+    }
+    
+    uint32_t position = fillEntry.offset + fillPosition;
+    uint32_t end = chunkEnd(position, fillEntry.offset + fillEntry.size);
+    uint32_t estimate = lastReadBytes ? (uint32_t)((uint64_t)lastReadMicros * (end - position) / lastReadBytes) : 0;
+    
+    if (!lastReadBytes || remainingMicros < 2 * estimate) {
+        return false;
+    }
+    
+    source->setTimingTag(fillFrame);
+    if (end > position && !source->read(fillBuffer + fillPosition, end - position, position)) {
+        cancelPrefill();
+        return true;
+    }
+    
+    fillPosition += end - position;
+    if (fillPosition >= fillEntry.size) {
+        frameCache->commit(fillFrame, true);
+        fillBuffer = nullptr;
+    }
+    return true;
+}
+
+void VideoPlayer::cancelPrefill() {
+    if (fillBuffer) {
+        frameCache->release(fillFrame);
+        fillBuffer = nullptr;
+    }
+}
+
+// scheduler.next(), recording how many frames the late policy jumped over.
+// When LATE_SLOW_DOWN moves the clock back, the sound restarts with the frame.
+uint32_t VideoPlayer::nextScheduledFrame(bool& display) {
+    const FrameSchedulerStats& stats = scheduler.getStats();
+    uint32_t skippedBefore = stats.skipped;
+    uint32_t rebasedBefore = stats.rebased;
+    uint32_t frame = scheduler.next(clockMicros(), display);
+    
+    if (stats.rebased != rebasedBefore) {
+        syncAudio(frame);
+    }
+    if (stats.skipped != skippedBefore) {
+        PIPELINE_EVENT(STAGE_SKIP, frame, 0, micros(), stats.skipped - skippedBefore);
+    }
+    return frame;
+}
+
+uint32_t VideoPlayer::upcomingFrame() const {
+    uint32_t frame = scheduler.getNextFrame();
+    if (frame >= header.frameCount && looping) {
+        frame = scheduler.getSpeed() < 0 ? header.frameCount - 1 : 0;
+    }
+    return frame;
+}
+
+// In loop mode, continues from the other end of the clip on the same clock.
+bool VideoPlayer::wrapLoop() {
+    if (!looping) {
+        return false;
+    }
+    
+    scheduler.start(scheduler.nextDeadline(), scheduler.getSpeed() < 0 ? header.frameCount - 1 : 0);
+    if (audioTrack && audioTrack->isActive()) {
+        audioTrack->rewind();
+    }
+    loopCount++;
+    return true;
+}
+
+bool VideoPlayer::getIdleUntil(uint32_t& wakeMicros) {
+    if (transferPending) {
+        wakeMicros = micros() + TRANSFER_SLEEP_MICROS;
+        return true;
+    }
+    if (!isValid || state != PLAYBACK_WAIT || !waitIdle || scrubbing) {
+        return false;
+    }
+    
+    int32_t remaining = (int32_t)(currentDeadline - clockMicros());
+    if (remaining <= 0) {
+        return false;
+    }
+    // Wake in time to decode more audio even if the sink raises no interrupt.
+    if (audioTrack) {
+        remaining = min((uint32_t)remaining, audioTrack->bufferedMicros() / 2);
+    }
+    wakeMicros = micros() + remaining;
+    return true;
+}
+
+// Largest compressed size among the next POWER_LOOKAHEAD_FRAMES frames the
+// scheduler will show, as far as their index entries are cached.
+uint32_t VideoPlayer::upcomingFrameBytes() const {
+    uint32_t bytes = currentEntry.size;
+    uint32_t step = scheduler.getStride();
+    uint32_t frame = currentFrame;
+    
+    for (uint32_t i = 1; i < POWER_LOOKAHEAD_FRAMES; i++) {
+        frame = scheduler.getSpeed() < 0 ? frame - step : frame + step;
+        if (!isIndexCached(frame)) {
+            break;
+        }
+        bytes = max(bytes, frameIndexCache[frame - indexCacheStart].size & ~VID_INDEX_FLAGS);
+    }
+    return bytes;
+}
+
+void VideoPlayer::setAudioTrack(AudioTrack* track) {
+    if (audioTrack && audioTrack != track) {
+        audioTrack->close();
+    }
+    audioTrack = track;
+    if (isValid) {
+        openAudio();
+        syncAudio(state == PLAYBACK_IDLE ? scheduler.getNextFrame() : currentFrame);
+    }
+}
+
+// Points the track at this clip's audio, or closes it for a silent clip so
+// its clock runs free.
+void VideoPlayer::openAudio() {
+    if (!audioTrack) {
+        return;
+    }
+    
+    bool ntsc = (header.flags & VID_FLAG_NTSC_RATE) != 0;
+    if (!(header.flags & VID_FLAG_AUDIO) ||
+        !audioTrack->open(audioHeader, ntsc ? header.fps * 1000 : header.fps, ntsc ? 1001 : 1)) {
+        audioTrack->close();
+    }
+}
+
+// Audio plays at normal speed forwards only, restarting at the frame whenever
+// playback returns to that.
+void VideoPlayer::syncAudio(uint32_t frameNumber) {
+    if (!audioTrack || !audioTrack->isOpen()) {
+        return;
+    }
+    
+    if (scheduler.getSpeed() == 100 && !scrubbing && frameNumber < header.frameCount) {
+        audioTrack->restart(frameNumber, scheduler.deadline(frameNumber));
+    } else {
+        audioTrack->stop();
+    }
+}
+
+// True while the track still needs the audio of chunks before this frame:
+// frames the late policy skipped or, after a restart, the lead-in chunks that
+// carry the frame's own audio. A wider gap (the clock ran on without audio)
+// restarts the sound at the frame instead.
+bool VideoPlayer::audioBehind(uint32_t frameNumber) {
+    if (!audioTrack || !audioTrack->isActive() || !(header.flags & VID_FLAG_AUDIO)) {
+        return false;
+    }
+    
+    uint32_t chunk = audioTrack->nextChunk();
+    if (chunk > frameNumber || frameNumber - chunk > (uint32_t)audioHeader.leadFrames + 1) {
+        audioTrack->restart(frameNumber, scheduler.deadline(frameNumber));
+        chunk = audioTrack->nextChunk();
+    }
+    return chunk < frameNumber;
+}
+
+// Reads only the audio at the start of the next chunk the track expects, one
+// small read per call; the frame itself is not needed.
+bool VideoPlayer::stepAudio() {
+    uint32_t chunk = audioTrack->nextChunk();
+    FrameIndexEntry entry;
+    const uint8_t* data = nullptr;
+    
+    source->setTimingTag(chunk);
+    if (!readIndexEntry(chunk, entry)) {
+        return false;
+    }
+    if (frameCache && frameCache->contains(chunk)) {
+        data = frameCache->lookup(chunk);
+    }
+    if (!data) {
+        PIPELINE_TIMED(STAGE_READ, chunk, 0);
+        entry.size = min(entry.size, (uint32_t)(sizeof(AudioChunkHeader) + audioHeader.maxChunkBytes));
+        data = source->getFrame(entry, compressedBuffer, readBufferSize);
+        if (!data) {
+            return false;
+        }
+    }
+    return splitChunk(chunk, entry, data, true);
+}
@@ -2,64 +2,377 @@
 #define VIDEO_PLAYER_H
 
 #include <Arduino.h>
-#include "SDFileReader.h"
+#include "VideoSource.h"
 #include "DisplayManager.h"
 #include "RLEDecoder.h"
+#include "TileDecoder.h"
+#include "RectDecoder.h"
+#include "SpanDecoder.h"
+#include "RowDecoder.h"
+#include "VideoFormat.h"
+#include "FrameScheduler.h"
+#include "FrameCache.h"
+#include "PipelineTelemetry.h"
+#include "MemoryPlanner.h"
+#include "AudioTrack.h"
+#include "PowerManager.h"
 
-#pragma pack(push, 1)
-struct VideoHeader {
-    char magic[4];
-    uint32_t frameCount;
-    uint16_t frameWidth;
-    uint16_t frameHeight;
-    uint8_t fps;
-    uint8_t compression;
-    uint8_t reserved[2];    
-    uint32_t indexOffset;
+// Steps of the non-blocking playback state machine; each update() call runs one.
+enum PlaybackState : uint8_t {
+    PLAYBACK_IDLE = 0,      // pick the next frame from the scheduler
+    PLAYBACK_READ,          // read one chunk of compressed data
+    PLAYBACK_WAIT,          // poll for the frame's deadline
+    PLAYBACK_DECODE,        // decode one segment
+    PLAYBACK_TRANSMIT,      // send one segment to the display
+    PLAYBACK_AUDIO,         // read the audio of one chunk the scheduler skipped
+    PLAYBACK_STATE_COUNT
 };
 
-struct FrameIndexEntry {
-    uint32_t offset;
-    uint32_t size;
+struct PlaybackSliceStats {
+    uint32_t count[PLAYBACK_STATE_COUNT];
+    uint32_t maxMicros[PLAYBACK_STATE_COUNT];
+    uint64_t totalMicros[PLAYBACK_STATE_COUNT];
+    uint32_t repeatsSkipped;    // repeat frames whose picture was already on screen
+    uint32_t repeatsDrawn;      // repeat frames that needed the frame they repeat drawn
+    uint32_t deltaBaseFrames;   // frames drawn only as the base of a delta frame
 };
-#pragma pack(pop)
 
 class VideoPlayer {
 private:
-    SDFileReader* sdReader;
+    VideoSource* source;
     DisplayManager* displayManager;
-    const char* videoPath;
     VideoHeader header;
+    AudioHeader audioHeader;
+    RowDictionaryHeader rowDictionaryHeader;
     bool isValid;
     
+    VideoSource* nextSource;
+    VideoHeader nextHeader;
+    AudioHeader nextAudioHeader;
+    RowDictionaryHeader nextRowDictionaryHeader;
+    bool nextReady;
+    FrameIndexEntry* nextIndexCache;
+    uint32_t nextIndexCacheSize;
+    
+    uint8_t* arena;
+    size_t arenaCapacity;
+    bool ownsArena;
+    MemoryPlanner* planner;
+    MemoryPlanner arenaPlanner;
+    
     uint8_t* compressedBuffer;
+    uint32_t compressedCapacity;
+    size_t readBufferSize;
     uint16_t* segmentBuffer;
     uint32_t segmentSize;
     uint32_t rowsPerSegment;
+    uint16_t* rowDictionary;
     
     FrameIndexEntry* frameIndexCache;
     uint32_t indexCacheStart;
     uint32_t indexCacheSize;
-    static const uint32_t INDEX_CACHE_FRAMES = 50;
+    // One block of 64 entries is 512 bytes; blocks start at multiples of 64
+    // frames so forward and reverse play both miss once per block.
+    static const uint32_t INDEX_CACHE_FRAMES = 64;
+    static const uint32_t SCRUB_RADIUS = 4;
+    static const uint32_t SEGMENT_BUFFER_BYTES = 100 * 1024;
+    static const uint32_t DMA_ALIGNMENT = 32;
+    static const uint16_t RECT_BATCH = 32;
+    
+    FrameScheduler scheduler;
+    
+    PlaybackState state;
+    uint16_t drawX;
+    uint16_t drawY;
+    uint32_t currentFrame;
+    bool currentDisplay;
+    uint32_t currentDeadline;
+    bool scrubbing;
+    bool scrubPending;
+    uint32_t scrubTarget;
+    FrameIndexEntry currentEntry;
+    const uint8_t* currentData;
+    uint32_t readPosition;
+    uint32_t readChunkBytes;
+    uint32_t currentSegment;
+    uint32_t currentSegmentRows;
+    uint32_t segmentRowLimit;
+    RLECursor cursor;
+    SpanCursor spanCursor;
+    RowCursor rowCursor;
+    TileLayout tileLayout;
+    TileCursor tileCursor;
+    TileInfo tileRow[TileDecoder::MAX_COLUMNS];
+    RectCursor rectCursor;
+    RectInfo rectBatch[RECT_BATCH];
+    uint16_t rectCount;
+    
+    // Decode and transmit steps of each compression type, which the frame
+    // being drawn selects. Codecs with fullRows fill the segment buffer with
+    // whole rows, so a whole frame of them goes out as one transfer.
+    struct FrameCodec {
+        uint32_t (VideoPlayer::*decode)(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+        void (VideoPlayer::*transmit)(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y);
+        bool fullRows;
+    };
+    static const FrameCodec FRAME_CODECS[VID_COMPRESSION_TYPES];
+    uint8_t frameCodec;
+    PlaybackSliceStats sliceStats;
     
-    bool loadIndexCache(uint32_t startFrame);
+    FrameCache* frameCache;
+    uint32_t clipKey;
+    bool looping;
+    uint32_t loopCount;
+    uint32_t readStartMicros;
+    uint32_t lastReadMicros;
+    uint32_t lastReadBytes;
+    uint32_t fillFrame;
+    FrameIndexEntry fillEntry;
+    uint8_t* fillBuffer;
+    uint32_t fillPosition;
+    bool transferPending;
+    uint32_t transferStartMicros;
+    AudioTrack* audioTrack;
+    PowerManager* powerManager;
+    uint32_t frameWorkMicros;
+    uint32_t transferMicros;
+    uint32_t presentLateMicros;
+    bool waitIdle;
+    static const uint32_t POWER_LOOKAHEAD_FRAMES = 4;
+    static const uint32_t TRANSFER_SLEEP_MICROS = 250;
+    static const uint32_t DEFAULT_READ_CHUNK_BYTES = 16 * 1024;
+    static const uint32_t READ_CHUNK_ALIGNMENT = 512;
+    static const uint32_t MIN_BENCHMARK_ROWS = 8;
+    static const uint32_t NO_FRAME = 0xFFFFFFFF;
+    
+    uint32_t readFrame;
+    bool currentRepeat;
+    uint32_t shownFrame;
+    uint16_t shownX;
+    uint16_t shownY;
+    uint32_t repeatFrame;
+    uint32_t repeatFrameSource;
+    uint32_t deltaTarget;
+#if PIPELINE_TELEMETRY
+    PipelineTelemetry telemetry;
+#endif
+    
+    bool openVideo(VideoSource* src, VideoHeader& hdr, AudioHeader& audio, RowDictionaryHeader& rows);
+    bool allocateBuffers();
+    bool loadRowDictionary();
+    bool loadIndexCache(uint32_t frameNumber);
+    bool isIndexCached(uint32_t frameNumber) const { return frameNumber - indexCacheStart < indexCacheSize; }
     void cleanupBuffers();
+    void applyFrameRate();
+    
+    bool lookupFrame(uint32_t frameNumber, FrameIndexEntry& entry, bool& repeat);
+    bool loadFrame(uint32_t frameNumber, FrameIndexEntry& entry, const uint8_t*& data, bool queueAudio);
+    uint32_t repeatSource(uint32_t frameNumber);
+    void markShown(uint16_t x, uint16_t y);
+    bool fetchFrame(uint32_t frameNumber, FrameIndexEntry& entry, const uint8_t*& data, bool queueAudio = false);
+    bool splitChunk(uint32_t frameNumber, FrameIndexEntry& entry, const uint8_t*& data, bool queueAudio);
+    bool selectCodec(FrameIndexEntry& entry, const uint8_t*& data);
+    bool drawFrame(const FrameIndexEntry& entry, const uint8_t* data, uint16_t x, uint16_t y);
+    uint32_t decodeSegment(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+    uint32_t segmentRowCount(uint32_t segment) const;
+    uint32_t decodeRLESegment(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+    uint32_t decodeRawSegment(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+    uint32_t decodeSpanSegment(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+    uint32_t decodeRowSegment(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+    uint32_t decodeTileRow(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+    uint32_t decodeRectBatch(const FrameIndexEntry& entry, const uint8_t* data, uint32_t segment);
+    void transmitSegment(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y);
+    void transmitRows(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y);
+    void transmitTileRow(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y);
+    void transmitRects(uint32_t segment, uint32_t rows, uint16_t x, uint16_t y);
+    static bool codecSupported(const VideoHeader& hdr, uint8_t codec);
+    bool usesCodec(uint8_t codec) const {
+        return header.compression == codec ||
+               (header.compression == VID_COMPRESSION_PER_FRAME && codecSupported(header, codec));
+    }
+    bool isTiled() const { return frameCodec == VID_COMPRESSION_TILES; }
+    bool isRects() const { return frameCodec == VID_COMPRESSION_RECTS; }
+    bool sendsWholeFrame() const { return isWholeFrame() && FRAME_CODECS[frameCodec].fullRows; }
+    uint32_t segmentRows() const { return isTiled() ? tileLayout.tileHeight : rowsPerSegment; }
+    bool moreSegments(const FrameIndexEntry& entry, uint32_t segment) const {
+        return isRects() ? segment == 0 || !rectCursor.atEnd(entry.size) : segment * segmentRows() < header.frameHeight;
+    }
+    bool indexFlags(uint32_t frameNumber, uint32_t& flags);
+    uint32_t deltaStart(uint32_t frameNumber, uint16_t x, uint16_t y);
+    bool prepareDelta(uint32_t frameNumber, uint16_t x, uint16_t y);
+    bool nextDeltaFrame(uint32_t target);
+    void waitUntil(uint32_t deadlineMicros);
+    uint32_t clockMicros() { return audioTrack ? audioTrack->clockMicros() : micros(); }
+    
+    bool step();
+    bool stepRead();
+    bool startRepeat();
+    bool startDecode();
+    bool finishTransmit();
+    uint32_t chunkEnd(uint32_t position, uint32_t end) const;
+    bool pollTransfer();
+    bool stepAudio();
+    bool audioBehind(uint32_t frameNumber);
+    void openAudio();
+    void syncAudio(uint32_t frameNumber);
+    bool readIndexEntry(uint32_t frameNumber, FrameIndexEntry& entry);
+    uint32_t computeClipKey() const;
+    void attachCache();
+    void cacheFrame(uint32_t frameNumber, const FrameIndexEntry& entry, const uint8_t* data);
+    bool prefillStep(uint32_t remainingMicros);
+    void cancelPrefill();
+    uint32_t nextScheduledFrame(bool& display);
+    uint32_t upcomingFrame() const;
+    uint32_t upcomingFrameBytes() const;
+    bool wrapLoop();
+    uint32_t pickScrubFrame(uint32_t target);
     
 public:
-    VideoPlayer(SDFileReader* reader, DisplayManager* display, const char* path);
+    VideoPlayer(VideoSource* videoSource, DisplayManager* display);
     ~VideoPlayer();
     
+    void setArena(uint8_t* storage, size_t size);
+    // Places buffers in the planner's pools instead of one arena: index blocks
+    // in fast memory, the read buffer in DMA memory and the segment buffer in
+    // fast memory with as many rows as the space left allows. begin() prints
+    // the resulting memory map.
+    void setMemoryPlanner(MemoryPlanner* memoryPlanner);
+    void setSource(VideoSource* videoSource) { if (!isValid) source = videoSource; }
+    
     bool begin();
     void end();
     
+    // Gapless transitions: preload() opens the next source (e.g. an SD file on
+    // the spare file slot) and reads its header and first index block while the
+    // current video is still playing; switchToPreloaded() then swaps to it,
+    // keeping all buffers when the frame geometry matches.
+    bool preload(VideoSource* next);
+    bool switchToPreloaded();
+    void cancelPreload();
+    bool isPreloaded() const { return nextReady; }
+    
+    static uint32_t maxCompressedFrameSize(const VideoHeader& hdr, const AudioHeader* audio = nullptr);
+    static size_t readBufferSizeFor(const VideoHeader& hdr, const VideoSource* src, const AudioHeader* audio = nullptr);
+    static size_t requiredArenaSize(const VideoHeader& hdr, const VideoSource* src, const AudioHeader* audio = nullptr,
+                                    const RowDictionaryHeader* dictionary = nullptr);
+    
     bool playFrameSegmented(uint32_t frameNumber, uint16_t x, uint16_t y);
     
+    // Timed playback. presentAt() reads the frame, waits for the deadline (a
+    // micros() value, or the audio clock with a track attached) and then
+    // decodes and draws it. playScheduled() asks the
+    // scheduler which frame is due, applying its late policy, and presents it;
+    // after a gapless switch the clock continues without a gap.
+    bool presentAt(uint32_t frameNumber, uint32_t deadlineMicros, uint16_t x, uint16_t y);
+    void startClock();
+    bool playScheduled(uint16_t x, uint16_t y);
+    bool isFinished() const { return !scrubbing && !looping && !transferPending && state == PLAYBACK_IDLE && scheduler.getNextFrame() >= header.frameCount; }
+    uint32_t getNextFrame() const { return scheduler.getNextFrame(); }
+    FrameScheduler& getScheduler() { return scheduler; }
+    
+    // Random access. seek() abandons the frame in progress and continues from
+    // the given frame on a fresh clock; a frame outside the cached index block
+    // costs one index read. Speed is a percentage, negative for reverse.
+    bool seek(uint32_t frameNumber);
+    bool seekTime(uint32_t milliseconds);
+    bool setSpeed(int16_t percent);
+    int16_t getSpeed() const { return scheduler.getSpeed(); }
+    uint32_t getPositionMillis() const;
+    
+    // While scrubbing, update() shows the cheapest frame (the smallest
+    // self-contained one, else the nearest) within SCRUB_RADIUS of the latest
+    // target as soon as it can, with the clock stopped. endScrub() shows the exact target and resumes from it.
+    void scrub(uint32_t frameNumber);
+    bool endScrub();
+    bool isScrubbing() const { return scrubbing; }
+    
+    // Compressed frames are looked up in the cache before the source is read,
+    // and frames the cache admits are copied in after a read. While waiting
+    // for a deadline, update() also reads uncached pinned frames into it. In
+    // loop mode the clip wraps to its start on the same clock without
+    // reopening the file; pinning the first frames hides the jump back.
+    void setFrameCache(FrameCache* cache);
+    FrameCache* getFrameCache() const { return frameCache; }
+    void setLooping(bool enabled) { looping = enabled; }
+    bool isLooping() const { return looping; }
+    uint32_t getLoopCount() const { return loopCount; }
+    
+    // Cooperative playback: each update() call does one bounded slice of work
+    // (one read chunk, one segment decode or one segment transfer) and returns
+    // at once while waiting for a deadline, so the caller's loop keeps running.
+    // A slice's worst case is set by the read chunk size and the segment height.
+    //
+    // Frames stored as repeats (VID_FLAG_REPEATS) keep their deadline but are
+    // neither read (beyond their audio), decoded nor sent while the picture
+    // they repeat is the last one drawn at the same position; otherwise that
+    // frame is read and drawn in their place.
+    //
+    // Tiled files (compression 2) are decoded and sent a row of tiles per
+    // segment: unchanged tiles are skipped and solid ones sent as rectangle
+    // fills. A delta frame whose base is not on screen at the position (after
+    // a seek, skipped frames or a move) has the frames it builds on drawn
+    // first, each read, decoded and sent in slices of its own without
+    // waiting for a deadline.
+    //
+    // Rectangle files (compression 3) need no segment buffer: a segment is a
+    // batch of up to RECT_BATCH rectangles, sent as fills while the bus stays
+    // held, so decoding costs per shape rather than per pixel.
+    //
+    // Row-dictionary files (compression 5) keep the dictionary resident in
+    // fast memory, in wire order, for as long as the clip plays; rows that
+    // refer to it are copied into the segment buffer instead of decoded.
+    //
+    // Per-frame files (compression 7) may mix all of these, and raw frames
+    // (compression 6), frame by frame; each frame's tag selects its decode
+    // and transmit steps. They always get a segment buffer, tall enough for
+    // a row of tiles when the header gives a tile shape.
+    bool update();
+    void setPosition(uint16_t x, uint16_t y) { drawX = x; drawY = y; }
+    void setReadChunkBytes(uint32_t bytes);
+    bool setSegmentRows(uint32_t rows);
+    PlaybackState getState() const { return state; }
+    const PlaybackSliceStats& getSliceStats() const { return sliceStats; }
+    void resetSliceStats();
+    void printSliceStats() const;
+    void benchmarkFrameModes(uint32_t frames);
+    
+    // Clips with an audio track play it through the attached track, whose
+    // clock then paces the frames. Audio plays at normal speed forwards only;
+    // it stops while scrubbing or at other speeds and restarts in sync after
+    // seeks and speed changes. Frames the scheduler skips still have their
+    // audio read (a few hundred bytes each) so the sound does not drop out.
+    void setAudioTrack(AudioTrack* track);
+    AudioTrack* getAudioTrack() const { return audioTrack; }
+    bool hasAudio() const { return (header.flags & VID_FLAG_AUDIO) != 0; }
+    
+    // Between update() calls the caller may sleep until getIdleUntil()'s
+    // micros() value: it returns true only while the player waits for a
+    // deadline with the index and frame cache work done, or for a background
+    // transfer whose completion interrupt ends the sleep. Blocking playback
+    // sleeps through the manager on its own. With clock scaling on, frames
+    // played through update() report their cost to the manager, and the
+    // largest of the next POWER_LOOKAHEAD_FRAMES cached index entries sets
+    // the clock ahead of heavy frames.
+    void setPowerManager(PowerManager* manager) { powerManager = manager; }
+    PowerManager* getPowerManager() const { return powerManager; }
+    bool getIdleUntil(uint32_t& wakeMicros);
+#if PIPELINE_TELEMETRY
+    // Per-stage timing records for each frame, streamed as binary over Serial
+    // while playback waits (see vid/analyze_telemetry.py). Off by default.
+    PipelineTelemetry& getTelemetry() { return telemetry; }
+#endif
+    
+    VideoSource* getSource() const { return source; }
     uint16_t getWidth() const { return header.frameWidth; }
     uint16_t getHeight() const { return header.frameHeight; }
     uint16_t getFPS() const { return header.fps; }
     uint32_t getFrameCount() const { return header.frameCount; }
     bool isReady() const { return isValid; }
+    bool isSectorAligned() const { return (header.flags & VID_FLAG_SECTOR_ALIGNED) != 0; }
+    bool isNTSCRate() const { return (header.flags & VID_FLAG_NTSC_RATE) != 0; }
     uint32_t getSegmentRows() const { return rowsPerSegment; }
+    bool isWholeFrame() const { return rowsPerSegment >= header.frameHeight; }
+    size_t getArenaSize() const { return arenaCapacity; }
 };
 
-#endif
\ No newline at end of file
+#endif
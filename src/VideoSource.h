@@ -0,0 +1,38 @@
+#ifndef VIDEO_SOURCE_H
+#define VIDEO_SOURCE_H
+
+#include <Arduino.h>
+#include "VideoFormat.h"
+
+// Where VideoPlayer gets its bytes from. Sources that live in addressable
+// memory hand out pointers into themselves; the rest copy into the scratch
+// buffer the player provides.
+class VideoSource {
+public:
+    virtual ~VideoSource() {}
+    
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    
+    // Copies exactly bytesToRead bytes at offset into buffer.
+    virtual bool read(uint8_t* buffer, size_t bytesToRead, size_t offset) = 0;
+    
+    // Returns a pointer to the frame's compressed bytes, or nullptr on error.
+    // `scratch` (scratchSize bytes, cache-line aligned) may be used as the
+    // destination; memory-mapped sources ignore it.
+    virtual const uint8_t* getFrame(const FrameIndexEntry& entry, uint8_t* scratch, size_t scratchSize) = 0;
+    
+    // True when getFrame never copies, so the player needs no read buffer.
+    virtual bool isMemoryMapped() const { return false; }
+    
+    // Scratch bytes getFrame needs beyond the frame itself (e.g. sector rounding).
+    virtual size_t getReadSlack() const { return 0; }
+    
+    // Called once the header is known so the source can pick a read strategy.
+    virtual void setLayoutFlags(uint8_t flags) { (void)flags; }
+    
+    // Tags subsequent I/O with the frame being read, for instrumentation.
+    virtual void setTimingTag(uint32_t tag) { (void)tag; }
+};
+
+#endif
@@ -3,14 +3,173 @@
 #include "DisplayManager.h"
 #include "SDFileReader.h"
 #include "VideoPlayer.h"
+#include "SDVideoSource.h"
+#include "MemoryVideoSource.h"
+#include "AllocCounter.h"
+#include "Playlist.h"
+#include "FrameCache.h"
+#include "Profiler.h"
+#include "MemoryPlanner.h"
+#include "AudioTrack.h"
+#include "PwmAudioSink.h"
+#include "PowerManager.h"
 
 #define PIN_SPI_CS    4
 #define PIN_SPI_DC    5
 #define PIN_BACKLIGHT 3
 #define PIN_SD_CS     10
+#define PIN_AUDIO     2
+
+#define PLAYLIST_FILE   "/playlist.txt"
+#define VIDEO_DIRECTORY "/"
+#define DEFAULT_VIDEO   "/bad_apple_rle.vid"
+#define PRELOAD_SECONDS 2
+#define LOOP_PLAYLIST   false
+#define LATE_POLICY     FrameScheduler::LATE_SKIP_DECODE
+#define SEEK_STEP_MS    5000
+#define BENCH_FRAMES    60
+#define CLOCK_SCALING   true
+
+// Compressed frames kept in RAM2. A one-clip looping playlist plays in loop
+// mode with the start of the clip and the frames before the loop point pinned.
+#define FRAME_CACHE_KB        192
+#define CACHE_LEAD_SECONDS    2
+#define CACHE_BOUNDARY_FRAMES 8
+
+// Player buffers: index blocks and the segment buffer in DTCM (ordinary
+// globals), the SD read buffer in RAM2. The segment buffer shrinks to what is
+// left of the DTCM pool once the index blocks are placed.
+#define FAST_MEMORY_KB 104
+#define DMA_MEMORY_KB  160
+
+// Compressed audio chunks and the two decoded blocks the PWM interrupt plays
+// from, in DTCM. Must hold (lead frames + 2) of the largest chunks: 48 KB fits
+// 22 kHz PCM with the converter's default lead, ADPCM needs a quarter of that.
+// Clips whose audio does not fit play silently.
+#define AUDIO_BUFFER_KB 48
 
 DisplayManager displayManager(PIN_SPI_CS, PIN_SPI_DC, PIN_BACKLIGHT);
 SDFileReader sdReader(PIN_SD_CS);
+Playlist playlist;
+FrameCache frameCache;
+DMAMEM uint8_t frameCacheStorage[FRAME_CACHE_KB * 1024];
+MemoryPlanner memoryPlanner;
+uint8_t fastMemory[FAST_MEMORY_KB * 1024] __attribute__((aligned(32)));
+DMAMEM uint8_t dmaMemory[DMA_MEMORY_KB * 1024];
+uint8_t audioMemory[AUDIO_BUFFER_KB * 1024] __attribute__((aligned(4)));
+AudioTrack audioTrack;
+// The carrier's buzzer; shares a PWM submodule with the backlight, so both
+// run at the audio carrier frequency.
+PwmAudioSink audioSink(PIN_AUDIO);
+PowerManager powerManager;
+
+// Two SD sources on separate file slots: one plays while the other preloads.
+SDVideoSource sdSources[2] = { SDVideoSource(&sdReader, 0), SDVideoSource(&sdReader, 1) };
+
+#ifdef EMBEDDED_VIDEO
+// Linked into program flash by vid/embed_video.py (see the teensymm_embedded environment).
+extern "C" const uint8_t embedded_video[];
+extern "C" const uint8_t embedded_video_end[];
+MemoryVideoSource embeddedSource(embedded_video, embedded_video_end - embedded_video);
+#endif
+
+// Single-character commands over Serial:
+//   t - dump SD timing statistics (CSV)
+//   r - reset SD, frame scheduling, cache, audio, power and profiling statistics
+//   s - dump frame scheduling, update() slice, audio and power statistics (CSV)
+//   + / - - double / halve playback speed (0.25x to 8x)
+//   v - reverse playback direction
+//   < / > - seek SEEK_STEP_MS back / forward
+//   c - dump frame cache statistics (CSV)
+//   z - dump profiling zones (CSV)
+//   b - benchmark whole-frame and segmented drawing on BENCH_FRAMES frames (CSV)
+//   p - start / stop the binary pipeline telemetry stream
+void serviceSerialCommands(VideoPlayer* video) {
+    while (Serial.available() > 0) {
+        switch (Serial.read()) {
+            case 't':
+                sdReader.printTimingSummary();
+                break;
+            case 'r':
+                sdReader.resetTimingStats();
+                frameCache.resetStats();
+                audioTrack.resetStats();
+                powerManager.resetStats();
+                Profiler::reset();
+                if (video) {
+                    video->getScheduler().resetStats();
+                    video->resetSliceStats();
+                }
+                break;
+            case 'c':
+                frameCache.printStats();
+                break;
+            case 'z':
+                Profiler::print();
+                break;
+            case 'b':
+                if (video) {
+                    video->benchmarkFrameModes(BENCH_FRAMES);
+                }
+                break;
+            case 's':
+                if (video) {
+                    video->getScheduler().printStats();
+                    video->printSliceStats();
+                    audioTrack.printStats();
+                    powerManager.printStats();
+                }
+                break;
+            case '+':
+                if (video) {
+                    video->setSpeed(video->getSpeed() * 2);
+                }
+                break;
+            case '-':
+                if (video) {
+                    video->setSpeed(video->getSpeed() / 2);
+                }
+                break;
+            case 'v':
+                if (video) {
+                    video->setSpeed(-video->getSpeed());
+                }
+                break;
+            case '<':
+                if (video) {
+                    uint32_t position = video->getPositionMillis();
+                    video->seekTime(position > SEEK_STEP_MS ? position - SEEK_STEP_MS : 0);
+                }
+                break;
+            case '>':
+                if (video) {
+                    video->seekTime(video->getPositionMillis() + SEEK_STEP_MS);
+                }
+                break;
+#if PIPELINE_TELEMETRY
+            case 'p':
+                if (video) {
+                    PipelineTelemetry& telemetry = video->getTelemetry();
+                    telemetry.setEnabled(!telemetry.isEnabled());
+                }
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+}
+
+void buildPlaylist() {
+    playlist.clear();
+    if (playlist.loadFromFile(&sdReader, PLAYLIST_FILE) > 0) {
+        return;
+    }
+    if (playlist.scanDirectory(&sdReader, VIDEO_DIRECTORY) > 0) {
+        return;
+    }
+    playlist.add(DEFAULT_VIDEO);
+}
 
 void playVideo() {
     if (!sdReader.begin()) {
@@ -21,38 +180,137 @@ void playVideo() {
         return;
     }
     displayManager.clear();
-    VideoPlayer video(&sdReader, &displayManager, "/bad_apple_rle.vid");
-    if (!video.begin()) {
+    
+    memoryPlanner.setPool(MEMORY_FAST, fastMemory, sizeof(fastMemory));
+    memoryPlanner.setPool(MEMORY_DMA, dmaMemory, sizeof(dmaMemory));
+    audioTrack.setStorage(audioMemory, sizeof(audioMemory));
+    audioTrack.setSink(&audioSink);
+    
+    uint8_t entry = 0;
+    uint8_t activeSource = 0;
+#ifdef EMBEDDED_VIDEO
+    VideoPlayer video(&embeddedSource, &displayManager);
+    video.setMemoryPlanner(&memoryPlanner);
+    video.setAudioTrack(&audioTrack);
+    video.setPowerManager(&powerManager);
+    bool started = video.begin();
+#else
+    buildPlaylist();
+    sdSources[activeSource].setPath(playlist.get(entry));
+    VideoPlayer video(&sdSources[activeSource], &displayManager);
+    video.setMemoryPlanner(&memoryPlanner);
+    video.setAudioTrack(&audioTrack);
+    video.setPowerManager(&powerManager);
+    bool started = video.begin();
+    while (!started) {
+        entry = playlist.nextIndex(entry, false);
+        if (entry == Playlist::NO_ENTRY) {
+            break;
+        }
+        sdSources[activeSource].setPath(playlist.get(entry));
+        started = video.begin();
+    }
+#endif
+    if (!started) {
         displayManager.end();
         sdReader.end();
         return;
     }
-    uint16_t frameCount = video.getFrameCount();
-    uint16_t fps = video.getFPS();
     uint16_t videoWidth = video.getWidth();
     uint16_t videoHeight = video.getHeight();
-    const uint32_t frameDelay = 1000 / fps;
     uint16_t x = (240 - videoWidth) / 2;
     uint16_t y = (320 - videoHeight) / 2;
-    uint32_t startTime = millis();
-    uint32_t nextFrameTime = startTime;
     
-    uint32_t frameNum = 0;
-    while (frameNum < frameCount) {
-        nextFrameTime = startTime + (frameNum * frameDelay);
-        displayManager.releaseSPI();
-        bool success = video.playFrameSegmented(frameNum, x, y);
+    // Entry to try preloading next; advanced past entries that fail to open.
+#ifdef EMBEDDED_VIDEO
+    uint8_t preloadEntry = Playlist::NO_ENTRY;
+#else
+    uint8_t preloadEntry = playlist.nextIndex(entry, LOOP_PLAYLIST);
+    
+    frameCache.setStorage(frameCacheStorage, sizeof(frameCacheStorage));
+    video.setFrameCache(&frameCache);
+    
+    if (preloadEntry == entry) {
+        // A single looping clip wraps in place instead of reopening the file.
+        uint32_t frameCount = video.getFrameCount();
+        uint32_t boundary = min((uint32_t)CACHE_BOUNDARY_FRAMES, frameCount);
+        
+        preloadEntry = Playlist::NO_ENTRY;
+        frameCache.setAdmission(FrameCache::ADMIT_PINNED);
+        frameCache.pinRange(0, (uint32_t)video.getFPS() * CACHE_LEAD_SECONDS);
+        frameCache.pinRange(frameCount - boundary, boundary);
+        video.setLooping(true);
+    }
+#endif
+    
+    uint32_t allocationsBefore = AllocCounter::getAllocationCount();
+    
+    video.getScheduler().setLatePolicy(LATE_POLICY);
+    video.setPosition(x, y);
+    powerManager.setClockScaling(CLOCK_SCALING);
+    powerManager.resetStats();
+    video.startClock();
+    
+    while (true) {
+        if (video.isFinished()) {
+            // The player carries the frame clock over, so the first frame of
+            // the next clip lands exactly one frame period after the last one.
+            if (!video.isPreloaded() || !video.switchToPreloaded()) {
+                break;
+            }
+            
+            entry = preloadEntry;
+            activeSource ^= 1;
+            preloadEntry = playlist.nextIndex(entry, LOOP_PLAYLIST);
+            
+            if (video.getWidth() != videoWidth || video.getHeight() != videoHeight) {
+                videoWidth = video.getWidth();
+                videoHeight = video.getHeight();
+                x = (240 - videoWidth) / 2;
+                y = (320 - videoHeight) / 2;
+                video.setPosition(x, y);
+                displayManager.releaseSPI();
+                displayManager.clear();
+            }
+        }
         
-        if (!success) {
+        if (!video.isPreloaded() && preloadEntry != Playlist::NO_ENTRY && 
+            video.getFrameCount() - video.getNextFrame() <= (uint32_t)video.getFPS() * PRELOAD_SECONDS) {
+            SDVideoSource& spare = sdSources[activeSource ^ 1];
+            spare.setPath(playlist.get(preloadEntry));
+            if (!video.preload(&spare)) {
+                preloadEntry = playlist.nextIndex(preloadEntry, LOOP_PLAYLIST);
+            }
+        }
+        
+        // update() returns after one bounded slice of work, so other tasks
+        // can be serviced here between slices.
+        if (!video.update()) {
             break;
         }
-        uint32_t now = millis();
+        serviceSerialCommands(&video);
         
-        if (now < nextFrameTime) {
-            delay(nextFrameTime - now);
+        // Sleep out the rest of the frame; any interrupt (USB, audio, the
+        // systick) wakes the loop early.
+        uint32_t wakeMicros;
+        if (video.getIdleUntil(wakeMicros)) {
+            powerManager.idleUntil(wakeMicros);
         }
-        frameNum++;
     }
+    
+    powerManager.setClockScaling(false);
+    
+    video.getScheduler().printStats();
+    video.printSliceStats();
+    frameCache.printStats();
+    audioTrack.printStats();
+    powerManager.printStats();
+    
+    if (AllocCounter::isEnabled()) {
+        Serial.printf("Heap allocations during playback: %lu\n", 
+                      (unsigned long)(AllocCounter::getAllocationCount() - allocationsBefore));
+    }
+    
     displayManager.end();
     video.end();
     sdReader.end();
@@ -65,5 +323,6 @@ void setup() {
 }
 
 void loop() {
-    delay(1000);
+    serviceSerialCommands(nullptr);
+    delay(10);
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+Analyze the pipeline telemetry stream sent by the player over USB serial
+Usage: python analyze_telemetry.py capture.bin [--trace trace.json] [--late-us 1000]
+       python analyze_telemetry.py --port /dev/ttyACM0 --seconds 30 [--save capture.bin]
+
+Toggle the stream with the 'p' serial command. Text printed on the same port
+(stats dumps etc.) is skipped.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+SYNC = 0xA5
+RECORD_SIZE = 16
+STAGES = ['index', 'read', 'cache', 'decode', 'swap', 'spi', 'present', 'skip', 'drop']
+TIMED_STAGES = ['index', 'read', 'decode', 'swap', 'spi']
+# Chrome trace rows: SD work, CPU work, LCD transfer, scheduling events
+TRACE_THREADS = {'index': 0, 'read': 0, 'cache': 0, 'decode': 1, 'swap': 1, 'spi': 2,
+                 'present': 3, 'skip': 3, 'drop': 3}
+THREAD_NAMES = ['sd', 'cpu', 'spi', 'schedule']
+
+def parse_records(data):
+    """Yield (stage, frame, segment, start, value) for every valid record, resyncing on bad bytes"""
+    i = 0
+    end = len(data) - RECORD_SIZE
+    while i <= end:
+        if data[i] != SYNC or data[i + 1] >= len(STAGES):
+            i += 1
+            continue
+        check = 0
+        for b in data[i + 4:i + RECORD_SIZE]:
+            check ^= b
+        if check != data[i + 3]:
+            i += 1
+            continue
+        frame, start, value = struct.unpack_from('<III', data, i + 4)
+        yield STAGES[data[i + 1]], frame, data[i + 2], start, value
+        i += RECORD_SIZE
+
+def unwrap_times(records):
+    """Turn 32-bit micros() timestamps into a monotonic timeline starting at 0"""
+    base = None
+    offset = 0
+    previous = 0
+    for stage, frame, segment, start, value in records:
+        if base is None:
+            base = start
+        relative = (start - base) & 0xFFFFFFFF
+        # Deadlines can sit slightly before earlier records; only a big
+        # backwards jump is a wrap.
+        if relative + offset < previous - (1 << 31):
+            offset += 1 << 32
+        previous = relative + offset
+        yield stage, frame, segment, relative + offset, value
+
+def signed32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+def percentile(sorted_values, fraction):
+    index = min(len(sorted_values) - 1, int(round(fraction * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+def read_serial(port, baud, seconds):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("reading from a port needs pyserial (pip install pyserial)")
+    import time
+    
+    data = bytearray()
+    with serial.Serial(port, baud, timeout=0.1) as link:
+        link.write(b'p')
+        stop = time.time() + seconds
+        while time.time() < stop:
+            data += link.read(4096)
+        link.write(b'p')
+    return bytes(data)
+
+def analyze(data, trace_path=None, late_us=1000):
+    records = list(unwrap_times(parse_records(data)))
+    if not records:
+        print("No telemetry records found")
+        return
+    
+    # Per-frame time spent in each stage (segments and read chunks summed)
+    per_frame = {stage: {} for stage in TIMED_STAGES}
+    late = []
+    skipped = 0
+    dropped = 0
+    cache_hits = 0
+    presented = 0
+    
+    for stage, frame, segment, start, value in records:
+        if stage in per_frame:
+            per_frame[stage][frame] = per_frame[stage].get(frame, 0) + value
+        elif stage == 'present':
+            presented += 1
+            lateness = signed32(value)
+            if lateness > late_us:
+                late.append((frame, lateness))
+        elif stage == 'skip':
+            skipped += value
+        elif stage == 'drop':
+            dropped += 1
+        elif stage == 'cache':
+            cache_hits += 1
+    
+    print(f"{len(records)} records, {presented} frames presented, "
+          f"{cache_hits} cache hits, {skipped} skipped, {dropped} dropped")
+    print()
+    print("stage,frames,p50_us,p90_us,p99_us,max_us,avg_us")
+    for stage in TIMED_STAGES:
+        values = sorted(per_frame[stage].values())
+        if not values:
+            continue
+        print(f"{stage},{len(values)},{percentile(values, 0.5)},{percentile(values, 0.9)},"
+              f"{percentile(values, 0.99)},{values[-1]},{sum(values) // len(values)}")
+    
+    print()
+    print(f"{len(late)} frames presented more than {late_us} us after their deadline")
+    if late:
+        print("frame,late_us")
+        for frame, lateness in late:
+            print(f"{frame},{lateness}")
+    
+    if trace_path:
+        write_trace(records, trace_path)
+        print()
+        print(f"Wrote Chrome trace to {trace_path} (open in chrome://tracing or ui.perfetto.dev)")
+
+def write_trace(records, path):
+    events = [{'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': tid, 'args': {'name': name}}
+              for tid, name in enumerate(THREAD_NAMES)]
+    
+    for stage, frame, segment, start, value in records:
+        event = {'name': stage, 'pid': 0, 'tid': TRACE_THREADS[stage],
+                 'args': {'frame': frame, 'segment': segment}}
+        if stage in TIMED_STAGES:
+            event.update(ph='X', ts=start, dur=value)
+        elif stage == 'present':
+            lateness = signed32(value)
+            event.update(ph='i', s='t', ts=start + lateness)
+            event['args']['late_us'] = lateness
+        else:
+            event.update(ph='i', s='t', ts=start)
+            if stage == 'skip':
+                event['args']['frames'] = value
+        events.append(event)
+    
+    with open(path, 'w') as f:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Summarize a VID0 player pipeline telemetry capture")
+    parser.add_argument("capture", nargs='?', help="raw serial capture file")
+    parser.add_argument("--port", help="read live from this serial port instead of a file")
+    parser.add_argument("--baud", type=int, default=115200, help="serial baud rate (default: 115200)")
+    parser.add_argument("--seconds", type=float, default=10,
+                        help="how long to capture from --port (default: 10)")
+    parser.add_argument("--save", help="also write the raw capture from --port to this file")
+    parser.add_argument("--trace", help="write a Chrome trace JSON file")
+    parser.add_argument("--late-us", type=int, default=1000,
+                        help="report frames presented more than this many us late (default: 1000)")
+    args = parser.parse_args()
+    
+    if args.port:
+        data = read_serial(args.port, args.baud, args.seconds)
+        if args.save:
+            with open(args.save, 'wb') as f:
+                f.write(data)
+    elif args.capture:
+        with open(args.capture, 'rb') as f:
+            data = f.read()
+    else:
+        parser.error("give a capture file or --port")
+    
+    analyze(data, trace_path=args.trace, late_us=args.late_us)
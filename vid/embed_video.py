@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""
+Embed a .vid file into the firmware as a linkable object
+Usage: python embed_video.py input.vid output.S
+
+Writes an assembler source that .incbin's the video into the Teensy's
+memory-mapped program flash (.progmem section) between the symbols
+embedded_video and embedded_video_end, for MemoryVideoSource to play in place.
+
+Also works as a PlatformIO "pre:" extra script: it then embeds the file named
+by the environment's custom_embed_video option into src/embedded_video.S.
+The generated source is guarded by EMBEDDED_VIDEO, so other environments
+compile it to nothing.
+"""
+
+import os
+import struct
+import sys
+
+TEMPLATE = """/* Generated by vid/embed_video.py from {name} - do not edit */
+#ifdef EMBEDDED_VIDEO
+    .section .progmem.embedded_video, "a", %progbits
+    .balign 32
+    .global embedded_video
+    .type embedded_video, %object
+embedded_video:
+    .incbin "{path}"
+    .global embedded_video_end
+embedded_video_end:
+    .size embedded_video, embedded_video_end - embedded_video
+#endif
+"""
+
+def embed_video(input_path, output_path):
+    input_path = os.path.abspath(input_path)
+    
+    with open(input_path, 'rb') as f:
+        header = f.read(20)
+    if len(header) < 20 or header[:4] != b'VID0':
+        raise ValueError(f"{input_path} is not a VID0 file")
+    
+    frame_count, width, height, fps = struct.unpack('<IHHB', header[4:13])
+    size = os.path.getsize(input_path)
+    
+    source = TEMPLATE.format(name=os.path.basename(input_path), 
+                             path=input_path.replace('\\', '/'))
+    
+    # Only rewrite when the contents change so the build stays incremental
+    if os.path.exists(output_path):
+        with open(output_path) as f:
+            if f.read() == source:
+                return size
+    
+    with open(output_path, 'w') as f:
+        f.write(source)
+    
+    print(f"Embedded {input_path}: {frame_count} frames {width}x{height} @ {fps} FPS, "
+          f"{size / 1024 / 1024:.2f} MB of program flash")
+    return size
+
+def embed_for_platformio(env):
+    project_dir = env.subst("$PROJECT_DIR")
+    video = env.GetProjectOption("custom_embed_video", "")
+    if not video:
+        sys.stderr.write("embed_video.py: set custom_embed_video in platformio.ini\n")
+        env.Exit(1)
+    
+    embed_video(os.path.join(project_dir, video), 
+                os.path.join(env.subst("$PROJECT_SRC_DIR"), "embedded_video.S"))
+
+try:
+    Import("env")  # noqa: F821 - provided by SCons when run as a PlatformIO extra script
+except NameError:
+    env = None
+
+if env is not None:
+    embed_for_platformio(env)
+elif __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("Usage: python embed_video.py input.vid output.S")
+        sys.exit(1)
+    
+    embed_video(sys.argv[1], sys.argv[2])
@@ -1,22 +1,122 @@
 #!/usr/bin/env python3
 """
 Convert video files to custom RGB565 format with RLE compression for Teensy display
-Usage: python video_converter.py input.mp4 output.vid
+Usage: python video_converter.py input.mp4 output.vid [--align none|frame|group] [--audio [SOURCE]]
+                                  [--jobs N] [--benchmark] [--rle optimal|greedy] [--rle-packet-cost N]
+                                  [--report FILE] [--max-frame-kb N] [--max-late-frames N]
+                                  [--repeat-threshold N | --no-repeats]
+                                  [--codec rle|tiles|rects|spans|rows|auto] [--tile-size WxH] [--keyframe-interval N]
+                                  [--bilevel-threshold LEVEL] [--dictionary-kb KB]
 """
 
+import argparse
+import collections
 import cv2
+import multiprocessing
 import numpy as np
+import os
 import struct
+import subprocess
 import sys
+import time
+import wave
 from pathlib import Path
 
-def rgb888_to_rgb565(r, g, b):
-    """Convert 8-bit RGB to 16-bit RGB565"""
-    # Convert numpy types to Python int to avoid overflow issues
-    r = int(r)
-    g = int(g)
-    b = int(b)
-    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+SECTOR_SIZE = 512
+FLAG_SECTOR_ALIGNED = 0x01
+FLAG_NTSC_RATE = 0x02
+FLAG_AUDIO = 0x04
+FLAG_MAX_FRAME_SIZE = 0x08
+FLAG_REPEATS = 0x10
+FLAG_ROW_DICTIONARY = 0x20
+INDEX_REPEAT = 0x80000000
+INDEX_DELTA = 0x40000000
+
+COMPRESSION_RLE = 1
+COMPRESSION_TILES = 2
+COMPRESSION_RECTS = 3
+COMPRESSION_SPANS = 4
+COMPRESSION_ROWS = 5
+COMPRESSION_RAW = 6
+COMPRESSION_PER_FRAME = 7
+COMPRESSION_NAMES = {COMPRESSION_RLE: 'RLE', COMPRESSION_TILES: 'tiles', COMPRESSION_RECTS: 'rectangles',
+                     COMPRESSION_SPANS: 'spans', COMPRESSION_ROWS: 'dictionary rows', COMPRESSION_RAW: 'raw'}
+COMPRESSIONS = {'rle': COMPRESSION_RLE, 'tiles': COMPRESSION_TILES, 'rects': COMPRESSION_RECTS,
+                'spans': COMPRESSION_SPANS, 'rows': COMPRESSION_ROWS, 'auto': COMPRESSION_PER_FRAME}
+TILE_UNCHANGED = 0
+TILE_SOLID = 1
+TILE_RLE = 2
+TILE_RAW = 3
+TILE_MODE_NAMES = ['unchanged', 'solid', 'RLE', 'raw']
+
+# Bytes on the LCD bus to open a window: CASET and RASET with 4 parameters
+# each, then RAMWR
+WINDOW_SETUP_BYTES = 11
+
+# Rectangle frames: groups of a colour and a count less one, then 9-bit x, y,
+# width - 1 and height - 1 packed into 5 bytes per rectangle. A row's run of
+# one colour bridges up to RECT_MAX_GAP pixels already showing it, about what
+# starting another rectangle costs on the bus and in the file.
+RECT_GROUP_BYTES = 3
+RECT_BYTES = 5
+RECT_GROUP_MAX = 256
+RECT_FIELD_LIMIT = 512
+RECT_MAX_GAP = (WINDOW_SETUP_BYTES + RECT_BYTES) // 2
+
+# Span frames: row codes, followed by that many varint positions unless the
+# row repeats the previous one
+SPAN_ROW_SAME = 0
+SPAN_ROW_PREDICTED = 1
+SPAN_ROW_LITERAL = 2
+SPAN_ROW_MODE_NAMES = ['repeated', 'predicted', 'literal']
+SPAN_MAX_WIDTH = 320
+
+# Row-dictionary frames: a varint per row, ROW_LITERAL before the row's own
+# RLE packets or n + 1 for dictionary row n
+ROW_LITERAL = 0
+ROW_DICTIONARY_MAX = 0xFFFF
+
+AUDIO_CODECS = {'pcm': 1, 'adpcm': 2}
+
+ADPCM_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+]
+ADPCM_INDEX_STEPS = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+# Throughputs the budget report and --codec auto assume for the player: SD
+# read rate in MB/s and fixed cost per frame read, LCD SPI clock, and decoder
+# CPU time per RLE packet and per pixel written
+ThroughputModel = collections.namedtuple('ThroughputModel',
+                                         'sd_mbps sd_latency_us spi_mhz ns_per_packet ns_per_pixel')
+DEFAULT_MODEL = ThroughputModel(sd_mbps=20.0, sd_latency_us=250, spi_mhz=32.0, ns_per_packet=40, ns_per_pixel=2.0)
+
+def pad_to_sector(f):
+    """Zero-pad the output file up to the next sector boundary, returning the pad length"""
+    padding = (-f.tell()) % SECTOR_SIZE
+    if padding:
+        f.write(b'\x00' * padding)
+    return padding
+
+def frame_to_rgb565(frame):
+    """Convert a BGR frame (as read by OpenCV) to a flat array of RGB565 values"""
+    b = frame[:, :, 0].astype(np.uint16)
+    g = frame[:, :, 1].astype(np.uint16)
+    r = frame[:, :, 2].astype(np.uint16)
+    return (((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)).ravel()
+
+def max_channel_difference(a, b):
+    """Largest red, green or blue difference between two RGB565 frames, in 8-bit levels"""
+    a = a.astype(np.int32)
+    b = b.astype(np.int32)
+    return max(int(np.abs((a >> 11) - (b >> 11)).max()) << 3,
+               int(np.abs(((a >> 5) & 0x3F) - ((b >> 5) & 0x3F)).max()) << 2,
+               int(np.abs((a & 0x1F) - (b & 0x1F)).max()) << 3)
 
 def compress_frame_rle(frame_data):
     """
@@ -27,55 +127,783 @@ def compress_frame_rle(frame_data):
     - Run: header byte followed by 2 bytes (RGB565 value)
     - Literal: header byte followed by count * 2 bytes (RGB565 values)
     
+    Runs of 3+ identical values are encoded as runs of up to 128; a run's last
+    1-2 values and shorter stretches of equal values form literals of up to 128
+    that end where the next run starts. Runs are found with numpy, so the loop
+    below only visits each stretch of equal values once.
+    
     Returns: compressed bytes
     """
+    pixels = np.asarray(frame_data, dtype='<u2').ravel()
+    if len(pixels) == 0:
+        return b''
+    
+    # Start and length of every stretch of equal values
+    starts = np.concatenate(([0], np.flatnonzero(np.diff(pixels)) + 1))
+    lengths = np.diff(np.append(starts, len(pixels)))
+    
     compressed = bytearray()
-    i = 0
+    literal_start = None
     
-    while i < len(frame_data):
-        # Check for runs
-        run_start = i
-        run_value = frame_data[i]
-        run_length = 1
+    def write_literals(end):
+        for position in range(literal_start, end, 128):
+            count = min(128, end - position)
+            compressed.append(count - 1)
+            compressed.extend(pixels[position:position + count].tobytes())
+    
+    for start, length in zip(starts.tolist(), lengths.tolist()):
+        if length < 3:
+            if literal_start is None:
+                literal_start = start
+            continue
         
-        # Count consecutive identical values (max 128)
-        while i + run_length < len(frame_data) and run_length < 128:
-            if frame_data[i + run_length] == run_value:
-                run_length += 1
-            else:
-                break
+        if literal_start is not None:
+            write_literals(start)
+            literal_start = None
         
-        # Decide whether to encode as run or literal
-        if run_length >= 3:  # Use run encoding for 3+ identical values
-            # Run encoding: set bit 7, store count-1 in bits 6-0
-            header = 0x80 | (run_length - 1)
-            compressed.append(header)
-            compressed.extend(struct.pack('<H', run_value))
-            i += run_length
+        value = pixels[start:start + 1].tobytes()
+        full_runs, rest = divmod(length, 128)
+        compressed.extend((b'\xff' + value) * full_runs)
+        if rest >= 3:
+            compressed.append(0x80 | (rest - 1))
+            compressed.extend(value)
+        elif rest:
+            literal_start = start + length - rest
+    
+    if literal_start is not None:
+        write_literals(len(pixels))
+    return bytes(compressed)
+
+def compress_frame_rle_optimal(frame_data, packet_cost=0):
+    """
+    Compress frame data to the same RLE format as compress_frame_rle, choosing
+    the packets with a shortest-path parse instead of greedily
+    
+    Minimises bytes + packet_cost * packets, then the packet count. With
+    packet_cost=0 this is the smallest possible output; a packet_cost of a few
+    bytes trades size for fewer headers for the decoder to branch on, and a
+    very large one gives the fewest packets whatever the size.
+    
+    cost[q] is the cheapest encoding of the first q values, and never falls as
+    q grows. A run packet costs 3 bytes and a literal 1 + 2 * count, so a
+    literal only takes values from a stretch of 3+ equal values [s, e) at its
+    ends, to save a run packet: one value when packets are free, more as they
+    cost more. Inside such stretches the parse only visits the positions within
+    that reach of s and e, and every position elsewhere. The best literal start
+    within 128 values, by cost[p] - 2 * p, is kept in a monotonic queue.
+    
+    Returns: compressed bytes
+    """
+    pixels = np.asarray(frame_data, dtype='<u2').ravel()
+    if len(pixels) == 0:
+        return b''
+    
+    starts = np.concatenate(([0], np.flatnonzero(np.diff(pixels)) + 1))
+    lengths = np.diff(np.append(starts, len(pixels)))
+    
+    # Costs in 1/65536 bytes, so the packet count only breaks ties
+    byte_weight = 1 << 16
+    packet_weight = packet_cost * byte_weight + 1
+    reach = min(127, packet_cost // 2 + 2)
+    literal_cost = packet_weight + byte_weight
+    value_cost = 2 * byte_weight
+    run_cost = packet_weight + 3 * byte_weight
+    
+    cost = {0: 0}
+    came_from = {}
+    literal_starts = collections.deque([0])
+    
+    for start, length in zip(starts.tolist(), lengths.tolist()):
+        end = start + length
+        if length > 2 * reach + 1:
+            ends = list(range(start + 1, start + reach + 1)) + list(range(end - reach, end + 1))
         else:
-            # Find length of literal sequence (different consecutive values)
-            literal_start = i
-            literal_length = 0
+            ends = range(start + 1, end + 1)
+        
+        for q in ends:
+            best = None
+            while literal_starts and literal_starts[0] < q - 128:
+                literal_starts.popleft()
+            if literal_starts:
+                p = literal_starts[0]
+                best = cost[p] + literal_cost + value_cost * (q - p)
+                came_from[q] = (p, False)
             
-            while i < len(frame_data) and literal_length < 128:
-                # Look ahead to see if a run is coming
-                if i + 2 < len(frame_data) and frame_data[i] == frame_data[i + 1] == frame_data[i + 2]:
-                    break
-                literal_length += 1
-                i += 1
+            # Runs back to the start of the stretch, or one packet fewer from
+            # the first visited position that allows it
+            candidates = [start]
+            if q - start > 128:
+                p = q - 128 * ((q - start - 1) // 128)
+                if p > start + reach:
+                    p = max(p, end - reach)
+                if p < q:
+                    candidates.append(p)
+            for p in candidates:
+                c = cost[p] + run_cost * -(-(q - p) // 128)
+                if best is None or c < best:
+                    best = c
+                    came_from[q] = (p, True)
             
-            # Literal encoding: clear bit 7, store count-1 in bits 6-0
-            header = (literal_length - 1) & 0x7F
-            compressed.append(header)
-            for j in range(literal_start, literal_start + literal_length):
-                compressed.extend(struct.pack('<H', frame_data[j]))
+            cost[q] = best
+            key = best - value_cost * q
+            while literal_starts and cost[literal_starts[-1]] - value_cost * literal_starts[-1] >= key:
+                literal_starts.pop()
+            literal_starts.append(q)
+    
+    packets = []
+    q = len(pixels)
+    while q:
+        p, run = came_from[q]
+        packets.append((p, q, run))
+        q = p
     
+    compressed = bytearray()
+    for p, q, run in reversed(packets):
+        if run:
+            value = pixels[p:p + 1].tobytes()
+            for position in range(p, q, 128):
+                compressed.append(0x80 | (min(128, q - position) - 1))
+                compressed.extend(value)
+        else:
+            compressed.append(q - p - 1)
+            compressed.extend(pixels[p:q].tobytes())
     return bytes(compressed)
 
-def convert_video(input_path, output_path, target_width=240):
+def count_rle_packets(data):
+    """Number of packets in an RLE-compressed frame"""
+    packets = 0
+    position = 0
+    while position < len(data):
+        header = data[position]
+        position += 3 if header & 0x80 else 1 + 2 * ((header & 0x7F) + 1)
+        packets += 1
+    return packets
+
+def encode_tiles(pixels, width, height, tile_size, rle, packet_cost):
+    """
+    Encode every tile of a frame on its own: as a solid colour, or as RLE or
+    raw pixels, whichever is smaller (raw on ties, as it decodes fastest)
+    
+    Returns: (mode, payload, packets) for each tile in raster order
+    """
+    tile_width, tile_height = tile_size
+    frame = pixels.reshape(height, width)
+    tiles = []
+    for top in range(0, height, tile_height):
+        for left in range(0, width, tile_width):
+            tile = frame[top:top + tile_height, left:left + tile_width].ravel()
+            if (tile == tile[0]).all():
+                tiles.append((TILE_SOLID, tile[:1].astype('<u2').tobytes(), 0))
+                continue
+            compressed = compress_frame_rle(tile) if rle == 'greedy' else compress_frame_rle_optimal(tile, packet_cost)
+            raw = tile.astype('<u2').tobytes()
+            if len(compressed) < len(raw):
+                tiles.append((TILE_RLE, compressed, count_rle_packets(compressed)))
+            else:
+                tiles.append((TILE_RAW, raw, 0))
+    return tiles
+
+def changed_tiles(pixels, previous, width, height, tile_size):
+    """Which tiles differ anywhere from the previous picture, in raster order"""
+    tile_width, tile_height = tile_size
+    rows = -(-height // tile_height)
+    columns = -(-width // tile_width)
+    changed = np.zeros((rows * tile_height, columns * tile_width), dtype=bool)
+    changed[:height, :width] = (pixels != previous).reshape(height, width)
+    return changed.reshape(rows, tile_height, columns, tile_width).any(axis=(1, 3)).ravel()
+
+def assemble_tiled_frame(tiles, changed, width, height, tile_size):
+    """
+    Build a tiled frame: the mode map, 2 bits per tile from the lowest bits
+    up, then the payloads of the tiles that changed
+    
+    Returns: the frame, its RLE packets, the pixels the player decodes and
+    sends, the windows it opens, and the tiles stored in each mode
+    """
+    tile_width, tile_height = tile_size
+    mode_map = bytearray((len(tiles) + 3) // 4)
+    payload = bytearray()
+    packets = decoded = sent = windows = 0
+    mode_counts = [0] * 4
+    i = 0
+    for top in range(0, height, tile_height):
+        for left in range(0, width, tile_width):
+            mode, data, tile_packets = tiles[i] if changed[i] else (TILE_UNCHANGED, b'', 0)
+            mode_map[i // 4] |= mode << (2 * (i % 4))
+            mode_counts[mode] += 1
+            i += 1
+            if mode == TILE_UNCHANGED:
+                continue
+            pixels = min(tile_width, width - left) * min(tile_height, height - top)
+            payload.extend(data)
+            packets += tile_packets
+            decoded += pixels if mode != TILE_SOLID else 0
+            sent += pixels
+            windows += 1
+    return bytes(mode_map + payload), packets, decoded, sent, windows, mode_counts
+
+def cover_rectangles(pixels, previous, width, height):
+    """
+    Cover the pixels that differ from the previous picture (all of them when
+    there is none) with filled rectangles of one colour each
+    
+    Each row is cut into runs of one colour over the pixels to draw, bridging
+    gaps of up to RECT_MAX_GAP pixels that already show that colour, and runs
+    over the same columns in consecutive rows are merged. Without a previous
+    picture the most common colour is first filled over the whole frame.
+    
+    Returns: (colour, x, y, width, height) for each rectangle in drawing order,
+    the rest grouped by colour
+    """
+    flat = pixels.ravel()
+    background = []
+    if previous is None:
+        values, counts = np.unique(flat, return_counts=True)
+        background = [(int(values[counts.argmax()]), 0, 0, width, height)]
+        draw = flat != values[counts.argmax()]
+    else:
+        draw = flat != previous
+    
+    # Pixels with the same run number lie in one row and share a colour
+    change = np.ones(len(flat), dtype=bool)
+    change[1:] = flat[1:] != flat[:-1]
+    change[::width] = True
+    run = np.cumsum(change)
+    positions = np.flatnonzero(draw)
+    if not len(positions):
+        return background
+    split = np.ones(len(positions), dtype=bool)
+    split[1:] = ((run[positions[1:]] != run[positions[:-1]]) |
+                 (positions[1:] - positions[:-1] > RECT_MAX_GAP + 1))
+    starts = positions[split]
+    ends = positions[np.append(split[1:], True)]
+    
+    rects = []
+    open_rects = {}
+    for start, end in zip(starts.tolist(), ends.tolist()):
+        y, x = divmod(start, width)
+        key = (int(flat[start]), x, end - start + 1)
+        rect = open_rects.get(key)
+        if rect is not None and rect[2] + rect[4] == y:
+            rect[4] += 1
+            continue
+        rect = [key[0], x, y, key[2], 1]
+        open_rects[key] = rect
+        rects.append(rect)
+    rects.sort(key=lambda rect: rect[0])
+    return background + [tuple(rect) for rect in rects]
+
+def assemble_rect_frame(rects):
+    """Build a rectangle frame, starting a group at each change of colour"""
+    data = bytearray()
+    i = 0
+    while i < len(rects):
+        colour = rects[i][0]
+        count = 1
+        while i + count < len(rects) and count < RECT_GROUP_MAX and rects[i + count][0] == colour:
+            count += 1
+        data += struct.pack('<HB', colour, count - 1)
+        for _, x, y, w, h in rects[i:i + count]:
+            data += (x | (y << 9) | ((w - 1) << 18) | ((h - 1) << 27)).to_bytes(RECT_BYTES, 'little')
+        i += count
+    return bytes(data)
+
+def to_bilevel(frame, threshold):
+    """
+    Reduce a BGR frame to two colours: pixels whose luma is below the
+    threshold take the most common colour among them, the others the most
+    common among the rest (black and white when a side is empty)
+    
+    Returns: the RGB565 pixels, the two colours, and which pixels take the
+    second (light) one
+    """
+    pixels = frame_to_rgb565(frame)
+    light = cv2.cvtColor(frame, cv2.COLOR_BGR2GRAY).ravel() >= threshold
+    colours = []
+    for side, default in ((~light, 0x0000), (light, 0xFFFF)):
+        values, counts = np.unique(pixels[side], return_counts=True)
+        colours.append(int(values[counts.argmax()]) if len(values) else default)
+    return np.where(light, colours[1], colours[0]).astype(np.uint16), colours, light
+
+def encode_varint(value):
+    """Little-endian base-128 varint, 7 bits a byte with the top bit set on all but the last"""
+    data = bytearray()
+    while value >= 0x80:
+        data.append((value & 0x7F) | 0x80)
+        value >>= 7
+    data.append(value)
+    return data
+
+def encode_spans(light, colours, width, height):
+    """
+    Encode a two-colour frame as the x positions where each row flips colour,
+    starting from the first colour. A row is stored as a repeat of the row
+    above, as signed offsets from its positions when it has as many, or as
+    the positions themselves, whichever is smallest.
+    
+    Returns: the frame, its runs of one colour (the decoder's loop count)
+    and the rows stored in each mode
+    """
+    light = light.reshape(height, width)
+    flips = np.zeros((height, width), dtype=bool)
+    flips[:, 0] = light[:, 0]
+    flips[:, 1:] = light[:, 1:] != light[:, :-1]
+    data = bytearray(struct.pack('<HH', *colours))
+    previous = []
+    runs = 0
+    row_modes = [0] * 3
+    for row in flips:
+        positions = np.flatnonzero(row).tolist()
+        runs += len(positions) + 1
+        if positions == previous:
+            data += encode_varint(SPAN_ROW_SAME)
+            row_modes[SPAN_ROW_SAME] += 1
+            continue
+        encoded = encode_varint(SPAN_ROW_LITERAL + len(positions))
+        for last, x in zip([-1] + positions, positions):
+            encoded += encode_varint(x - last - 1)
+        mode = SPAN_ROW_LITERAL
+        if len(positions) == len(previous):
+            predicted = encode_varint(SPAN_ROW_PREDICTED)
+            for above, x in zip(previous, positions):
+                predicted += encode_varint(2 * (x - above) if x >= above else 2 * (above - x) - 1)
+            if len(predicted) < len(encoded):
+                encoded = predicted
+                mode = SPAN_ROW_PREDICTED
+        data += encoded
+        row_modes[mode] += 1
+        previous = positions
+    return bytes(data), runs, row_modes
+
+def encode_frame(job):
+    """
+    Resize, convert and compress one frame; runs in the worker processes
+    
+    Returns the compressed frame, its packet count, the greedy encoder's
+    size and packet count to compare the optimal parse against, the RGB565
+    pixels for repeat detection, with a tile size every tile encoded for the
+    tiled format, with a bilevel threshold the span frame and with split_rows
+    every row compressed on its own. Bilevel frames are reduced to two colours
+    before any of it.
+    """
+    frame, target_width, target_height, rle, packet_cost, tile_size, threshold, split_rows = job
+    frame = cv2.resize(frame, (target_width, target_height))
+    pixels = frame_to_rgb565(frame)
+    spans = None
+    if threshold is not None:
+        pixels, colours, light = to_bilevel(frame, threshold)
+        spans = encode_spans(light, colours, target_width, target_height)
+    tiles = encode_tiles(pixels, target_width, target_height, tile_size, rle, packet_cost) if tile_size else None
+    compress = compress_frame_rle if rle == 'greedy' else lambda data: compress_frame_rle_optimal(data, packet_cost)
+    rows = [compress(row) for row in pixels.reshape(target_height, target_width)] if split_rows else None
+    greedy = compress_frame_rle(pixels)
+    greedy_packets = count_rle_packets(greedy)
+    if rle == 'greedy':
+        return greedy, greedy_packets, len(greedy), greedy_packets, pixels, tiles, spans, rows
+    compressed = compress_frame_rle_optimal(pixels, packet_cost)
+    return compressed, count_rle_packets(compressed), len(greedy), greedy_packets, pixels, tiles, spans, rows
+
+def frame_pixels(job):
+    """The RGB565 pixels encode_frame would compress, for the row dictionary pass"""
+    frame, target_width, target_height, _, _, _, threshold, _ = job
+    frame = cv2.resize(frame, (target_width, target_height))
+    return to_bilevel(frame, threshold)[0] if threshold is not None else frame_to_rgb565(frame)
+
+def build_row_dictionary(input_path, frame_count, jobs, target_width, target_height, threshold, repeat_threshold,
+                         budget):
+    """
+    Pick the rows for the player to keep resident: every row is counted over
+    the whole video (skipping frames that will be stored as repeats), and the
+    rows seen more than once that save the most bytes, their RLE in every
+    frame less a reference each and one raw copy in the file, are kept until
+    the RAM budget is used up
+    
+    Returns: the rows as RGB565 arrays, those saving most first
+    """
+    cap = cv2.VideoCapture(input_path)
+    pool = multiprocessing.Pool(jobs) if jobs > 1 else None
+    counts = collections.Counter()
+    candidates = {}
+    stored = None
+    for batch in read_batches(cap, frame_count, jobs * 4, target_width, target_height, None, 0, None, threshold, False):
+        for pixels in (pool.map(frame_pixels, batch) if pool else map(frame_pixels, batch)):
+            if (stored is not None and repeat_threshold is not None and
+                    max_channel_difference(pixels, stored) <= repeat_threshold):
+                continue
+            stored = pixels
+            # Rows are counted by hash so unique rows cost no memory beyond it
+            for row in pixels.reshape(target_height, target_width):
+                key = hash(row.tobytes())
+                counts[key] += 1
+                if counts[key] == 2:
+                    candidates[key] = row.copy()
+    if pool:
+        pool.close()
+        pool.join()
+    cap.release()
+    
+    row_bytes = target_width * 2
+    savings = sorted(((counts[key] * (len(compress_frame_rle(row)) + 1 - 2) - row_bytes, key)
+                      for key, row in candidates.items()), reverse=True)
+    limit = min(budget // row_bytes, ROW_DICTIONARY_MAX)
+    return [candidates[key] for saving, key in savings[:limit] if saving > 0]
+
+def assemble_row_frame(pixels, rows, dictionary, width, height):
+    """
+    Code each row of a frame as a reference when the row dictionary holds it
+    and as its own RLE packets otherwise
+    
+    Returns: the frame, its packets (a dictionary row counting as one), the
+    dictionary rows it refers to and the bytes that saved
+    """
+    data = bytearray()
+    packets = 0
+    references = []
+    saved = 0
+    for row, compressed in zip(pixels.reshape(height, width), rows):
+        index = dictionary.get(row.tobytes())
+        if index is None:
+            data += encode_varint(ROW_LITERAL) + compressed
+            packets += count_rle_packets(compressed)
+            continue
+        reference = encode_varint(index + 1)
+        data += reference
+        packets += 1
+        references.append(index)
+        saved += len(encode_varint(ROW_LITERAL)) + len(compressed) - len(reference)
+    return bytes(data), packets, references, saved
+
+def decode_varint(data, position):
+    """Read a varint written by encode_varint, returning it and the position after it"""
+    value = 0
+    shift = 0
+    while True:
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, position
+
+def renumber_row_frame(data, numbers, width):
+    """Rewrite a row-dictionary frame's references as numbers[old row]"""
+    renumbered = bytearray()
+    position = 0
+    while position < len(data):
+        code, position = decode_varint(data, position)
+        if code != ROW_LITERAL:
+            renumbered += encode_varint(numbers[code - 1] + 1)
+            continue
+        # Rows are compressed on their own, so the row's packets end with it
+        start = position
+        pixels = 0
+        while pixels < width:
+            header = data[position]
+            position += 3 if header & 0x80 else 1 + 2 * ((header & 0x7F) + 1)
+            pixels += (header & 0x7F) + 1
+        renumbered += encode_varint(ROW_LITERAL) + data[start:position]
+    return bytes(renumbered)
+
+def trim_row_dictionary(path, used, align, group_frames):
+    """
+    Rewrite a per-frame codec file with only the dictionary rows in used,
+    renumbered in their order, or without the dictionary and its flag when
+    used is empty; the player keeps every row in RAM whether frames refer to
+    it or not. Frames are laid out again, padded as before.
+    
+    Returns: the new frame offsets and sizes and the sector padding
+    """
+    with open(path, 'rb') as f:
+        data = f.read()
+    _, frame_count, width, _, _, _, flags, tile_shape, index_offset, _ = struct.unpack_from('<4sIHHBBBBII', data, 0)
+    position = struct.calcsize('<4sIHHBBBBII') + (struct.calcsize('<4sIIBBBBHH') if flags & FLAG_AUDIO else 0)
+    headers = data[:position]
+    row_bytes = width * 2
+    rows_start = position + struct.calcsize('<4sHH')
+    kept = sorted(used)
+    numbers = {row: number for number, row in enumerate(kept)}
+    if not kept:
+        flags &= ~FLAG_ROW_DICTIONARY
+    
+    frame_offsets = []
+    frame_sizes = []
+    frame_flags = []
+    padding = 0
+    temporary = path + '.tmp'
+    with open(temporary, 'wb') as f:
+        f.write(headers)
+        if kept:
+            f.write(struct.pack('<4sHH', b'ROW0', len(kept), 0))
+            for row in kept:
+                f.write(data[rows_start + row * row_bytes:rows_start + (row + 1) * row_bytes])
+        new_index_offset = f.tell()
+        f.write(b'\x00' * (frame_count * 8))
+        for i in range(frame_count):
+            offset, size = struct.unpack_from('<II', data, index_offset + i * 8)
+            frame_flags.append(size & (INDEX_REPEAT | INDEX_DELTA))
+            frame = data[offset:offset + (size & ~(INDEX_REPEAT | INDEX_DELTA))]
+            # The frame's audio chunk comes first, then its codec byte
+            audio = 4 + struct.unpack_from('<H', frame, 0)[0] if flags & FLAG_AUDIO else 0
+            if not size & INDEX_REPEAT and frame[audio] == COMPRESSION_ROWS:
+                frame = frame[:audio + 1] + renumber_row_frame(frame[audio + 1:], numbers, width)
+            if align == 'frame' or (align == 'group' and i % group_frames == 0):
+                padding += pad_to_sector(f)
+            frame_offsets.append(f.tell())
+            frame_sizes.append(len(frame))
+            f.write(frame)
+        if align != 'none':
+            padding += pad_to_sector(f)
+        f.seek(14)
+        f.write(struct.pack('<BBII', flags, tile_shape, new_index_offset, max(frame_sizes, default=0)))
+        f.seek(new_index_offset)
+        for offset, size, entry_flags in zip(frame_offsets, frame_sizes, frame_flags):
+            f.write(struct.pack('<II', offset, size | entry_flags))
+    os.replace(temporary, path)
+    return frame_offsets, frame_sizes, padding
+
+def load_audio(source, rate):
+    """Load a sound track as mono 16-bit samples at `rate` Hz
+    
+    WAV files are read directly; anything else (including the input video itself)
+    is decoded with the ffmpeg command-line tool.
+    """
+    if source.lower().endswith('.wav'):
+        with wave.open(source, 'rb') as w:
+            channels, width, source_rate = w.getnchannels(), w.getsampwidth(), w.getframerate()
+            raw = w.readframes(w.getnframes())
+        if width == 1:
+            samples = (np.frombuffer(raw, np.uint8).astype(np.float64) - 128) * 256
+        elif width in (2, 4):
+            samples = np.frombuffer(raw, '<i2' if width == 2 else '<i4').astype(np.float64) / (1 << (8 * width - 16))
+        else:
+            sys.exit(f"{source}: unsupported {8 * width}-bit WAV")
+        samples = samples.reshape(-1, channels).mean(axis=1)
+        if source_rate != rate:
+            positions = np.arange(len(samples) * rate // source_rate) * source_rate / rate
+            samples = np.interp(positions, np.arange(len(samples)), samples)
+        return np.clip(np.round(samples), -32768, 32767).astype(np.int16)
+    
+    try:
+        result = subprocess.run(['ffmpeg', '-v', 'error', '-i', source, '-vn', '-ac', '1', '-ar', str(rate),
+                                 '-f', 's16le', '-'], capture_output=True, check=True)
+    except FileNotFoundError:
+        sys.exit(f"ffmpeg is needed to read the audio of {source}; pass a .wav file to --audio instead")
+    except subprocess.CalledProcessError as error:
+        sys.exit(f"ffmpeg could not decode audio from {source}: {error.stderr.decode().strip()}")
+    return np.frombuffer(result.stdout, '<i2')
+
+def encode_ima_adpcm(samples, state):
+    """
+    Encode one chunk of samples as IMA ADPCM
+    
+    Format:
+    - Preamble: predictor (int16), step index (uint8), reserved byte
+    - Then two 4-bit codes per byte, low nibble first
+    
+    `state` is the (predictor, index) pair carried from chunk to chunk, so each
+    chunk decodes on its own exactly as the continuous stream would.
+    Returns: (encoded bytes, new state)
+    """
+    predictor, index = state
+    encoded = bytearray(struct.pack('<hBB', predictor, index, 0))
+    codes = []
+    
+    for sample in samples.tolist():
+        step = ADPCM_STEPS[index]
+        difference = sample - predictor
+        code = 0
+        if difference < 0:
+            code = 8
+            difference = -difference
+        if difference >= step:
+            code |= 4
+            difference -= step
+        if difference >= step >> 1:
+            code |= 2
+            difference -= step >> 1
+        if difference >= step >> 2:
+            code |= 1
+        
+        # Track the decoder exactly, rounding included
+        delta = step >> 3
+        if code & 1:
+            delta += step >> 2
+        if code & 2:
+            delta += step >> 1
+        if code & 4:
+            delta += step
+        predictor = max(-32768, min(32767, predictor - delta if code & 8 else predictor + delta))
+        index = max(0, min(88, index + ADPCM_INDEX_STEPS[code & 7]))
+        codes.append(code)
+    
+    if len(codes) % 2:
+        codes.append(0)
+    for i in range(0, len(codes), 2):
+        encoded.append(codes[i] | (codes[i + 1] << 4))
+    return bytes(encoded), (predictor, index)
+
+def encode_audio_chunks(samples, frame_count, fps_num, fps_den, rate, codec, lead):
+    """
+    Split a sound track into one chunk per frame
+    
+    The track is trimmed or padded with silence to the length of the video. Chunk 0
+    carries the audio of frames 0 to `lead`, chunk n > 0 the audio of frame n + lead,
+    so the player always has audio queued ahead of the frame it shows.
+    Returns: list of (sample count, encoded bytes)
+    """
+    sample_count = frame_count * rate * fps_den // fps_num
+    samples = np.pad(samples[:sample_count], (0, max(0, sample_count - len(samples))))
+    
+    def frame_start(frame):
+        return min(frame * rate * fps_den // fps_num, sample_count)
+    
+    starts = [0] + [frame_start(i + lead) for i in range(1, frame_count)] + [sample_count]
+    chunks = []
+    state = (int(samples[0]) if sample_count else 0, 0)
+    
+    for i in range(frame_count):
+        chunk = samples[starts[i]:starts[i + 1]]
+        if len(chunk) == 0:
+            encoded = b''
+        elif codec == AUDIO_CODECS['adpcm']:
+            encoded, state = encode_ima_adpcm(chunk, state)
+        else:
+            encoded = chunk.astype('<i2').tobytes()
+        if len(chunk) > 0xFFFF or len(encoded) > 0xFFFF:
+            sys.exit(f"Audio chunk {i} holds {len(chunk)} samples; lower --audio-rate or --audio-lead")
+        chunks.append((len(chunk), encoded))
+    return chunks
+
+def read_batches(cap, frame_count, batch_size, target_width, target_height, rle, packet_cost, tile_size, threshold,
+                 split_rows):
+    """Yield lists of up to batch_size frames to encode, stopping at the end of the video"""
+    batch = []
+    for _ in range(frame_count):
+        ret, frame = cap.read()
+        if not ret:
+            break
+        batch.append((frame, target_width, target_height, rle, packet_cost, tile_size, threshold, split_rows))
+        if len(batch) == batch_size:
+            yield batch
+            batch = []
+    if batch:
+        yield batch
+
+def modelled_time(model, size, packets, work):
+    """The SD read, decode and LCD transfer time of a frame in microseconds, as in the budget report"""
+    decoded, sent, windows = work
+    sd_us = model.sd_latency_us + size / model.sd_mbps if size else 0
+    decode_us = (packets * model.ns_per_packet + decoded * model.ns_per_pixel) / 1000
+    spi_us = (sent * 16 + windows * WINDOW_SETUP_BYTES * 8) / model.spi_mhz
+    return sd_us, decode_us, spi_us
+
+def choose_frame_codec(candidates, model):
+    """
+    Pick the way of storing a frame that the player is modelled to read,
+    decode and send fastest, rather than the smallest; the smaller of two
+    that tie
+    
+    candidates holds (compression, data, packets, work, delta) tuples, work
+    as in the budget report. The frame's audio chunk is the same whichever
+    is picked and left out.
+    """
+    def cost(candidate):
+        _, data, packets, work, _ = candidate
+        return sum(modelled_time(model, len(data), packets, work)), len(data)
+    
+    return min(candidates, key=cost)
+
+def budget_report(frame_offsets, frame_sizes, frame_packets, frame_work, frame_repeats, fps_num, fps_den, aligned,
+                  model, budget_ms, max_frame_kb, max_late_frames, report_path):
+    """
+    Print the player's budget report and optionally write it as CSV
+    
+    Each frame's time is modelled as the SD read, the RLE decode and the LCD
+    transfer one after another, which is an upper bound: the player can
+    overlap the transfer with the next frame's read. frame_work holds each
+    frame's pixels decoded and sent and the windows opened for them.
+    Sector-aligned files are read as whole sectors. Repeat frames cost only
+    the read of their audio, as when the player shows the frame they repeat
+    just before them.
+    
+    Returns: descriptions of the hard limits exceeded, empty when none are
+    """
+    frame_count = len(frame_sizes)
+    budget_us = budget_ms * 1000 if budget_ms else 1000000 * fps_den / fps_num
+    
+    read_sizes = []
+    frame_times = []
+    for offset, size, packets, work, repeat in zip(frame_offsets, frame_sizes, frame_packets, frame_work,
+                                                   frame_repeats):
+        if aligned and size:
+            size = ((offset + size + SECTOR_SIZE - 1) // SECTOR_SIZE - offset // SECTOR_SIZE) * SECTOR_SIZE
+        read_sizes.append(size)
+        sd_us, decode_us, spi_us = modelled_time(model, size, packets, work if not repeat else (0, 0, 0))
+        frame_times.append((sd_us, decode_us, spi_us, sd_us + decode_us + spi_us))
+    
+    # SD bytes read in each second of playback
+    seconds = [0] * ((frame_count * fps_den + fps_num - 1) // fps_num)
+    for i, size in enumerate(read_sizes):
+        seconds[i * fps_den // fps_num] += size
+    
+    largest = max(range(frame_count), key=lambda i: frame_sizes[i])
+    late = [i for i, (_, _, _, total) in enumerate(frame_times) if total > budget_us]
+    busiest = max(range(len(seconds)), key=lambda i: seconds[i])
+    slowest = max(range(frame_count), key=lambda i: frame_times[i][3])
+    
+    print(f"\nBudget report ({budget_us / 1000:.1f} ms per frame; SD {model.sd_mbps:g} MB/s + "
+          f"{model.sd_latency_us} us per read, SPI {model.spi_mhz:g} MHz, "
+          f"{model.ns_per_packet} ns per packet + {model.ns_per_pixel:g} ns per pixel):")
+    print(f"  Largest frame: {frame_sizes[largest]} bytes (frame {largest}), limit {max_frame_kb} KB")
+    print(f"  SD bandwidth: {sum(read_sizes) / len(seconds) / 1024:.1f} KB/s average, "
+          f"{seconds[busiest] / 1024:.1f} KB/s peak (second {busiest})")
+    print(f"  RLE packets: {sum(frame_packets) / frame_count:.0f} per frame on average, "
+          f"{max(frame_packets)} at most")
+    print(f"  Frame time: {sum(t for _, _, _, t in frame_times) / frame_count / 1000:.2f} ms average, "
+          f"{frame_times[slowest][3] / 1000:.2f} ms at most (frame {slowest}: "
+          f"SD {frame_times[slowest][0] / 1000:.2f} ms, decode {frame_times[slowest][1] / 1000:.2f} ms, "
+          f"LCD {frame_times[slowest][2] / 1000:.2f} ms)")
+    if late:
+        listed = ', '.join(str(i) for i in late[:10]) + (', ...' if len(late) > 10 else '')
+        print(f"  Frames over budget: {len(late)} ({listed})")
+    else:
+        print("  Frames over budget: none")
+    
+    if report_path:
+        with open(report_path, 'w') as report:
+            report.write("# second,bytes,kb_per_s\n")
+            for i, size in enumerate(seconds):
+                report.write(f"second,{i},{size},{size / 1024:.1f}\n")
+            report.write("# frame,bytes,read_bytes,packets,sd_us,decode_us,lcd_us,total_us,late\n")
+            for i, (size, read_size, packets, (sd_us, decode_us, lcd_us, total_us)) in enumerate(
+                    zip(frame_sizes, read_sizes, frame_packets, frame_times)):
+                report.write(f"frame,{i},{size},{read_size},{packets},{sd_us:.0f},{decode_us:.0f},"
+                             f"{lcd_us:.0f},{total_us:.0f},{int(total_us > budget_us)}\n")
+        print(f"  Report written to {report_path}")
+    
+    failures = []
+    if frame_sizes[largest] > max_frame_kb * 1024:
+        failures.append(f"frame {largest} is {frame_sizes[largest]} bytes, over the {max_frame_kb} KB limit")
+    if max_late_frames is not None and len(late) > max_late_frames:
+        failures.append(f"{len(late)} frames miss the {budget_us / 1000:.1f} ms budget, "
+                        f"more than the {max_late_frames} allowed")
+    return failures
+
+def convert_video(input_path, output_path, target_width=240, align='none', group_frames=8,
+                  audio_source=None, audio_rate=22050, audio_codec='adpcm', audio_lead=4,
+                  jobs=None, benchmark=False, rle='optimal', packet_cost=0, model=DEFAULT_MODEL,
+                  budget_ms=None, max_frame_kb=100, max_late_frames=None, report_path=None,
+                  repeat_threshold=0, codec='rle', tile_size=(16, 16), keyframe_interval=None,
+                  bilevel_threshold=None, dictionary_kb=32):
     # Open video
     cap = cv2.VideoCapture(input_path)
-    fps = int(cap.get(cv2.CAP_PROP_FPS))
+    source_fps = cap.get(cv2.CAP_PROP_FPS)
+    fps = int(source_fps)
+    # 29.97, 59.94, 23.976...: store the nominal rate and flag the 1000/1001 factor
+    nominal_fps = round(source_fps * 1001 / 1000)
+    ntsc_rate = abs(source_fps - nominal_fps * 1000 / 1001) < 0.005 and abs(source_fps - nominal_fps) > 0.005
+    if ntsc_rate:
+        fps = nominal_fps
     frame_count = int(cap.get(cv2.CAP_PROP_FRAME_COUNT))
     original_width = int(cap.get(cv2.CAP_PROP_FRAME_WIDTH))
     original_height = int(cap.get(cv2.CAP_PROP_FRAME_HEIGHT))
@@ -88,91 +916,475 @@ def convert_video(input_path, output_path, target_width=240):
     aspect_ratio = original_height / original_width
     target_height = int(target_width * aspect_ratio)
     
-    print(f"Input video: {frame_count} frames at {fps} FPS")
+    if ntsc_rate:
+        print(f"Input video: {frame_count} frames at {fps}/1.001 FPS")
+    else:
+        print(f"Input video: {frame_count} frames at {fps} FPS")
     print(f"Original resolution: {original_width}x{original_height}")
     print(f"Output format: {target_width}x{target_height} RGB565 (aspect ratio preserved)")
-    print(f"Compression: RLE")
+    parse = f"optimal parse with packets weighed as {packet_cost} bytes" if rle == 'optimal' and packet_cost else f"{rle} parse"
+    keyframe_interval = keyframe_interval or fps
+    if codec == 'tiles':
+        print(f"Compression: {tile_size[0]}x{tile_size[1]} tiles, unchanged, solid, RLE ({parse}) or raw; "
+              f"a self-contained frame at least every {keyframe_interval} frames")
+    elif codec == 'rects':
+        print(f"Compression: filled rectangles over the pixels that change; "
+              f"a self-contained frame at least every {keyframe_interval} frames")
+        if max(target_width, target_height) > RECT_FIELD_LIMIT:
+            sys.exit(f"Rectangle frames are at most {RECT_FIELD_LIMIT} pixels on a side")
+    elif codec == 'rows':
+        print(f"Compression: RLE rows ({parse}) or references to a row dictionary of up to {dictionary_kb} KB")
+    elif codec == 'spans':
+        print("Compression: two-colour spans, each row's colour flips predicted from the row above")
+        if target_width > SPAN_MAX_WIDTH:
+            sys.exit(f"Span frames are at most {SPAN_MAX_WIDTH} pixels wide")
+    elif codec == 'auto':
+        print(f"Compression: per frame, whichever of RLE ({parse}), raw, {tile_size[0]}x{tile_size[1]} tiles, "
+              f"rectangles, spans (two-colour frames only) and dictionary rows (up to {dictionary_kb} KB) "
+              f"the player is modelled to show fastest; a self-contained frame at least every "
+              f"{keyframe_interval} frames")
+    else:
+        print(f"Compression: RLE, {parse}")
+    if align == 'frame':
+        print(f"Layout: every frame starts on a {SECTOR_SIZE}-byte sector boundary")
+    elif align == 'group':
+        print(f"Layout: every group of {group_frames} frames starts on a {SECTOR_SIZE}-byte sector boundary")
+    if codec == 'spans' and bilevel_threshold is None:
+        bilevel_threshold = 128
+    if bilevel_threshold is not None:
+        print(f"Colours: two per frame, split at luma {bilevel_threshold}")
+    if repeat_threshold is not None:
+        print(f"Repeats: frames within {repeat_threshold} levels of the last stored frame"
+              if repeat_threshold else "Repeats: exact duplicates of the last stored frame")
+    
+    fps_num, fps_den = (fps * 1000, 1001) if ntsc_rate else (fps, 1)
+    compression = COMPRESSIONS[codec]
+    tile_shape = ((tile_size[0].bit_length() - 1) | ((tile_size[1].bit_length() - 1) << 4)
+                  if codec in ('tiles', 'auto') else 0)
+    flags = FLAG_MAX_FRAME_SIZE | (FLAG_SECTOR_ALIGNED if align != 'none' else 0)
+    if ntsc_rate:
+        flags |= FLAG_NTSC_RATE
+    
+    # The dictionary has to be written ahead of the frames, so rows are
+    # counted in a pass of their own.
+    jobs = jobs or os.cpu_count() or 1
+    row_dictionary = []
+    if codec == 'rows' or (codec == 'auto' and dictionary_kb):
+        row_dictionary = build_row_dictionary(input_path, frame_count, jobs, target_width, target_height,
+                                              bilevel_threshold, repeat_threshold, dictionary_kb * 1024)
+    if codec == 'rows' or row_dictionary:
+        flags |= FLAG_ROW_DICTIONARY
+    row_lookup = {row.tobytes(): i for i, row in enumerate(row_dictionary)}
+    
+    audio_chunks = []
+    if audio_source is not None:
+        flags |= FLAG_AUDIO
+        samples = load_audio(audio_source or input_path, audio_rate)
+        audio_chunks = encode_audio_chunks(samples, frame_count, fps_num, fps_den, audio_rate,
+                                           AUDIO_CODECS[audio_codec], audio_lead)
+        print(f"Audio: {len(samples) / audio_rate:.1f} s at {audio_rate} Hz, {audio_codec.upper()}, "
+              f"{audio_lead} frames ahead of the video")
     
     with open(output_path, 'wb') as f:
         # Write header (will update index offset later)
         # Header with RLE compression always enabled
-        header = struct.pack('<4sIHHBBBBI', 
+        header = struct.pack('<4sIHHBBBBII', 
                            b'VID0',           # magic
                            frame_count,       # frame count
                            target_width,      # width
                            target_height,     # height
                            fps,              # fps
-                           1,                # reserved[0] = compression type (1=RLE)
-                           0, 0,             # reserved[1], reserved[2]
-                           0)                # index offset (placeholder)
+                           compression,      # compression type (1=RLE, 2=tiles, 3=rects, 4=spans, 5=rows, 7=per frame)
+                           flags,            # layout flags
+                           tile_shape,       # log2 tile width and height (tiles and auto only)
+                           0,                # index offset (placeholder)
+                           0)                # largest frame (placeholder)
         f.write(header)
         
+        # The audio header follows the video header when the file has sound
+        if audio_chunks:
+            f.write(struct.pack('<4sIIBBBBHH',
+                                b'AUD0',                                        # magic
+                                audio_rate,                                     # sample rate
+                                sum(count for count, _ in audio_chunks),        # samples in total
+                                AUDIO_CODECS[audio_codec],                      # codec (1=PCM, 2=IMA ADPCM)
+                                1,                                              # channels
+                                audio_lead,                                     # lead frames
+                                0,                                              # reserved
+                                max(len(data) for _, data in audio_chunks),     # largest chunk payload
+                                0))                                             # reserved
+        
+        # Then the row dictionary, as raw rows
+        if flags & FLAG_ROW_DICTIONARY:
+            f.write(struct.pack('<4sHH', b'ROW0', len(row_dictionary), 0))
+            for row in row_dictionary:
+                f.write(row.astype('<u2').tobytes())
+        
         # Write frame index table (placeholders)
         index_offset = f.tell()
         frame_offsets = []
         frame_sizes = []  # Track compressed frame sizes
+        frame_packets = []
+        frame_work = []
+        frame_repeats = []
+        frame_deltas = []
         f.write(b'\x00' * (frame_count * 8))  # 4 bytes offset + 4 bytes size per frame
         
         # Process each frame
         total_uncompressed = 0
         total_compressed = 0
+        total_padding = 0
+        total_audio = 0
+        total_packets = 0
+        greedy_compressed = 0
+        greedy_packets = 0
+        repeat_saved = 0
+        rle_compressed = 0
+        rle_packets = 0
+        tile_modes = [0] * 4
+        frame_rects = []
+        span_modes = [0] * 3
+        row_hits = 0
+        row_saved = 0
+        rows_coded = 0
+        used_rows = set()
+        frame_codecs = collections.Counter()
+        last_key = None
+        stored_pixels = None
+        uncompressed_size = target_width * target_height * 2
         
-        for i in range(frame_count):
-            ret, frame = cap.read()
-            if not ret:
-                break
-                
-            # Resize frame
-            frame = cv2.resize(frame, (target_width, target_height))
+        # Frames are read here and encoded in worker processes a batch at a
+        # time, so memory stays bounded and frames are written in order.
+        pool = multiprocessing.Pool(jobs) if jobs > 1 else None
+        encoded_frames = (encoded
+                          for batch in read_batches(cap, frame_count, jobs * 4, target_width, target_height, rle, packet_cost,
+                                                    tile_size if codec in ('tiles', 'auto') else None,
+                                                    bilevel_threshold, codec == 'rows' or bool(row_dictionary))
+                          for encoded in (pool.map(encode_frame, batch) if pool else map(encode_frame, batch)))
+        start_time = time.perf_counter()
+        
+        for i, (compressed_data, packets, greedy_size, greedy_count, pixels, tiles, spans, rows) in enumerate(encoded_frames):
+            # Track uncompressed size
+            total_uncompressed += uncompressed_size
             
-            # Convert BGR to RGB
-            frame = cv2.cvtColor(frame, cv2.COLOR_BGR2RGB)
+            # A frame close enough to the last one stored only keeps its audio;
+            # comparing with the stored frame rather than the previous one keeps
+            # a slow change from drifting further than the threshold.
+            repeat = (stored_pixels is not None and repeat_threshold is not None and
+                      max_channel_difference(pixels, stored_pixels) <= repeat_threshold)
             
-            # Convert to RGB565
-            frame_data = []
-            for y in range(target_height):
-                for x in range(target_width):
-                    r, g, b = frame[y, x]
-                    rgb565 = rgb888_to_rgb565(r, g, b)
-                    frame_data.append(rgb565)
+            # Tiled and rectangle frames only store what differs from the
+            # picture on screen, which is the last stored frame, except for a
+            # self-contained frame at least every keyframe_interval frames so
+            # the player can start from there. Rectangles count as packets.
+            work = (target_width * target_height, target_width * target_height, 1)
+            delta = False
+            if codec == 'spans' and not repeat:
+                rle_compressed += len(compressed_data)
+                rle_packets += packets
+                compressed_data, packets, row_modes = spans
+                span_modes = [a + b for a, b in zip(span_modes, row_modes)]
+            elif codec == 'rows' and not repeat:
+                rle_compressed += len(compressed_data)
+                rle_packets += packets
+                compressed_data, packets, references, saved = assemble_row_frame(pixels, rows, row_lookup,
+                                                                                 target_width, target_height)
+                work = ((target_height - len(references)) * target_width, target_width * target_height, 1)
+                row_hits += len(references)
+                row_saved += saved
+                rows_coded += target_height
+            elif codec == 'auto' and not repeat:
+                rle_compressed += len(compressed_data)
+                rle_packets += packets
+                key = last_key is None or i - last_key >= keyframe_interval
+                candidates = [(COMPRESSION_RLE, compressed_data, packets, work, False),
+                              (COMPRESSION_RAW, pixels.astype('<u2').tobytes(), 0, work, False)]
+                changed = (np.ones(len(tiles), dtype=bool) if key else
+                           changed_tiles(pixels, stored_pixels, target_width, target_height, tile_size))
+                tiled, tile_packets, decoded, sent, windows, _ = assemble_tiled_frame(
+                    tiles, changed, target_width, target_height, tile_size)
+                candidates.append((COMPRESSION_TILES, tiled, tile_packets, (decoded, sent, windows), not changed.all()))
+                if max(target_width, target_height) <= RECT_FIELD_LIMIT:
+                    rects = cover_rectangles(pixels, None if key else stored_pixels, target_width, target_height)
+                    candidates.append((COMPRESSION_RECTS, assemble_rect_frame(rects), len(rects),
+                                       (0, sum(w * h for _, _, _, w, h in rects), len(rects)), not key))
+                if spans is not None and target_width <= SPAN_MAX_WIDTH:
+                    candidates.append((COMPRESSION_SPANS, spans[0], spans[1], work, False))
+                if row_dictionary:
+                    coded, row_packets, references, saved = assemble_row_frame(pixels, rows, row_lookup,
+                                                                               target_width, target_height)
+                    candidates.append((COMPRESSION_ROWS, coded, row_packets,
+                                       ((target_height - len(references)) * target_width,
+                                        target_width * target_height, 1), False))
+                chosen, compressed_data, packets, work, delta = choose_frame_codec(candidates, model)
+                compressed_data = bytes([chosen]) + compressed_data
+                frame_codecs[chosen] += 1
+                if chosen == COMPRESSION_ROWS:
+                    used_rows.update(references)
+                    row_hits += len(references)
+                    row_saved += saved
+                    rows_coded += target_height
+                if not delta:
+                    last_key = i
+            elif codec != 'rle' and not repeat:
+                rle_compressed += len(compressed_data)
+                rle_packets += packets
+                key = last_key is None or i - last_key >= keyframe_interval
+                if codec == 'tiles':
+                    changed = (np.ones(len(tiles), dtype=bool) if key else
+                               changed_tiles(pixels, stored_pixels, target_width, target_height, tile_size))
+                    compressed_data, packets, decoded, sent, windows, mode_counts = assemble_tiled_frame(
+                        tiles, changed, target_width, target_height, tile_size)
+                    work = (decoded, sent, windows)
+                    delta = not changed.all()
+                    tile_modes = [a + b for a, b in zip(tile_modes, mode_counts)]
+                else:
+                    rects = cover_rectangles(pixels, None if key else stored_pixels, target_width, target_height)
+                    compressed_data = assemble_rect_frame(rects)
+                    packets = len(rects)
+                    work = (0, sum(w * h for _, _, _, w, h in rects), len(rects))
+                    delta = not key
+                    frame_rects.append(len(rects))
+                if not delta:
+                    last_key = i
+            if not repeat:
+                stored_pixels = pixels
             
-            # Track uncompressed size
-            uncompressed_size = len(frame_data) * 2
-            total_uncompressed += uncompressed_size
+            # Pad so the frame (or its group) starts on a sector boundary
+            if align == 'frame' or (align == 'group' and i % group_frames == 0):
+                total_padding += pad_to_sector(f)
             
             # Record frame offset BEFORE writing
             frame_offsets.append(f.tell())
             
-            # Compress and write
-            compressed_data = compress_frame_rle(frame_data)
+            # Write the frame, after its audio chunk if there is sound
+            audio_data = b''
+            if audio_chunks:
+                sample_count, encoded = audio_chunks[i]
+                audio_data = struct.pack('<HH', len(encoded), sample_count) + encoded
+                total_audio += len(audio_data)
+            f.write(audio_data)
+            frame_repeats.append(repeat)
+            frame_deltas.append(delta)
+            if repeat:
+                frame_sizes.append(len(audio_data))
+                frame_packets.append(0)
+                frame_work.append((0, 0, 0))
+                repeat_saved += len(compressed_data)
+                print(f"{f'Frame {i+1}/{frame_count}: repeat of the last stored frame':<64}", end='\r')
+                continue
             f.write(compressed_data)
-            frame_sizes.append(len(compressed_data))
+            frame_sizes.append(len(audio_data) + len(compressed_data))
             total_compressed += len(compressed_data)
+            total_packets += packets
+            frame_packets.append(packets)
+            frame_work.append(work)
+            greedy_compressed += greedy_size
+            greedy_packets += greedy_count
             compression_ratio = (1 - len(compressed_data) / uncompressed_size) * 100
             print(f"Frame {i+1}/{frame_count}: {uncompressed_size} -> {len(compressed_data)} bytes ({compression_ratio:.1f}% reduction)", end='\r')
         
-        # Update header with index offset
+        encode_seconds = time.perf_counter() - start_time
+        if pool:
+            pool.close()
+            pool.join()
+        
+        # Pad the tail so the last frame can also be read as whole sectors
+        if align != 'none':
+            total_padding += pad_to_sector(f)
+        
+        # Update header with the repeats flag (only set when there are any, so
+        # older players can still play files without), index offset and
+        # largest frame
+        if any(frame_repeats):
+            flags |= FLAG_REPEATS
         current_pos = f.tell()
-        f.seek(16)  # Seek to index offset field (at byte 16)
-        f.write(struct.pack('<I', index_offset))
+        f.seek(14)  # Seek to layout flags field (at byte 14)
+        f.write(struct.pack('<BBII', flags, tile_shape, index_offset, max(frame_sizes, default=0)))
         f.seek(current_pos)  # Return to end of file
         
         # Write actual frame offsets and sizes
         f.seek(index_offset)
-        for offset, size in zip(frame_offsets, frame_sizes):
-            f.write(struct.pack('<II', offset, size))
+        for offset, size, repeat, delta in zip(frame_offsets, frame_sizes, frame_repeats, frame_deltas):
+            f.write(struct.pack('<II', offset, size | (INDEX_REPEAT if repeat else 0) | (INDEX_DELTA if delta else 0)))
     
     cap.release()
+    
+    # Which dictionary rows auto frames refer to is only known now
+    if codec == 'auto' and len(used_rows) < len(row_dictionary):
+        frame_offsets, frame_sizes, total_padding = trim_row_dictionary(output_path, used_rows, align, group_frames)
+        total_compressed = sum(frame_sizes) - total_audio
+        row_dictionary = [row_dictionary[row] for row in sorted(used_rows)]
+    
     print(f"\n\nConverted {len(frame_offsets)} frames to {output_path}")
     print(f"Output file size: {Path(output_path).stat().st_size / 1024 / 1024:.1f} MB")
     
     compression_ratio = (1 - total_compressed / total_uncompressed) * 100
     print(f"Total compression ratio: {compression_ratio:.1f}%")
     print(f"Uncompressed size would be: {total_uncompressed / 1024 / 1024:.1f} MB")
+    print(f"RLE packets: {total_packets} ({total_packets / max(len(frame_offsets), 1):.0f} per frame)")
+    if repeat_threshold is not None:
+        repeats = sum(frame_repeats)
+        print(f"Repeat frames: {repeats} of {len(frame_offsets)} ({repeats / max(len(frame_offsets), 1) * 100:.1f}%), "
+              f"{repeat_saved / 1024:.1f} KB of frame data and {repeats * uncompressed_size / 1024:.0f} KB "
+              f"of decode and LCD transfer removed")
+    if codec == 'tiles':
+        tiles = sum(tile_modes)
+        print("Tiles: " + ", ".join(f"{count / max(tiles, 1) * 100:.1f}% {name}"
+                                    for name, count in zip(TILE_MODE_NAMES, tile_modes)))
+    elif codec == 'rects' and frame_rects:
+        print(f"Rectangles: {sum(frame_rects) / len(frame_rects):.1f} per frame on average, "
+              f"{max(frame_rects)} at most; no frame buffer needed")
+    elif codec == 'spans':
+        rows = sum(span_modes)
+        print("Span rows: " + ", ".join(f"{count / max(rows, 1) * 100:.1f}% {name}"
+                                        for name, count in zip(SPAN_ROW_MODE_NAMES, span_modes)))
+    elif codec == 'auto':
+        stored = sum(frame_codecs.values())
+        print("Frames: " + ", ".join(f"{frame_codecs[compression] / max(stored, 1) * 100:.1f}% {name}"
+                                     for compression, name in COMPRESSION_NAMES.items()))
+    if codec == 'rows' or (codec == 'auto' and row_dictionary):
+        dictionary_bytes = len(row_dictionary) * target_width * 2
+        print(f"Row dictionary: {len(row_dictionary)} rows, {dictionary_bytes / 1024:.1f} of {dictionary_kb} KB of RAM; "
+              f"{row_hits / max(rows_coded, 1) * 100:.1f}% of rows found in it, saving {row_saved / 1024:.1f} KB "
+              f"of frame data for {dictionary_bytes / 1024:.1f} KB stored once")
+    if codec != 'rle':
+        print(f"Versus whole-frame RLE: {(total_compressed - rle_compressed) / 1024:+.1f} KB "
+              f"({(total_compressed / max(rle_compressed, 1) - 1) * 100:+.2f}%), "
+              f"{total_packets - rle_packets:+d} packets, "
+              f"{sum(decoded for decoded, _, _ in frame_work) / max(len(frame_offsets), 1):.0f} pixels decoded "
+              f"and {sum(sent for _, sent, _ in frame_work) / max(len(frame_offsets), 1):.0f} sent per frame")
+    elif rle != 'greedy' and greedy_compressed:
+        print(f"Versus greedy RLE: {(total_compressed - greedy_compressed) / 1024:+.1f} KB "
+              f"({(total_compressed / greedy_compressed - 1) * 100:+.2f}%), "
+              f"{total_packets - greedy_packets:+d} packets "
+              f"({(total_packets / max(greedy_packets, 1) - 1) * 100:+.2f}%)")
+    
+    if audio_chunks:
+        print(f"Audio data: {total_audio / 1024:.1f} KB")
+    
+    if align != 'none':
+        overhead = total_padding / (total_compressed + total_audio + total_padding) * 100
+        print(f"Sector padding: {total_padding / 1024:.1f} KB ({overhead:.1f}% of frame data)")
+    
+    if benchmark:
+        frames = len(frame_offsets)
+        print(f"Benchmark: {frames} frames in {encode_seconds:.2f} s "
+              f"({frames / max(encode_seconds, 1e-9):.1f} frames/s, {jobs} processes)")
+    
+    if frame_sizes:
+        failures = budget_report(frame_offsets, frame_sizes, frame_packets, frame_work, frame_repeats,
+                                 fps_num, fps_den, align != 'none', model, budget_ms, max_frame_kb,
+                                 max_late_frames, report_path)
+        if failures:
+            # The player could not play the file, so don't leave it around
+            Path(output_path).unlink()
+            sys.exit("Conversion failed: " + "; ".join(failures))
 
 if __name__ == "__main__":
-    if len(sys.argv) != 3:
-        print("Usage: python video_converter.py input.mp4 output.vid")
-        sys.exit(1)
+    parser = argparse.ArgumentParser(description="Convert a video to the VID0 format")
+    parser.add_argument("input", help="input video file (e.g. input.mp4)")
+    parser.add_argument("output", help="output .vid file")
+    parser.add_argument("--align", choices=['none', 'frame', 'group'], default='none',
+                        help="pad frames (or groups of frames) to 512-byte sector boundaries")
+    parser.add_argument("--group-frames", type=int, default=8,
+                        help="frames per sector-aligned group when --align=group (default: 8)")
+    parser.add_argument("--audio", nargs='?', const='', metavar="SOURCE",
+                        help="interleave a sound track, from SOURCE (a .wav file, or anything ffmpeg reads) "
+                             "or from the input video when no SOURCE is given")
+    parser.add_argument("--audio-rate", type=int, default=22050,
+                        help="audio sample rate in Hz (default: 22050)")
+    parser.add_argument("--audio-codec", choices=list(AUDIO_CODECS), default='adpcm',
+                        help="audio encoding: 16-bit PCM or 4-bit IMA ADPCM (default: adpcm)")
+    parser.add_argument("--audio-lead", type=int, default=4,
+                        help="frames of audio stored ahead of the video (default: 4)")
+    parser.add_argument("--jobs", type=int, default=None,
+                        help="frames encoded in parallel processes (default: one per CPU)")
+    parser.add_argument("--rle", choices=['optimal', 'greedy'], default='optimal',
+                        help="RLE parse: optimal, or the original greedy encoder (default: optimal)")
+    parser.add_argument("--rle-packet-cost", type=int, default=0, metavar="BYTES",
+                        help="weigh each RLE packet as this many extra bytes in the optimal parse; "
+                             "large values minimise the packet count (default: 0, the smallest file)")
+    parser.add_argument("--report", metavar="FILE",
+                        help="write the budget report's per-second SD bandwidth and per-frame cost as CSV")
+    parser.add_argument("--budget-ms", type=float, default=None,
+                        help="time the player has for each frame (default: the frame period)")
+    parser.add_argument("--sd-mbps", type=float, default=DEFAULT_MODEL.sd_mbps,
+                        help=f"modelled SD read throughput in MB/s (default: {DEFAULT_MODEL.sd_mbps:g})")
+    parser.add_argument("--sd-latency-us", type=int, default=DEFAULT_MODEL.sd_latency_us,
+                        help=f"modelled fixed cost of each frame read (default: {DEFAULT_MODEL.sd_latency_us})")
+    parser.add_argument("--spi-mhz", type=float, default=DEFAULT_MODEL.spi_mhz,
+                        help=f"modelled LCD SPI clock (default: {DEFAULT_MODEL.spi_mhz:g})")
+    parser.add_argument("--cpu-ns-per-packet", type=int, default=DEFAULT_MODEL.ns_per_packet,
+                        help=f"modelled decode time per RLE packet (default: {DEFAULT_MODEL.ns_per_packet})")
+    parser.add_argument("--cpu-ns-per-pixel", type=float, default=DEFAULT_MODEL.ns_per_pixel,
+                        help=f"modelled decode time per pixel (default: {DEFAULT_MODEL.ns_per_pixel:g})")
+    parser.add_argument("--max-frame-kb", type=int, default=100,
+                        help="fail when a frame (audio chunk included) is larger (default: 100)")
+    parser.add_argument("--max-late-frames", type=int, default=None,
+                        help="fail when more frames miss the budget in the model (default: never)")
+    parser.add_argument("--repeat-threshold", type=int, default=0, metavar="LEVELS",
+                        help="store frames whose red, green and blue all stay within this many 8-bit levels "
+                             "of the last stored frame as repeats of it (default: 0, exact duplicates only)")
+    parser.add_argument("--no-repeats", action="store_true",
+                        help="store every frame, for players without repeat support")
+    parser.add_argument("--codec", choices=list(COMPRESSIONS), default='rle',
+                        help="whole frames as RLE; tiles stored only when changed, each as a solid colour, "
+                             "RLE or raw pixels; filled rectangles covering the changes, for flat-colour "
+                             "animation; two-colour spans; RLE rows that may refer to a row dictionary the "
+                             "player keeps in RAM; or auto, each frame in whichever of these or raw pixels "
+                             "the throughput model says the player shows fastest (default: rle)")
+    parser.add_argument("--tile-size", default='16x16', metavar="WxH",
+                        help="tile width and height for --codec tiles and auto, powers of two from 8 to 64 "
+                             "(default: 16x16)")
+    parser.add_argument("--keyframe-interval", type=int, default=None, metavar="FRAMES",
+                        help="most frames between self-contained tiled or rectangle frames, which bound "
+                             "the work of seeking (default: one second)")
+    parser.add_argument("--bilevel-threshold", type=int, default=None, metavar="LEVEL",
+                        help="reduce every frame to two colours, split at this luma (0-255); --codec spans "
+                             "needs it (default: 128 for spans, else full colour)")
+    parser.add_argument("--dictionary-kb", type=int, default=32, metavar="KB",
+                        help="RAM the player may spend on the row dictionary of --codec rows and auto; 0 leaves "
+                             "dictionary rows out of auto (default: 32)")
+    parser.add_argument("--benchmark", action="store_true",
+                        help="print the encoding rate in frames per second")
+    args = parser.parse_args()
+    
+    if args.group_frames < 1:
+        parser.error("--group-frames must be at least 1")
+    if not 1 <= args.audio_lead <= 255:
+        parser.error("--audio-lead must be between 1 and 255")
+    if args.audio_rate < 1:
+        parser.error("--audio-rate must be positive")
+    if args.jobs is not None and args.jobs < 1:
+        parser.error("--jobs must be at least 1")
+    if args.rle_packet_cost < 0:
+        parser.error("--rle-packet-cost must not be negative")
+    if not 0 <= args.repeat_threshold <= 255:
+        parser.error("--repeat-threshold must be between 0 and 255")
+    try:
+        tile_size = tuple(int(n) for n in args.tile_size.lower().split('x'))
+    except ValueError:
+        tile_size = ()
+    if len(tile_size) != 2 or any(n not in (8, 16, 32, 64) for n in tile_size):
+        parser.error("--tile-size must be WxH with each a power of two from 8 to 64")
+    if args.bilevel_threshold is not None and not 0 <= args.bilevel_threshold <= 255:
+        parser.error("--bilevel-threshold must be between 0 and 255")
+    if args.dictionary_kb < 0:
+        parser.error("--dictionary-kb must not be negative")
+    if args.keyframe_interval is not None and args.keyframe_interval < 1:
+        parser.error("--keyframe-interval must be at least 1")
+    if min(args.sd_mbps, args.spi_mhz) <= 0 or (args.budget_ms is not None and args.budget_ms <= 0):
+        parser.error("--sd-mbps, --spi-mhz and --budget-ms must be positive")
     
-    convert_video(sys.argv[1], sys.argv[2])
\ No newline at end of file
+    convert_video(args.input, args.output, align=args.align, group_frames=args.group_frames,
+                  audio_source=args.audio, audio_rate=args.audio_rate, audio_codec=args.audio_codec,
+                  audio_lead=args.audio_lead, jobs=args.jobs, benchmark=args.benchmark, rle=args.rle,
+                  packet_cost=args.rle_packet_cost,
+                  model=ThroughputModel(args.sd_mbps, args.sd_latency_us, args.spi_mhz,
+                                        args.cpu_ns_per_packet, args.cpu_ns_per_pixel),
+                  budget_ms=args.budget_ms, max_frame_kb=args.max_frame_kb,
+                  max_late_frames=args.max_late_frames, report_path=args.report,
+                  repeat_threshold=None if args.no_repeats else args.repeat_threshold, codec=args.codec,
+                  tile_size=tile_size, keyframe_interval=args.keyframe_interval,
+                  bilevel_threshold=args.bilevel_threshold, dictionary_kb=args.dictionary_kb)
\ No newline at end of file